@@ -2,6 +2,7 @@
 #include "util/assertion.h"
 #include "core/lisp_vm.h"
 #include "core/lisp_lambda.h"
+#include "core/lisp_asm.h"
 /* 
  * @todo typecheck for values
  * @todo overflow check and high prec. arithmetric
@@ -27,14 +28,123 @@ static int lisp_builtin_plus(lisp_eval_env_t     * env,
   return LISP_OK;
 }
 
+/* (- a) is -a, (- a b c ...) is a - b - c ... */
+static int lisp_builtin_minus(lisp_eval_env_t     * env,
+                              const lisp_lambda_t * lambda,
+                              lisp_size_t           nargs)
+{
+  lisp_cell_t * stack = env->stack + env->stack_top - nargs;
+  lisp_integer_t i;
+  env->n_values = 1;
+  *env->values  = lisp_nil;
+  if(nargs == 0) 
+  {
+    return LISP_EVAL_ERROR;
+  }
+  for(i = 0; i < nargs; i++) 
+  {
+    if(!LISP_IS_INTEGER(&stack[i])) 
+    {
+      return LISP_TYPE_ERROR;
+    }
+  }
+  env->values->type_id      = LISP_TID_INTEGER;
+  env->values->data.integer = (nargs == 1 ? 
+                               -stack[0].data.integer : 
+                               stack[0].data.integer);
+  for(i = 1; i < nargs; i++) 
+  {
+    env->values->data.integer-= stack[i].data.integer;
+  }
+  return LISP_OK;
+}
+
+static int lisp_builtin_times(lisp_eval_env_t     * env,
+                              const lisp_lambda_t * lambda,
+                              lisp_size_t           nargs)
+{
+  lisp_cell_t * stack = env->stack + env->stack_top - nargs;
+  lisp_integer_t i;
+  env->values->type_id      = LISP_TID_INTEGER;
+  env->values->data.integer = 1;
+  env->n_values             = 1;
+  for(i = 0; i < nargs; i++) 
+  {
+    if(!LISP_IS_INTEGER(&stack[i])) 
+    {
+      *env->values = lisp_nil;
+      return LISP_TYPE_ERROR;
+    }
+    env->values->data.integer*= stack[i].data.integer;
+  }
+  return LISP_OK;
+}
+
+/* 1 if the arguments are strictly increasing, nil otherwise */
+static int lisp_builtin_less(lisp_eval_env_t     * env,
+                             const lisp_lambda_t * lambda,
+                             lisp_size_t           nargs)
+{
+  lisp_cell_t * stack = env->stack + env->stack_top - nargs;
+  lisp_integer_t i;
+  int            less = 1;
+  env->n_values = 1;
+  *env->values  = lisp_nil;
+  if(nargs == 0) 
+  {
+    return LISP_EVAL_ERROR;
+  }
+  for(i = 0; i < nargs; i++) 
+  {
+    if(!LISP_IS_INTEGER(&stack[i])) 
+    {
+      return LISP_TYPE_ERROR;
+    }
+    if(i > 0 && stack[i - 1].data.integer >= stack[i].data.integer) 
+    {
+      less = 0;
+    }
+  }
+  if(less) 
+  {
+    lisp_make_integer(env->values, 1);
+  }
+  return LISP_OK;
+}
+
 int lisp_make_func_plus(struct lisp_vm_t * vm,
                         struct lisp_cell_t * cell)
 {
   /* @todo make arguments */
-  return lisp_make_builtin_lambda(vm,
-                                  cell,
-                                  0,
-                                  NULL,
-                                  lisp_builtin_plus);
+  return lisp_make_builtin_lambda_op(vm,
+                                     cell,
+                                     lisp_builtin_plus,
+                                     LISP_ASM_ADD2);
+}
+
+int lisp_make_func_minus(struct lisp_vm_t * vm,
+                         struct lisp_cell_t * cell)
+{
+  return lisp_make_builtin_lambda_op(vm,
+                                     cell,
+                                     lisp_builtin_minus,
+                                     LISP_ASM_SUB2);
+}
+
+int lisp_make_func_times(struct lisp_vm_t * vm,
+                         struct lisp_cell_t * cell)
+{
+  return lisp_make_builtin_lambda_op(vm,
+                                     cell,
+                                     lisp_builtin_times,
+                                     LISP_ASM_MUL2);
 }
 
+int lisp_make_func_less(struct lisp_vm_t * vm,
+                        struct lisp_cell_t * cell)
+{
+  return lisp_make_builtin_lambda_op(vm,
+                                     cell,
+                                     lisp_builtin_less,
+                                     LISP_ASM_LT2);
+}
@@ -8,5 +8,16 @@ struct lisp_cell_t;
 int lisp_make_func_plus(struct lisp_vm_t * vm, 
 			struct lisp_cell_t * cell);
 
+int lisp_make_func_minus(struct lisp_vm_t * vm, 
+			 struct lisp_cell_t * cell);
+
+int lisp_make_func_times(struct lisp_vm_t * vm, 
+			 struct lisp_cell_t * cell);
+
+/** (< a b ...), 1 if the arguments are strictly increasing, 
+ *  nil otherwise */
+int lisp_make_func_less(struct lisp_vm_t * vm, 
+			struct lisp_cell_t * cell);
+
 
 #endif
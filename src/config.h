@@ -0,0 +1,20 @@
+/* src/config.h.  Generated from config.h.in by configure.  */
+#define HAS_FMEMOPEN
+#define HAS_MMAP
+#define HAS_PTHREAD
+
+/* Pack cells to 12 and conses to 28 bytes, see lisp_type.h */
+/* #define LISP_COMPACT_CELL */
+#define WITH_COLOR
+
+/* Default max. size of values register
+ * The values register is reallocated on demand
+ */
+#define LISP_EVAL_DEFAULT_MAX_VALUES 10
+
+#define LISP_MAX_STACK_SIZE             1024
+#define LISP_STACK_INIT_BLOCK_SIZE      32
+
+#define LISP_CALL_STACK_INIT_BLOCK_SIZE 32
+#define LISP_MAX_CALL_STACK_SIZE        1024
+
@@ -12,6 +12,11 @@
 #define LISP_ASM_PUSHD     0x03
 #define LISP_SIZ_PUSHD     sizeof(lisp_instr_t) + sizeof(lisp_cell_t)
 
+/* PUSHV: push the first value (nil without values), the values 
+   are released */
+#define LISP_ASM_PUSHV     0x04
+#define LISP_SIZ_PUSHV     sizeof(lisp_instr_t)
+
 #define LISP_ASM_RET       0x10
 #define LISP_SIZ_RET       sizeof(lisp_instr_t)
 
@@ -22,10 +27,142 @@
 #define LISP_ASM_HALT      0x12
 #define LISP_SIZ_HALT      sizeof(lisp_instr_t)
 
+/* CALL n, L: call L with the n arguments at the top of the stack,
+   the evaluation continues after CALL when L returns */
+#define LISP_ASM_CALL      0x13
+#define LISP_SIZ_CALL      sizeof(lisp_instr_t) + sizeof(lisp_size_t) + \
+                           sizeof(lisp_lambda_t*)
+
+/* CALLR n, S and JPR n, S: CALL and JP of the lambda bound to the 
+   symbol S, LISP_TYPE_ERROR if it is not a lambda */
+#define LISP_ASM_CALLR     0x14
+#define LISP_SIZ_CALLR     sizeof(lisp_instr_t) + sizeof(lisp_size_t) + \
+                           sizeof(lisp_cell_t)
+
+#define LISP_ASM_JPR       0x15
+#define LISP_SIZ_JPR       sizeof(lisp_instr_t) + sizeof(lisp_size_t) + \
+                           sizeof(lisp_cell_t)
+
+/* FIXR S: guard of the fixnum instruction that follows, emitted for 
+   (S A B) if S is bound to a builtin lambda with a fixnum instruction.
+   While S is bound to a lambda with the same instruction the 
+   evaluation continues with it, otherwise FIXR is CALLR 2, S and 
+   the call returns after the fixnum instruction. */
+#define LISP_ASM_FIXR      0x16
+#define LISP_SIZ_FIXR      sizeof(lisp_instr_t) + sizeof(lisp_cell_t)
+
+/* CALLV n and JPV n: CALL and JP of the lambda below the n arguments
+   at the top of the stack, the lambda is removed from the stack. 
+   Emitted for calls with a call as head, ((F) A B). 
+   LISP_TYPE_ERROR if the value is not a lambda. */
+#define LISP_ASM_CALLV     0x17
+#define LISP_SIZ_CALLV     sizeof(lisp_instr_t) + sizeof(lisp_size_t)
+
+#define LISP_ASM_JPV       0x18
+#define LISP_SIZ_JPV       sizeof(lisp_instr_t) + sizeof(lisp_size_t)
+
 #define LISP_ASM_BUILTIN   0x20
 #define LISP_SIZ_BUILTIN   sizeof(lisp_instr_t) + \
                            sizeof(lisp_builtin_function_t)
 
+/* Fixnum instructions: pop the two integers A and B at the top of 
+   the stack, values <- result. LISP_TYPE_ERROR for other types, 
+   LISP_RANGE_ERROR if the result overflows lisp_integer_t. 
+   The compiler emits them for calls of builtin lambdas with two 
+   arguments, see lisp_make_builtin_lambda_op(), behind FIXR if the 
+   lambda is bound to a symbol. */
+#define LISP_ASM_ADD2      0x28 /* ADD2: A + B */
+#define LISP_SIZ_ADD2      sizeof(lisp_instr_t)
+
+#define LISP_ASM_SUB2      0x29 /* SUB2: A - B */
+#define LISP_SIZ_SUB2      sizeof(lisp_instr_t)
+
+#define LISP_ASM_MUL2      0x2a /* MUL2: A * B */
+#define LISP_SIZ_MUL2      sizeof(lisp_instr_t)
+
+#define LISP_ASM_LT2       0x2b /* LT2:  1 if A < B, nil otherwise */
+#define LISP_SIZ_LT2       sizeof(lisp_instr_t)
+
+#define LISP_IS_FIXNUM_INSTR(__INSTR__)                 \
+  ((__INSTR__) >= LISP_ASM_ADD2 && (__INSTR__) <= LISP_ASM_LT2)
+
+/* Superinstructions, formed from common sequences when the byte code 
+   is decoded. They do not appear in the byte code itself. */
+#define LISP_ASM_LDVD_RET  0x30 /* LDVD  A; RET */
+#define LISP_ASM_LDVR_RET  0x31 /* LDVR  S; RET */
+#define LISP_ASM_PUSHD2    0x32 /* PUSHD A; PUSHD B */
+#define LISP_ASM_PUSHDN_JP 0x33 /* PUSHD A_1; ... PUSHD A_n; JP */
+
+/* Register instructions, evaluated by lisp_eval_lambda_reg().
+   The registers R0 .. Rn-1 of a frame are cells of env->stack, 
+   the arguments of the call are the first registers. 
+   A lambda in register code starts with RFRAME. */
+#define LISP_ASM_RFRAME    0x40 /* RFRAME n:        reserve n registers */
+#define LISP_SIZ_RFRAME    sizeof(lisp_instr_t) + sizeof(lisp_size_t)
+
+#define LISP_ASM_RMOVD     0x41 /* RMOVD  Rd, A:    Rd <- A */
+#define LISP_SIZ_RMOVD     sizeof(lisp_instr_t) + sizeof(lisp_size_t) + \
+                           sizeof(lisp_cell_t)
+
+#define LISP_ASM_RMOVR     0x42 /* RMOVR  Rd, S:    Rd <- value of S */
+#define LISP_SIZ_RMOVR     sizeof(lisp_instr_t) + sizeof(lisp_size_t) + \
+                           sizeof(lisp_cell_t)
+
+#define LISP_ASM_RMOV      0x43 /* RMOV   Rd, Rs:   Rd <- Rs */
+#define LISP_SIZ_RMOV      sizeof(lisp_instr_t) + 2 * sizeof(lisp_size_t)
+
+/* RCALL Rd, Rs, n, L: Rd <- (L Rs .. Rs+n-1) */
+#define LISP_ASM_RCALL     0x44
+#define LISP_SIZ_RCALL     sizeof(lisp_instr_t) + 3 * sizeof(lisp_size_t) + \
+                           sizeof(lisp_lambda_t*)
+
+#define LISP_ASM_RRET      0x45 /* RRET   Rs:       values <- Rs, pop frame */
+#define LISP_SIZ_RRET      sizeof(lisp_instr_t) + sizeof(lisp_size_t)
+
+/** Instruction decoded from the byte code when a lambda is evaluated
+ *  for the first time. The operands are aligned, handler is the 
+ *  entry of the threaded dispatch (NULL for the switch). 
+ *  The array is terminated by a slot with opcode 0 at offset instr_size.
+ */
+typedef struct lisp_decoded_instr_t
+{
+  const void   * handler;
+  lisp_instr_t   opcode;
+  /** FIXR: fixnum instruction of the cached binding, 0 for other values */
+  lisp_instr_t   fixnum;
+  /** offset of the instruction in the byte code */
+  lisp_size_t    offset;
+  union
+  {
+    lisp_cell_t              cell;
+    /** PUSHD2 */
+    lisp_cell_t              cells[2];
+    lisp_builtin_function_t  builtin;
+    /** LDVR, LDVR_RET, CALLR, JPR and FIXR, binding is the cached 
+     *  result of lisp_symbol_get(), valid while epoch is 
+     *  vm->symbol_epoch */
+    struct
+    {
+      lisp_cell_t            symbol;
+      lisp_cell_t          * binding;
+      lisp_size_t            epoch;
+      lisp_size_t            nargs;
+    } ldvr;
+    /** JP, CALL, CALLV, JPV (lambda NULL) and PUSHDN_JP, the n_push 
+     *  cells of PUSHDN_JP are stored in the following slots */
+    struct
+    {
+      lisp_size_t            nargs;
+      lisp_lambda_t        * lambda;
+      lisp_size_t            n_push;
+    } jp;
+  } arg;
+} lisp_decoded_instr_t;
+
+/** Size of the byte code instruction opcode, 0 for opcodes that do 
+ *  not appear in byte code. */
+lisp_size_t lisp_instr_size(lisp_instr_t opcode);
+
 #define LISP_INSTR_ARG(__INSTR__, __TYPE__)     \
   ((__TYPE__*)((__INSTR__) + 1))
 
@@ -38,6 +175,10 @@
     *LISP_INSTR_ARG(__INSTR__, __TYPE__) = (__VALUE__);              \
   }
 
+/* operand of type __TYPE__ after __I__ register operands */
+#define LISP_INSTR_ARG_N(__INSTR__, __I__, __TYPE__)            \
+  ((__TYPE__*)((lisp_size_t*)((__INSTR__) + 1) + (__I__)))
+
 #define LISP_SET_INSTR_2(__TYPE_ID__, __INSTR__, __TYPE__, __VALUE__,   \
                          __TYPE2__, __VALUE2__)                         \
   {                                                                     \
@@ -1,7 +1,26 @@
+#include "config.h"
+#if defined(HAS_MMAP) || defined(HAS_PTHREAD)
+#define _DEFAULT_SOURCE
+#endif
 #include "lisp_vm.h"
 #include "util/xmalloc.h"
 #include "util/assertion.h"
 #include "util/mock.h"
+#include <stdint.h>
+#ifdef HAS_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef HAS_PTHREAD
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#endif
+
+/* defined in lisp_vm.c */
+void   _lisp_defer_object_frees(lisp_vm_t * vm);
+void * _lisp_take_deferred_objects(lisp_vm_t * vm);
+void   _lisp_free_deferred_objects(void * list);
 
 static inline int _lisp_make_cons(lisp_vm_t     * vm,
                                   lisp_cell_t   * cell,
@@ -27,8 +46,14 @@ static inline int _lisp_init_cons_car_cdr(lisp_vm_t * vm,
 					   
 
 static inline lisp_cons_t * _new_cons_page(lisp_vm_t * vm);
+static inline void          _free_cons_page(lisp_vm_t * vm,
+                                            lisp_cons_t * page);
 static inline int           _ensure_root_cons_table(lisp_vm_t * vm);
 static inline int           _ensure_cons_table(lisp_vm_t * vm);
+static inline int           _grow_cons_table(lisp_vm_t * vm);
+static int                  _ensure_cons_run(lisp_vm_t     * vm, 
+                                             lisp_size_t     n,
+                                             lisp_cons_t *** run);
 static inline lisp_cons_t * _insert_root_cons(lisp_vm_t * vm,
                                               lisp_cons_t * cons);
 static inline lisp_cons_t * _add_root_cons(lisp_vm_t * vm);
@@ -40,6 +65,39 @@ static inline lisp_cons_t * _insert_black_cons(lisp_vm_t * vm,
 static inline void          _ensure_not_white(lisp_vm_t   * vm,
                                               lisp_cons_t * cons);
 
+static inline void          _gc_sweep_cons(lisp_vm_t   * vm,
+                                           lisp_cons_t * cons);
+static inline void          _gc_grey_children(lisp_vm_t   * vm,
+                                              lisp_cons_t * cons);
+static void                 _gc_scan_roots(lisp_vm_t * vm);
+static inline void          _gc_blacken_grey(lisp_vm_t * vm);
+static void                 _gc_end_cycle(lisp_vm_t * vm);
+static void                 _gc_mark_step(lisp_vm_t * vm,
+                                          lisp_size_t n_conses);
+static inline void          _gc_alloc_tick(lisp_vm_t * vm);
+static inline void          _gc_alloc_ticks(lisp_vm_t * vm,
+                                            lisp_size_t n);
+static void                 _gc_release_step(lisp_vm_t * vm,
+                                             lisp_size_t n_conses);
+static void                 _gc_release_free_pages(lisp_vm_t * vm);
+static inline int           _gc_push_cons(lisp_vm_t    * vm,
+                                          lisp_cons_t *** list,
+                                          lisp_size_t  * top,
+                                          lisp_size_t  * size,
+                                          lisp_cons_t  * cons);
+static inline void          _gc_add_young(lisp_vm_t   * vm,
+                                          lisp_cons_t * cons);
+static inline void          _gc_remember(lisp_vm_t         * vm,
+                                         lisp_cons_t       * cons,
+                                         const lisp_cell_t * child);
+static void                 _gc_reset_nursery(lisp_vm_t * vm);
+#ifdef HAS_PTHREAD
+static int                  _gc_parallel_collect(lisp_vm_t * vm);
+#endif
+static void                 _gc_sweeper_hand_off(lisp_vm_t * vm);
+static int                  _gc_sweeper_reclaim(lisp_vm_t * vm);
+static void                 _gc_sweeper_sync(lisp_vm_t * vm);
+
 /**********************************************************************
  * 
  * public make_cons functions 
@@ -129,14 +187,6 @@ int lisp_cons_root(lisp_vm_t * vm, lisp_cons_t * cons)
     lisp_size_t index = cons->gc_cons_index;
     REQUIRE_EQ_PTR(cons, vm->cons_table[index]);
     lisp_cons_t * tmp = _insert_root_cons(vm, cons);
-    if(LISP_IS_CONS_OBJECT(&cons->car)) 
-    {
-      _ensure_not_white(vm, cons->car.data.cons);
-    }
-    if(LISP_IS_CONS_OBJECT(&cons->cdr)) 
-    {
-      _ensure_not_white(vm, cons->cdr.data.cons);
-    }
     if(tmp == NULL) 
     {
       return LISP_ALLOC_ERROR;
@@ -151,7 +201,7 @@ int lisp_cons_root(lisp_vm_t * vm, lisp_cons_t * cons)
 	vm->cons_table[index]->gc_cons_index = index;
       }
       vm->cons_table[vm->black_cons_top] = tmp;
-      return LISP_OK;
+      tmp->gc_cons_index = vm->black_cons_top;
     }
     else if(index < vm->grey_cons_top) 
     {
@@ -163,9 +213,9 @@ int lisp_cons_root(lisp_vm_t * vm, lisp_cons_t * cons)
 	vm->cons_table[index]->gc_cons_index = index;
       }
       vm->cons_table[vm->grey_cons_begin] = tmp;
+      tmp->gc_cons_index = vm->grey_cons_begin;
       ++vm->grey_cons_begin;
       REQUIRE_LE_U(vm->grey_cons_begin, vm->grey_cons_top);
-      return LISP_OK;
     }
     else 
     {
@@ -177,7 +227,16 @@ int lisp_cons_root(lisp_vm_t * vm, lisp_cons_t * cons)
 	vm->cons_table[index]->gc_cons_index = index;
       }
       vm->cons_table[vm->white_cons_top] = tmp;
-      return LISP_OK;
+      tmp->gc_cons_index = vm->white_cons_top;
+    }
+    /* write barrier, cons must have left the cons table */
+    if(LISP_IS_CONS_OBJECT(&cons->car)) 
+    {
+      _ensure_not_white(vm, cons->car.data.cons);
+    }
+    if(LISP_IS_CONS_OBJECT(&cons->cdr)) 
+    {
+      _ensure_not_white(vm, cons->cdr.data.cons);
     }
   }
   return LISP_OK;
@@ -199,10 +258,19 @@ int lisp_cons_unroot(lisp_vm_t * vm, lisp_cons_t * cons)
 	vm->root_cons_table[cons->gc_cons_index].ref_count++;
 	return LISP_ALLOC_ERROR;
       }
-      vm->root_cons_table[index] = vm->root_cons_table[vm->root_cons_top];
-      vm->root_cons_table[index].cons->gc_cons_index = index;
       vm->root_cons_top--;
-      vm->root_cons_table[vm->root_cons_top].cons = tmp;
+      if(index != vm->root_cons_top) 
+      {
+	/* not the last root */
+	vm->root_cons_table[index] = vm->root_cons_table[vm->root_cons_top];
+	vm->root_cons_table[index].cons->gc_cons_index = index;
+      }
+      vm->root_cons_table[vm->root_cons_top].cons      = tmp;
+      vm->root_cons_table[vm->root_cons_top].ref_count = 0;
+      tmp->gc_cons_index = vm->root_cons_top;
+      /* the children are no longer scanned as children of a root */
+      _gc_remember(vm, cons, &cons->car);
+      _gc_remember(vm, cons, &cons->cdr);
       return LISP_OK;
     }
     return LISP_OK;
@@ -266,8 +334,14 @@ int lisp_cons_set_car_cdr(lisp_vm_t * vm,
   +----------------------------+ <- grey_top      
   | white conses               |
   +----------------------------+ <- white_top     
+  | unswept conses             |
+  +----------------------------+ <- sweep_top (if > white_top)
   | disposed_conses_2          |
   +----------------------------+ <- cons_table_size
+
+  Disposed conses are kept with nil car and cdr. 
+  Unswept conses are unreachable conses of the last gc cycle
+  whose car and cdr have not been released yet.
 */
 
 int _lisp_init_cons_car_cdr(lisp_vm_t         * vm,
@@ -295,6 +369,7 @@ int _lisp_init_cons_car_cdr(lisp_vm_t         * vm,
       {
 	_ensure_not_white(vm, car->data.cons);
       }
+      _gc_remember(vm, cons, car);
       cons->car.type_id = car->type_id;
       cons->car.data    = car->data;
     }
@@ -319,6 +394,7 @@ int _lisp_init_cons_car_cdr(lisp_vm_t         * vm,
       {
 	_ensure_not_white(vm, cdr->data.cons);
       }
+      _gc_remember(vm, cons, cdr);
       cons->cdr.type_id   = cdr->type_id;
       cons->cdr.data.cons = cdr->data.cons;
     }
@@ -330,6 +406,7 @@ int _lisp_make_cons(lisp_vm_t     * vm,
                     lisp_cell_t   * cell,
                     lisp_type_id_t  type_id)
 {
+  _gc_alloc_tick(vm);
   if(_ensure_cons_table(vm)) 
   {
     return LISP_ALLOC_ERROR;
@@ -337,6 +414,7 @@ int _lisp_make_cons(lisp_vm_t     * vm,
   register lisp_cons_t * cons = vm->cons_table[vm->white_cons_top];
   cons->is_root = 0;
   cons->gc_cons_index = vm->white_cons_top;
+  _gc_add_young(vm, cons);
   cons->car = lisp_nil;
   cons->cdr = lisp_nil;
   vm->white_cons_top++;
@@ -351,6 +429,7 @@ static inline int _lisp_make_cons_car_cdr(lisp_vm_t     * vm,
 					  const lisp_cell_t * car, 
 					  const lisp_cell_t * cdr)
 {
+  _gc_alloc_tick(vm);
   if(_ensure_cons_table(vm)) 
   {
     return LISP_ALLOC_ERROR;
@@ -358,6 +437,7 @@ static inline int _lisp_make_cons_car_cdr(lisp_vm_t     * vm,
   register lisp_cons_t * cons = vm->cons_table[vm->white_cons_top];
   cons->is_root = 0;
   cons->gc_cons_index = vm->white_cons_top;
+  _gc_add_young(vm, cons);
   if(lisp_copy_object(vm, &cons->car, car)) return LISP_ALLOC_ERROR;
   if(lisp_copy_object(vm, &cons->cdr, cdr)) return LISP_ALLOC_ERROR;
   vm->white_cons_top++;
@@ -375,7 +455,6 @@ int _lisp_make_cons_root(lisp_vm_t     * vm,
   {
     return LISP_ALLOC_ERROR;
   }
-  vm->root_cons_table[vm->root_cons_top].ref_count = 1;
   cons->car = lisp_nil;
   cons->cdr = lisp_nil;
   cell->type_id = type_id;
@@ -395,7 +474,6 @@ int _lisp_make_cons_root_car_cdr(lisp_vm_t     * vm,
   {
     return LISP_ALLOC_ERROR;
   }
-  vm->root_cons_table[vm->root_cons_top].ref_count = 1;
   cons->car = lisp_nil;
   cons->cdr = lisp_nil;
   int ret = _lisp_init_cons_car_cdr(vm, cons, car, cdr);
@@ -405,16 +483,152 @@ int _lisp_make_cons_root_car_cdr(lisp_vm_t     * vm,
 }
 
 
+/**********************************************************************
+ * 
+ * cons pages
+ *
+ **********************************************************************/
+void _lisp_init_cons_arena(lisp_vm_t * vm, const lisp_vm_param_t * param)
+{
+  vm->cons_arena              = NULL;
+  vm->cons_arena_stride       = 0;
+  vm->cons_arena_n_pages      = 0;
+  vm->cons_arena_top          = 0;
+  vm->cons_arena_free_pages   = NULL;
+  vm->n_cons_arena_free_pages = 0;
+#ifdef HAS_MMAP
+  if(param->cons_arena_size) 
+  {
+    size_t os_page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t stride  = sizeof(lisp_cons_t) * vm->cons_page_size;
+    lisp_size_t n_pages;
+    stride  = (stride + os_page - 1) / os_page * os_page;
+    n_pages = (param->cons_arena_size + vm->cons_page_size - 1) / 
+      vm->cons_page_size;
+    /* page tables are never reallocated while the arena has pages */
+    vm->cons_pages            = MALLOC(sizeof(lisp_cons_t*) * n_pages);
+    vm->cons_arena_free_pages = MALLOC(sizeof(lisp_cons_t*) * n_pages);
+    if(vm->cons_pages != NULL && vm->cons_arena_free_pages != NULL) 
+    {
+      /* reserve address space only, pages are committed on demand */
+      vm->cons_arena = mmap(NULL, 
+                            stride * n_pages,
+                            PROT_NONE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                            -1, 
+                            0);
+    }
+    if(vm->cons_arena == NULL || vm->cons_arena == MAP_FAILED) 
+    {
+      /* fall back to malloc'd pages */
+      vm->cons_arena = NULL;
+      if(vm->cons_pages != NULL) FREE(vm->cons_pages);
+      if(vm->cons_arena_free_pages != NULL) FREE(vm->cons_arena_free_pages);
+      vm->cons_pages            = NULL;
+      vm->cons_arena_free_pages = NULL;
+      return;
+    }
+#ifdef MADV_HUGEPAGE
+    if(param->cons_arena_huge_pages) 
+    {
+      madvise(vm->cons_arena, stride * n_pages, MADV_HUGEPAGE);
+    }
+#endif
+    vm->cons_arena_stride  = stride;
+    vm->cons_arena_n_pages = n_pages;
+  }
+#endif
+}
+
+void _lisp_free_cons_pages(lisp_vm_t * vm)
+{
+  lisp_size_t i;
+  for(i = 0; i < vm->n_cons_pages; i++) 
+  {
+    _free_cons_page(vm, vm->cons_pages[i]);
+  }
+  if(vm->cons_pages) 
+  {
+    FREE(vm->cons_pages);
+  }
+#ifdef HAS_MMAP
+  if(vm->cons_arena) 
+  {
+    munmap(vm->cons_arena, vm->cons_arena_stride * vm->cons_arena_n_pages);
+    FREE(vm->cons_arena_free_pages);
+  }
+#endif
+}
+
+static inline int _is_arena_cons_page(lisp_vm_t * vm, lisp_cons_t * page)
+{
+  return (vm->cons_arena != NULL &&
+          (char*) page >= (char*) vm->cons_arena &&
+          (char*) page <  ((char*) vm->cons_arena + 
+                           vm->cons_arena_stride * vm->cons_arena_n_pages));
+}
+
+static inline lisp_cons_t * _new_arena_cons_page(lisp_vm_t * vm)
+{
+#ifdef HAS_MMAP
+  char * page;
+  if(vm->n_cons_arena_free_pages) 
+  {
+    return vm->cons_arena_free_pages[--vm->n_cons_arena_free_pages];
+  }
+  if(vm->cons_arena_top == vm->cons_arena_n_pages) 
+  {
+    return NULL;
+  }
+  page = (char*) vm->cons_arena + vm->cons_arena_top * vm->cons_arena_stride;
+  if(mprotect(page, vm->cons_arena_stride, PROT_READ | PROT_WRITE)) 
+  {
+    return NULL;
+  }
+  vm->cons_arena_top++;
+  return (lisp_cons_t*) page;
+#else
+  return NULL;
+#endif
+}
+
+static inline void _free_cons_page(lisp_vm_t * vm, lisp_cons_t * page)
+{
+#ifdef HAS_MMAP
+  if(_is_arena_cons_page(vm, page)) 
+  {
+    /* keep the mapping, return the memory to the os */
+    madvise(page, vm->cons_arena_stride, MADV_DONTNEED);
+    vm->cons_arena_free_pages[vm->n_cons_arena_free_pages++] = page;
+    return;
+  }
+#endif
+  FREE(page);
+}
+
 static inline lisp_cons_t * _new_cons_page(lisp_vm_t * gc) 
 {
+  lisp_size_t   i;
   lisp_cons_t * cons_array;
   lisp_cons_t ** pages;
-  pages = REALLOC(gc->cons_pages, 
-		  sizeof(lisp_cons_t**) * (gc->n_cons_pages + 1) );
-  if(pages == NULL) return NULL;
-  gc->cons_pages = pages;
-  cons_array = MALLOC(sizeof(lisp_cons_t) * gc->cons_page_size);
+  if(gc->n_cons_pages >= gc->cons_arena_n_pages) 
+  {
+    pages = REALLOC(gc->cons_pages, 
+                    sizeof(lisp_cons_t**) * (gc->n_cons_pages + 1) );
+    if(pages == NULL) return NULL;
+    gc->cons_pages = pages;
+  }
+  cons_array = _new_arena_cons_page(gc);
+  if(cons_array == NULL) 
+  {
+    cons_array = MALLOC(sizeof(lisp_cons_t) * gc->cons_page_size);
+  }
   if(cons_array == NULL) return NULL;
+  for(i = 0; i < gc->cons_page_size; i++) 
+  {
+    cons_array[i].car = lisp_nil;
+    cons_array[i].cdr = lisp_nil;
+  }
   gc->cons_pages[gc->n_cons_pages++] = cons_array;
   return cons_array;
 }
@@ -425,16 +639,32 @@ static inline int _ensure_root_cons_table(lisp_vm_t * vm)
   if(vm->root_cons_top == vm->root_cons_table_size) 
   {
     size_t n,i,j;
-    lisp_cons_t * cons_array = _new_cons_page(vm);
-    if(cons_array == NULL) return LISP_ALLOC_ERROR;
+    lisp_cons_t * cons_array;
+    if(vm->root_cons_top + vm->cons_page_size > LISP_MAX_CONS_INDEX) 
+    {
+      /* gc_cons_index would overflow */
+      return LISP_ALLOC_ERROR;
+    }
+    if(lisp_heap_limit_exceeded(vm, 
+                                vm->cons_page_size * 
+                                (sizeof(lisp_cons_t) + 
+                                 sizeof(lisp_root_cons_t)))) 
+    {
+      return LISP_ALLOC_ERROR;
+    }
+    /* table first: a failure leaves no unused page behind */
     n = vm->root_cons_top + vm->cons_page_size;
     lisp_root_cons_t * tmp = REALLOC(vm->root_cons_table,
 				     sizeof(lisp_root_cons_t)*n);
     if(tmp == NULL) return LISP_ALLOC_ERROR;
+    vm->root_cons_table = tmp;
+    cons_array = _new_cons_page(vm);
+    if(cons_array == NULL) return LISP_ALLOC_ERROR;
     j = 0;
     for(i = vm->root_cons_top; i < n; i++) 
     {
       tmp[i].cons = &cons_array[j];
+      tmp[i].cons->gc_cons_index = i;
       tmp[i].ref_count = 0;
       j++;
     }  
@@ -447,24 +677,98 @@ static inline int _ensure_root_cons_table(lisp_vm_t * vm)
 static inline int _ensure_cons_table(lisp_vm_t * vm)
 {
   REQUIRE_LE_U(vm->white_cons_top, vm->cons_table_size);
-  if(vm->white_cons_top == vm->cons_table_size) 
+  if(vm->white_cons_top < vm->sweep_cons_top) 
   {
-    size_t n,i,j;
-    lisp_cons_t * cons_array = _new_cons_page(vm);
-    if(cons_array == NULL) return LISP_ALLOC_ERROR;
-    n = vm->white_cons_top + vm->cons_page_size;
-    lisp_cons_t ** tmp = REALLOC(vm->cons_table,
-				sizeof(lisp_cons_t*)*n);
-    if(tmp == NULL) return LISP_ALLOC_ERROR;
-    j = 0;
-    for(i = vm->white_cons_top; i < n; i++) 
+    /* lazy sweep: the next free cons is unswept */
+    _gc_sweep_cons(vm, vm->cons_table[vm->white_cons_top]);
+  }
+  else if(vm->white_cons_top == vm->cons_table_size) 
+  {
+    if(vm->gc_sweep_lent && _gc_sweeper_reclaim(vm)) 
     {
-      tmp[i] = &cons_array[j];
-      j++;
-    }  
-    vm->cons_table      = tmp;
-    vm->cons_table_size = n;
+      return LISP_OK;
+    }
+    return _grow_cons_table(vm);
+  }
+  return LISP_OK;
+}
+
+/* append the conses of a new page to the cons table */
+static inline int _grow_cons_table(lisp_vm_t * vm)
+{
+  size_t n,i,j;
+  lisp_cons_t * cons_array;
+  if(vm->cons_table_size + vm->cons_page_size > LISP_MAX_CONS_INDEX) 
+  {
+    /* gc_cons_index would overflow */
+    return LISP_ALLOC_ERROR;
+  }
+  if(lisp_heap_limit_exceeded(vm, 
+                              vm->cons_page_size * 
+                              (sizeof(lisp_cons_t) + sizeof(lisp_cons_t*)))) 
+  {
+    return LISP_ALLOC_ERROR;
+  }
+  /* table first: a failure leaves no unused page behind,
+     the slots of conses lent to the sweeper are kept */
+  n = vm->cons_table_size + vm->cons_page_size;
+  lisp_cons_t ** tmp = REALLOC(vm->cons_table,
+                               sizeof(lisp_cons_t*) * 
+                               (n + vm->gc_sweep_lent));
+  if(tmp == NULL) return LISP_ALLOC_ERROR;
+  vm->cons_table = tmp;
+  cons_array = _new_cons_page(vm);
+  if(cons_array == NULL) return LISP_ALLOC_ERROR;
+  j = 0;
+  for(i = vm->cons_table_size; i < n; i++) 
+  {
+    tmp[i] = &cons_array[j];
+    tmp[i]->gc_cons_index = i;
+    j++;
+  }  
+  vm->cons_table      = tmp;
+  vm->cons_table_size = n;
+  return LISP_OK;
+}
+
+/* Provide n swept free conses at white_cons_top that are consecutive 
+   in memory, carved from a fresh page or from free space that is still 
+   in address order. *run is NULL if the free conses are scattered 
+   or the list does not fit into a page. */
+static int _ensure_cons_run(lisp_vm_t     * vm, 
+                            lisp_size_t     n,
+                            lisp_cons_t *** run)
+{
+  lisp_size_t i;
+  *run = NULL;
+  if(n > vm->cons_page_size) 
+  {
+    return LISP_OK;
+  }
+  if(vm->white_cons_top == vm->cons_table_size && !vm->gc_sweep_lent) 
+  {
+    if(_grow_cons_table(vm)) 
+    {
+      return LISP_ALLOC_ERROR;
+    }
+  }
+  if(vm->cons_table_size - vm->white_cons_top < n) 
+  {
+    return LISP_OK;
+  }
+  for(i = vm->white_cons_top + 1; i < vm->white_cons_top + n; i++) 
+  {
+    if(vm->cons_table[i] != vm->cons_table[i - 1] + 1) 
+    {
+      return LISP_OK;
+    }
   }
+  for(i = vm->white_cons_top; i < vm->white_cons_top + n && 
+        i < vm->sweep_cons_top; i++) 
+  {
+    _gc_sweep_cons(vm, vm->cons_table[i]);
+  }
+  *run = &vm->cons_table[vm->white_cons_top];
   return LISP_OK;
 }
 
@@ -493,6 +797,8 @@ static inline lisp_cons_t * _add_root_cons(lisp_vm_t * vm)
   lisp_cons_t * ret = vm->root_cons_table[vm->root_cons_top].cons;
   vm->root_cons_table[vm->root_cons_top].ref_count = 1;
   ret->is_root       = 1;
+  ret->gc_young      = 0;
+  ret->gc_remembered = 0;
   ret->gc_cons_index = vm->root_cons_top;
   vm->root_cons_top++;
   return ret;
@@ -577,33 +883,1523 @@ static inline void _ensure_not_white(lisp_vm_t   * vm,
   }
 }
 
-int lisp_make_list(lisp_vm_t         * vm,
-		   lisp_cell_t       * cell,
-		   const lisp_cell_t * elems,
-		   lisp_size_t         n)
+/*********************************************************
+ * 
+ * incremental garbage collector
+ *
+ *********************************************************/
+static inline void _gc_sweep_cons(lisp_vm_t   * vm,
+                                  lisp_cons_t * cons)
 {
-  MOCK_CALL(lisp_make_list, int);
-  if(n == 0) 
+  lisp_unset_object(vm, &cons->car);
+  lisp_unset_object(vm, &cons->cdr);
+}
+
+static inline void _gc_grey_children(lisp_vm_t   * vm,
+                                     lisp_cons_t * cons)
+{
+  if(LISP_IS_CONS_OBJECT(&cons->car)) 
   {
-    *cell = lisp_nil;
-    return LISP_OK;
+    _ensure_not_white(vm, cons->car.data.cons);
   }
-  else 
+  if(LISP_IS_CONS_OBJECT(&cons->cdr)) 
+  {
+    _ensure_not_white(vm, cons->cdr.data.cons);
+  }
+}
+
+static void _gc_scan_roots(lisp_vm_t * vm)
+{
+  /* black conses that have been unrooted before the 
+     first cycle are scanned as well */
+  lisp_size_t i;
+  for(i = 0; i < vm->root_cons_top; i++) 
+  {
+    _gc_grey_children(vm, vm->root_cons_table[i].cons);
+  }
+  for(i = 0; i < vm->black_cons_top; i++) 
+  {
+    _gc_grey_children(vm, vm->cons_table[i]);
+  }
+  for(i = 0; i < vm->n_root_regions; i++) 
+  {
+    lisp_cell_t * cells   = *vm->root_regions[i].cells;
+    lisp_size_t   n_cells = *vm->root_regions[i].n_cells;
+    lisp_size_t   j;
+    for(j = 0; j < n_cells; j++) 
+    {
+      if(LISP_IS_CONS_OBJECT(&cells[j])) 
+      {
+        _ensure_not_white(vm, cells[j].data.cons);
+      }
+    }
+  }
+  vm->gc_roots_scanned = 1;
+}
+
+static inline void _gc_blacken_grey(lisp_vm_t * vm)
+{
+  REQUIRE_LT_U(vm->grey_cons_begin, vm->grey_cons_top);
+  lisp_cons_t * cons = vm->cons_table[vm->grey_cons_begin];
+  if(vm->black_cons_top != vm->grey_cons_begin) 
+  {
+    /* swap with the first disposed cons of the gap */
+    lisp_cons_t * tmp = vm->cons_table[vm->black_cons_top];
+    tmp->gc_cons_index = vm->grey_cons_begin;
+    vm->cons_table[vm->grey_cons_begin] = tmp;
+    cons->gc_cons_index = vm->black_cons_top;
+    vm->cons_table[vm->black_cons_top] = cons;
+  }
+  vm->black_cons_top++;
+  vm->grey_cons_begin++;
+  _gc_grey_children(vm, cons);
+}
+
+static void _gc_end_cycle(lisp_vm_t * vm)
+{
+  REQUIRE_EQ_U(vm->grey_cons_begin, vm->grey_cons_top);
+  /* remaining white conses are unreachable */
+  if(vm->white_cons_top > vm->sweep_cons_top) 
+  {
+    vm->sweep_cons_top = vm->white_cons_top;
+  }
+  /* black conses become white and the gap joins the unswept conses */
+  vm->white_cons_top  = vm->black_cons_top;
+  vm->black_cons_top  = 0;
+  vm->grey_cons_begin = 0;
+  vm->grey_cons_top   = 0;
+  vm->gc_n_cycles++;
+  vm->gc_cycle_pending = 0;
+  /* the surviving young conses are promoted */
+  _gc_reset_nursery(vm);
+  _gc_sweeper_hand_off(vm);
+  _gc_scan_roots(vm);
+}
+
+/* Every cons of a page is in the cons table or in the root cons table
+   and gc_cons_index is its slot. The conses of the cons table below 
+   the sweep or white top are in use or unswept, the conses of the gap 
+   between black and grey are kept as well. */
+static inline int _gc_is_page_in_use(lisp_vm_t * vm, lisp_cons_t * page)
+{
+  lisp_size_t i, index;
+  lisp_size_t pinned_top = vm->white_cons_top > vm->sweep_cons_top ? 
+    vm->white_cons_top : vm->sweep_cons_top;
+  for(i = 0; i < vm->cons_page_size; i++) 
   {
-    *cell = lisp_nil;
-    lisp_cell_t tmp;
-    int ret = LISP_OK;
-    while(n > 0) 
+    index = page[i].gc_cons_index;
+    if(index < vm->root_cons_table_size &&
+       vm->root_cons_table[index].cons == &page[i]) 
+    {
+      if(index < vm->root_cons_top) 
+      {
+        return 1;
+      }
+    }
+    else 
     {
-      ret = lisp_make_cons_car_cdr(vm, &tmp, &elems[n-1], &lisp_nil);
-      if(ret) 
+      REQUIRE_EQ_PTR(&page[i], vm->cons_table[index]);
+      if(index < pinned_top) 
       {
-	return ret;
+        return 1;
       }
-      *LISP_CDR(&tmp) = *cell;
-      *cell = tmp;
-      n--;
     }
+  }
+  return 0;
+}
+
+/* remove the disposed conses of the page from both tables, 
+   the last page takes its place */
+static void _gc_release_page(lisp_vm_t * vm, lisp_size_t page_index)
+{
+  lisp_cons_t * page = vm->cons_pages[page_index];
+  lisp_size_t   i, index;
+  for(i = 0; i < vm->cons_page_size; i++) 
+  {
+    index = page[i].gc_cons_index;
+    if(index < vm->root_cons_table_size &&
+       vm->root_cons_table[index].cons == &page[i]) 
+    {
+      vm->root_cons_table[index] = 
+        vm->root_cons_table[--vm->root_cons_table_size];
+      vm->root_cons_table[index].cons->gc_cons_index = index;
+    }
+    else 
+    {
+      vm->cons_table[index] = vm->cons_table[--vm->cons_table_size];
+      vm->cons_table[index]->gc_cons_index = index;
+    }
+  }
+  vm->cons_pages[page_index] = vm->cons_pages[--vm->n_cons_pages];
+  _free_cons_page(vm, page);
+}
+
+static void _gc_shrink_cons_tables(lisp_vm_t * vm)
+{
+  /* keep the old tables if realloc fails */
+  if(vm->cons_table_size == 0 && vm->cons_table != NULL) 
+  {
+    FREE(vm->cons_table);
+    vm->cons_table = NULL;
+  }
+  else if(vm->cons_table_size) 
+  {
+    lisp_cons_t ** tmp = REALLOC(vm->cons_table,
+                                 sizeof(lisp_cons_t*) * vm->cons_table_size);
+    if(tmp != NULL) 
+    {
+      vm->cons_table = tmp;
+    }
+  }
+  if(vm->root_cons_table_size == 0 && vm->root_cons_table != NULL) 
+  {
+    FREE(vm->root_cons_table);
+    vm->root_cons_table = NULL;
+  }
+  else if(vm->root_cons_table_size) 
+  {
+    lisp_root_cons_t * tmp = REALLOC(vm->root_cons_table,
+                                     sizeof(lisp_root_cons_t) * 
+                                     vm->root_cons_table_size);
+    if(tmp != NULL) 
+    {
+      vm->root_cons_table = tmp;
+    }
+  }
+  if(vm->n_cons_pages == 0 && vm->cons_arena == NULL) 
+  {
+    FREE(vm->cons_pages);
+    vm->cons_pages = NULL;
+  }
+}
+
+/* Examine the pages from vm->gc_release_page on, at least one page 
+   and the pages of at most n_conses conses. Pages without conses in 
+   use are released. */
+static void _gc_release_step(lisp_vm_t * vm, lisp_size_t n_conses)
+{
+  lisp_size_t n = 0;
+  if(vm->gc_sweep_lent) 
+  {
+    /* the pages of lent conses are unknown */
+    vm->gc_release_pending = 0;
+    vm->gc_release_page    = 0;
+    return;
+  }
+  while(vm->gc_release_page < vm->n_cons_pages) 
+  {
+    if(_gc_is_page_in_use(vm, vm->cons_pages[vm->gc_release_page])) 
+    {
+      vm->gc_release_page++;
+    }
+    else 
+    {
+      _gc_release_page(vm, vm->gc_release_page);
+    }
+    n += vm->cons_page_size;
+    if(n >= n_conses) 
+    {
+      break;
+    }
+  }
+  if(vm->gc_release_page >= vm->n_cons_pages) 
+  {
+    vm->gc_release_pending = 0;
+    vm->gc_release_page    = 0;
+    _gc_shrink_cons_tables(vm);
+  }
+}
+
+static void _gc_release_free_pages(lisp_vm_t * vm)
+{
+  vm->gc_release_page = 0;
+  _gc_release_step(vm, vm->n_cons_pages * vm->cons_page_size);
+}
+
+static void _gc_mark_step(lisp_vm_t * vm, lisp_size_t n_conses)
+{
+  lisp_size_t n;
+  if(!vm->gc_roots_scanned) 
+  {
+    _gc_scan_roots(vm);
+  }
+  if(vm->sweep_cons_top > vm->white_cons_top) 
+  {
+    for(n = 0; 
+        n < n_conses && vm->sweep_cons_top > vm->white_cons_top; 
+        n++) 
+    {
+      _gc_sweep_cons(vm, vm->cons_table[--vm->sweep_cons_top]);
+    }
+    if(vm->sweep_cons_top <= vm->white_cons_top) 
+    {
+      /* sweep of the last cycle has finished, 
+         the pages are scanned by lisp_gc_step() */
+      vm->gc_release_pending = 1;
+    }
+  }
+  for(n = 0; n < n_conses && vm->grey_cons_begin < vm->grey_cons_top; n++) 
+  {
+    _gc_blacken_grey(vm);
+  }
+}
+
+static inline void _gc_alloc_tick(lisp_vm_t * vm)
+{
+  /* Conses under construction are usually held by C variables only.
+     Therefore allocation driven steps never end a cycle, 
+     the evaluator ends it at a safe point. */
+  if(vm->gc_alloc_interval && 
+     ++vm->gc_alloc_count >= vm->gc_alloc_interval) 
+  {
+    vm->gc_alloc_count = 0;
+    _gc_mark_step(vm, vm->gc_alloc_step_size);
+    if(vm->grey_cons_begin == vm->grey_cons_top) 
+    {
+      vm->gc_cycle_pending = 1;
+    }
+  }
+}
+
+/* allocation of n conses at once */
+static inline void _gc_alloc_ticks(lisp_vm_t * vm, lisp_size_t n)
+{
+  if(vm->gc_alloc_interval) 
+  {
+    vm->gc_alloc_count += n;
+    if(vm->gc_alloc_count >= vm->gc_alloc_interval) 
+    {
+      _gc_mark_step(vm, 
+                    vm->gc_alloc_step_size * 
+                    (vm->gc_alloc_count / vm->gc_alloc_interval));
+      vm->gc_alloc_count %= vm->gc_alloc_interval;
+      if(vm->grey_cons_begin == vm->grey_cons_top) 
+      {
+        vm->gc_cycle_pending = 1;
+      }
+    }
+  }
+}
+
+int lisp_register_root_region(lisp_vm_t    * vm,
+                              lisp_cell_t ** cells,
+                              lisp_size_t  * n_cells)
+{
+  lisp_root_region_t * regions = REALLOC(vm->root_regions,
+                                         sizeof(lisp_root_region_t) * 
+                                         (vm->n_root_regions + 1));
+  if(regions == NULL) 
+  {
+    return LISP_ALLOC_ERROR;
+  }
+  regions[vm->n_root_regions].cells   = cells;
+  regions[vm->n_root_regions].n_cells = n_cells;
+  vm->root_regions = regions;
+  vm->n_root_regions++;
+  return LISP_OK;
+}
+
+void lisp_unregister_root_region(lisp_vm_t    * vm,
+                                 lisp_cell_t ** cells)
+{
+  lisp_size_t i;
+  for(i = 0; i < vm->n_root_regions; i++) 
+  {
+    if(vm->root_regions[i].cells == cells) 
+    {
+      vm->root_regions[i] = vm->root_regions[--vm->n_root_regions];
+      return;
+    }
+  }
+}
+
+int lisp_copy_object_as_region_root(lisp_vm_t         * vm,
+                                    lisp_cell_t       * target,
+                                    const lisp_cell_t * source)
+{
+  if(LISP_IS_OBJECT(source)) 
+  {
+    ++LISP_REFCOUNT(source);
+  }
+  else if(LISP_IS_CONS_OBJECT(source) && vm->gc_roots_scanned)
+  {
+    /* the region has been scanned by the running cycle */
+    _ensure_not_white(vm, source->data.cons);
+  }
+  *target = *source;
+  return LISP_OK;
+}
+
+int lisp_gc_step(lisp_vm_t * vm, lisp_size_t n_conses)
+{
+  lisp_flush_deferred_unset(vm);
+  if(vm->gc_sweep_lent) 
+  {
+    _gc_sweeper_reclaim(vm);
+  }
+  _gc_mark_step(vm, n_conses);
+  if(vm->gc_release_pending) 
+  {
+    _gc_release_step(vm, n_conses);
+  }
+  if(n_conses && vm->grey_cons_begin == vm->grey_cons_top) 
+  {
+    _gc_end_cycle(vm);
+  }
+  return LISP_OK;
+}
+
+int lisp_gc_safe_point(lisp_vm_t * vm)
+{
+  if(!vm->gc_cycle_pending) 
+  {
+    return 0;
+  }
+  /* conses greyed since the last step and by the caller */
+  _gc_mark_step(vm, vm->gc_alloc_step_size);
+  if(vm->grey_cons_begin != vm->grey_cons_top) 
+  {
+    return 0;
+  }
+  _gc_end_cycle(vm);
+  return 1;
+}
+
+void lisp_gc_grey_cons(lisp_vm_t * vm, lisp_cons_t * cons)
+{
+  _ensure_not_white(vm, cons);
+}
+
+int lisp_gc_collect(lisp_vm_t * vm)
+{
+  lisp_flush_deferred_unset(vm);
+#ifdef HAS_PTHREAD
+  if(vm->gc_mark_threads > 1 && _gc_parallel_collect(vm) == LISP_OK) 
+  {
+    return LISP_OK;
+  }
+#endif
+  /* conses that died after the current cycle has started 
+     are only reclaimed by the next cycle */
+  lisp_size_t n_cycles = vm->gc_n_cycles + (vm->gc_roots_scanned ? 2 : 1);
+  while(vm->gc_n_cycles < n_cycles) 
+  {
+    lisp_gc_step(vm, vm->cons_page_size);
+  }
+  _gc_sweeper_sync(vm);
+  while(vm->sweep_cons_top > vm->white_cons_top) 
+  {
+    _gc_sweep_cons(vm, vm->cons_table[--vm->sweep_cons_top]);
+  }
+  _gc_release_free_pages(vm);
+  return LISP_OK;
+}
+
+/*********************************************************
+ * 
+ * nursery
+ *
+ *********************************************************/
+static inline int _gc_push_cons(lisp_vm_t    * vm,
+                                lisp_cons_t *** list,
+                                lisp_size_t  * top,
+                                lisp_size_t  * size,
+                                lisp_cons_t  * cons)
+{
+  if(*top == *size) 
+  {
+    lisp_size_t    new_size = (*size ? *size * 2 : vm->cons_page_size);
+    lisp_cons_t ** tmp      = REALLOC(*list, sizeof(lisp_cons_t*) * new_size);
+    if(tmp == NULL) 
+    {
+      return LISP_ALLOC_ERROR;
+    }
+    *list = tmp;
+    *size = new_size;
+  }
+  (*list)[(*top)++] = cons;
+  return LISP_OK;
+}
+
+static inline void _gc_add_young(lisp_vm_t   * vm,
+                                 lisp_cons_t * cons)
+{
+  cons->gc_young      = 0;
+  cons->gc_remembered = 0;
+  if(vm->gc_generational) 
+  {
+    if(_gc_push_cons(vm, 
+                     &vm->gc_nursery, 
+                     &vm->gc_nursery_top, 
+                     &vm->gc_nursery_size, 
+                     cons)) 
+    {
+      /* an old cons may point to young conses that are not remembered */
+      vm->gc_nursery_overflow = 1;
+    }
+    else 
+    {
+      cons->gc_young = 1;
+    }
+  }
+}
+
+/* write barrier of the nursery: old non-root cons gets a young child */
+static inline void _gc_remember(lisp_vm_t         * vm,
+                                lisp_cons_t       * cons,
+                                const lisp_cell_t * child)
+{
+  if(LISP_IS_CONS_OBJECT(child) &&
+     child->data.cons->gc_young && 
+     !cons->gc_young && 
+     !cons->is_root && 
+     !cons->gc_remembered) 
+  {
+    if(_gc_push_cons(vm, 
+                     &vm->gc_remembered, 
+                     &vm->gc_remembered_top, 
+                     &vm->gc_remembered_size, 
+                     cons)) 
+    {
+      vm->gc_nursery_overflow = 1;
+    }
+    else 
+    {
+      cons->gc_remembered = 1;
+    }
+  }
+}
+
+/* promote all young conses and forget the remembered set */
+static void _gc_reset_nursery(lisp_vm_t * vm)
+{
+  lisp_size_t i;
+  for(i = 0; i < vm->gc_nursery_top; i++) 
+  {
+    vm->gc_nursery[i]->gc_young = 0;
+  }
+  for(i = 0; i < vm->gc_remembered_top; i++) 
+  {
+    vm->gc_remembered[i]->gc_remembered = 0;
+  }
+  vm->gc_nursery_top      = 0;
+  vm->gc_remembered_top   = 0;
+  vm->gc_nursery_overflow = 0;
+}
+
+/* promote a reachable young cons and push it to the trace stack */
+static inline void _gc_minor_reach(lisp_cons_t      ** stack,
+                                   lisp_size_t       * n,
+                                   const lisp_cell_t * cell)
+{
+  if(LISP_IS_CONS_OBJECT(cell) && cell->data.cons->gc_young) 
+  {
+    cell->data.cons->gc_young = 0;
+    stack[(*n)++] = cell->data.cons;
+  }
+}
+
+/* move an unreachable young cons from its colour to the free conses */
+static inline void _gc_minor_dispose(lisp_vm_t   * vm,
+                                     lisp_cons_t * cons)
+{
+  lisp_size_t index = cons->gc_cons_index;
+  lisp_size_t free_index;
+  REQUIRE_EQ_PTR(cons, vm->cons_table[index]);
+  if(index < vm->black_cons_top) 
+  {
+    /* last black becomes the first cons of the gap */
+    free_index = --vm->black_cons_top;
+  }
+  else if(index < vm->grey_cons_top) 
+  {
+    /* first grey becomes the last cons of the gap */
+    REQUIRE_GE_U(index, vm->grey_cons_begin);
+    free_index = vm->grey_cons_begin++;
+  }
+  else 
+  {
+    REQUIRE_LT_U(index, vm->white_cons_top);
+    free_index = --vm->white_cons_top;
+  }
+  if(index != free_index) 
+  {
+    vm->cons_table[index] = vm->cons_table[free_index];
+    vm->cons_table[index]->gc_cons_index = index;
+    vm->cons_table[free_index] = cons;
+    cons->gc_cons_index = free_index;
+  }
+  cons->gc_young = 0;
+}
+
+int lisp_gc_minor(lisp_vm_t * vm)
+{
+  lisp_cons_t ** stack;
+  lisp_size_t    n = 0;
+  lisp_size_t    i;
+  lisp_flush_deferred_unset(vm);
+  if(vm->gc_nursery_top == 0 || vm->gc_nursery_overflow) 
+  {
+    _gc_reset_nursery(vm);
+    return LISP_OK;
+  }
+  /* every young cons is pushed at most once */
+  stack = MALLOC(sizeof(lisp_cons_t*) * vm->gc_nursery_top);
+  if(stack == NULL) 
+  {
+    _gc_reset_nursery(vm);
+    return LISP_OK;
+  }
+  for(i = 0; i < vm->root_cons_top; i++) 
+  {
+    lisp_cons_t * cons = vm->root_cons_table[i].cons;
+    _gc_minor_reach(stack, &n, &cons->car);
+    _gc_minor_reach(stack, &n, &cons->cdr);
+  }
+  for(i = 0; i < vm->n_root_regions; i++) 
+  {
+    lisp_cell_t * cells   = *vm->root_regions[i].cells;
+    lisp_size_t   n_cells = *vm->root_regions[i].n_cells;
+    lisp_size_t   j;
+    for(j = 0; j < n_cells; j++) 
+    {
+      _gc_minor_reach(stack, &n, &cells[j]);
+    }
+  }
+  for(i = 0; i < vm->gc_remembered_top; i++) 
+  {
+    lisp_cons_t * cons = vm->gc_remembered[i];
+    _gc_minor_reach(stack, &n, &cons->car);
+    _gc_minor_reach(stack, &n, &cons->cdr);
+  }
+  while(n) 
+  {
+    lisp_cons_t * cons = stack[--n];
+    _gc_minor_reach(stack, &n, &cons->car);
+    _gc_minor_reach(stack, &n, &cons->cdr);
+  }
+  FREE(stack);
+
+  /* young conses that have been rooted survive as well */
+  for(i = 0; i < vm->gc_nursery_top; i++) 
+  {
+    lisp_cons_t * cons = vm->gc_nursery[i];
+    if(cons->gc_young && !cons->is_root) 
+    {
+      _gc_sweep_cons(vm, cons);
+      _gc_minor_dispose(vm, cons);
+    }
+  }
+  _gc_reset_nursery(vm);
+  return LISP_OK;
+}
+
+/*********************************************************
+ * 
+ * background sweeper
+ *
+ *********************************************************/
+#ifdef HAS_PTHREAD
+/* At the end of a cycle the unswept conses are removed from the 
+   cons table and lent to the sweeper thread as one batch. 
+   The sweeper clears the cells of the conses and returns the batch 
+   through a lock-free stack. Object cells are unset by the mutator: 
+   reference counts are not atomic and destructors may change the vm, 
+   e.g. the symbol table. The memory of the objects freed there is 
+   deferred and handed back to the sweeper in a batch without conses, 
+   the sweeper releases it through the thread-safe return path of the 
+   object slabs. The sweeper never allocates memory. */
+typedef struct lisp_gc_sweep_batch_t
+{
+  struct lisp_gc_sweep_batch_t * next;
+  /* deferred object blocks to release */
+  void                         * objects;
+  lisp_size_t                    n_conses;
+  /* conses with object cells are at the end of the batch */
+  lisp_size_t                    n_objects;
+  lisp_cons_t                  * conses[1];
+} lisp_gc_sweep_batch_t;
+
+typedef struct lisp_gc_sweeper_t
+{
+  pthread_t                       thread;
+  pthread_mutex_t                 lock;
+  pthread_cond_t                  work;
+  pthread_cond_t                  idle;
+  int                             stop;
+  lisp_gc_sweep_batch_t         * pending;
+  lisp_size_t                     n_busy;
+  lisp_gc_sweep_batch_t         * done;
+} lisp_gc_sweeper_t;
+
+static void _gc_sweep_batch(lisp_gc_sweep_batch_t * batch)
+{
+  lisp_size_t i = 0;
+  lisp_size_t j = batch->n_conses;
+  while(i < j) 
+  {
+    lisp_cons_t * cons = batch->conses[i];
+    if(LISP_IS_OBJECT(&cons->car) || LISP_IS_OBJECT(&cons->cdr)) 
+    {
+      if(!LISP_IS_OBJECT(&cons->car)) 
+      {
+        cons->car = lisp_nil;
+      }
+      if(!LISP_IS_OBJECT(&cons->cdr)) 
+      {
+        cons->cdr = lisp_nil;
+      }
+      batch->conses[i]   = batch->conses[--j];
+      batch->conses[j]   = cons;
+    }
+    else 
+    {
+      cons->car = lisp_nil;
+      cons->cdr = lisp_nil;
+      i++;
+    }
+  }
+  batch->n_objects = batch->n_conses - j;
+}
+
+static void * _gc_sweeper_run(void * arg)
+{
+  lisp_gc_sweeper_t * sweeper = arg;
+  pthread_mutex_lock(&sweeper->lock);
+  while(!sweeper->stop) 
+  {
+    lisp_gc_sweep_batch_t * batch = sweeper->pending;
+    if(batch == NULL) 
+    {
+      pthread_cond_wait(&sweeper->work, &sweeper->lock);
+      continue;
+    }
+    sweeper->pending = batch->next;
+    pthread_mutex_unlock(&sweeper->lock);
+    _gc_sweep_batch(batch);
+    _lisp_free_deferred_objects(batch->objects);
+    batch->objects = NULL;
+    /* push to the stack of swept batches */
+    batch->next = __atomic_load_n(&sweeper->done, __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&sweeper->done, 
+                                       &batch->next, 
+                                       batch, 
+                                       0,
+                                       __ATOMIC_RELEASE,
+                                       __ATOMIC_RELAXED)) 
+    {
+    }
+    pthread_mutex_lock(&sweeper->lock);
+    if(!--sweeper->n_busy) 
+    {
+      pthread_cond_broadcast(&sweeper->idle);
+    }
+  }
+  pthread_mutex_unlock(&sweeper->lock);
+  return NULL;
+}
+
+void _lisp_init_cons_sweeper(lisp_vm_t * vm, const lisp_vm_param_t * param)
+{
+  lisp_gc_sweeper_t * sweeper;
+  vm->gc_sweeper    = NULL;
+  vm->gc_sweep_lent = 0;
+  if(!param->gc_background_sweep) 
+  {
+    return;
+  }
+  sweeper = MALLOC(sizeof(lisp_gc_sweeper_t));
+  if(sweeper == NULL) 
+  {
+    return;
+  }
+  sweeper->stop    = 0;
+  sweeper->pending = NULL;
+  sweeper->n_busy  = 0;
+  sweeper->done    = NULL;
+  pthread_mutex_init(&sweeper->lock, NULL);
+  pthread_cond_init(&sweeper->work, NULL);
+  pthread_cond_init(&sweeper->idle, NULL);
+  if(pthread_create(&sweeper->thread, NULL, _gc_sweeper_run, sweeper)) 
+  {
+    /* lazy sweeping by the mutator */
+    pthread_mutex_destroy(&sweeper->lock);
+    pthread_cond_destroy(&sweeper->work);
+    pthread_cond_destroy(&sweeper->idle);
+    FREE(sweeper);
+    return;
+  }
+  vm->gc_sweeper = sweeper;
+}
+
+void _lisp_stop_cons_sweeper(lisp_vm_t * vm)
+{
+  lisp_gc_sweeper_t * sweeper = vm->gc_sweeper;
+  if(sweeper == NULL) 
+  {
+    return;
+  }
+  _gc_sweeper_sync(vm);
+  pthread_mutex_lock(&sweeper->lock);
+  sweeper->stop = 1;
+  pthread_cond_signal(&sweeper->work);
+  pthread_mutex_unlock(&sweeper->lock);
+  pthread_join(sweeper->thread, NULL);
+  pthread_mutex_destroy(&sweeper->lock);
+  pthread_cond_destroy(&sweeper->work);
+  pthread_cond_destroy(&sweeper->idle);
+  FREE(sweeper);
+  vm->gc_sweeper = NULL;
+}
+
+static void _gc_sweeper_push(lisp_gc_sweeper_t     * sweeper, 
+                             lisp_gc_sweep_batch_t * batch)
+{
+  pthread_mutex_lock(&sweeper->lock);
+  batch->next      = sweeper->pending;
+  sweeper->pending = batch;
+  sweeper->n_busy++;
+  pthread_cond_signal(&sweeper->work);
+  pthread_mutex_unlock(&sweeper->lock);
+}
+
+/* lend the unswept conses to the sweeper */
+static void _gc_sweeper_hand_off(lisp_vm_t * vm)
+{
+  lisp_gc_sweeper_t     * sweeper = vm->gc_sweeper;
+  lisp_gc_sweep_batch_t * batch;
+  lisp_size_t             n, i;
+  if(sweeper == NULL || vm->sweep_cons_top <= vm->white_cons_top) 
+  {
+    return;
+  }
+  n     = vm->sweep_cons_top - vm->white_cons_top;
+  batch = MALLOC(sizeof(lisp_gc_sweep_batch_t) + 
+                 sizeof(lisp_cons_t*) * (n - 1));
+  if(batch == NULL) 
+  {
+    /* swept lazily */
+    return;
+  }
+  batch->objects   = NULL;
+  batch->n_conses  = n;
+  batch->n_objects = 0;
+  for(i = 0; i < n; i++) 
+  {
+    batch->conses[i] = vm->cons_table[vm->white_cons_top + i];
+  }
+  /* free conses move down, the slots stay allocated */
+  for(i = vm->sweep_cons_top; i < vm->cons_table_size; i++) 
+  {
+    vm->cons_table[i - n] = vm->cons_table[i];
+    vm->cons_table[i - n]->gc_cons_index = i - n;
+  }
+  vm->cons_table_size -= n;
+  vm->sweep_cons_top   = vm->white_cons_top;
+  vm->gc_sweep_lent   += n;
+  _gc_sweeper_push(sweeper, batch);
+}
+
+/* hand deferred object blocks to the sweeper */
+static void _gc_sweeper_free_objects(lisp_vm_t * vm, void * objects)
+{
+  lisp_gc_sweep_batch_t * batch;
+  batch = MALLOC(sizeof(lisp_gc_sweep_batch_t));
+  if(batch == NULL) 
+  {
+    _lisp_free_deferred_objects(objects);
+    return;
+  }
+  batch->objects   = objects;
+  batch->n_conses  = 0;
+  batch->n_objects = 0;
+  _gc_sweeper_push(vm->gc_sweeper, batch);
+}
+
+/* take back swept batches, returns 1 if conses have been returned */
+static int _gc_sweeper_reclaim(lisp_vm_t * vm)
+{
+  lisp_gc_sweep_batch_t * batch;
+  lisp_size_t             i;
+  void                  * objects;
+  int                     ret = 0;
+  if(vm->gc_sweeper == NULL) 
+  {
+    return 0;
+  }
+  batch = __atomic_exchange_n(&vm->gc_sweeper->done, NULL, __ATOMIC_ACQUIRE);
+  _lisp_defer_object_frees(vm);
+  while(batch != NULL) 
+  {
+    lisp_gc_sweep_batch_t * next = batch->next;
+    for(i = batch->n_conses - batch->n_objects; i < batch->n_conses; i++) 
+    {
+      _gc_sweep_cons(vm, batch->conses[i]);
+    }
+    for(i = 0; i < batch->n_conses; i++) 
+    {
+      batch->conses[i]->gc_cons_index = vm->cons_table_size;
+      vm->cons_table[vm->cons_table_size++] = batch->conses[i];
+    }
+    vm->gc_sweep_lent -= batch->n_conses;
+    ret = ret || batch->n_conses;
+    FREE(batch);
+    batch = next;
+  }
+  objects = _lisp_take_deferred_objects(vm);
+  if(objects != NULL) 
+  {
+    _gc_sweeper_free_objects(vm, objects);
+  }
+  if(ret && vm->gc_sweep_lent == 0 && 
+     vm->sweep_cons_top <= vm->white_cons_top) 
+  {
+    vm->gc_release_pending = 1;
+  }
+  return ret;
+}
+
+/* wait for the sweeper and take back all batches */
+static void _gc_sweeper_sync(lisp_vm_t * vm)
+{
+  lisp_gc_sweeper_t * sweeper = vm->gc_sweeper;
+  if(sweeper == NULL) 
+  {
+    return;
+  }
+  /* taking back batches may hand objects to the sweeper again */
+  do 
+  {
+    pthread_mutex_lock(&sweeper->lock);
+    while(sweeper->n_busy) 
+    {
+      pthread_cond_wait(&sweeper->idle, &sweeper->lock);
+    }
+    pthread_mutex_unlock(&sweeper->lock);
+    _gc_sweeper_reclaim(vm);
+  } 
+  while(__atomic_load_n(&sweeper->n_busy, __ATOMIC_RELAXED));
+}
+#else
+void _lisp_init_cons_sweeper(lisp_vm_t * vm, const lisp_vm_param_t * param)
+{
+  vm->gc_sweeper    = NULL;
+  vm->gc_sweep_lent = 0;
+}
+
+void _lisp_stop_cons_sweeper(lisp_vm_t * vm)
+{
+}
+
+static void _gc_sweeper_hand_off(lisp_vm_t * vm)
+{
+}
+
+static int _gc_sweeper_reclaim(lisp_vm_t * vm)
+{
+  return 0;
+}
+
+static void _gc_sweeper_sync(lisp_vm_t * vm)
+{
+}
+#endif
+
+/*********************************************************
+ * 
+ * compaction
+ *
+ *********************************************************/
+/* The nursery is empty during compaction: gc_remembered marks 
+   pinned conses and gc_young marks conses that have been moved, 
+   the car of a moved cons holds its new location. */
+static inline void _gc_pin_cell(const lisp_cell_t * cell)
+{
+  /* typed conses (lambdas, exceptions) are referenced by 
+     byte code and call stacks */
+  if(LISP_IS_CONS_OBJECT(cell) && cell->type_id != LISP_TID_CONS) 
+  {
+    cell->data.cons->gc_remembered = 1;
+  }
+}
+
+static inline void _gc_forward_cell(lisp_cell_t * cell)
+{
+  if(LISP_IS_CONS_OBJECT(cell) && cell->data.cons->gc_young) 
+  {
+    cell->data.cons = cell->data.cons->car.data.cons;
+  }
+}
+
+static inline int _gc_is_in_use(lisp_vm_t * vm, lisp_size_t index)
+{
+  return (index < vm->black_cons_top || 
+          (index >= vm->grey_cons_begin && index < vm->white_cons_top));
+}
+
+static int _cmp_cons_slot(const void * a, const void * b)
+{
+  uintptr_t pa = (uintptr_t) **(lisp_cons_t ** const *) a;
+  uintptr_t pb = (uintptr_t) **(lisp_cons_t ** const *) b;
+  return (pa > pb) - (pa < pb);
+}
+
+int lisp_gc_compact(lisp_vm_t * vm)
+{
+  lisp_cons_t *** free_slots;
+  lisp_cons_t *** live;
+  lisp_size_t     n_free = 0;
+  lisp_size_t     n_live = 0;
+  lisp_size_t     n_moved = 0;
+  lisp_size_t     i, j;
+  lisp_gc_collect(vm);
+  _gc_reset_nursery(vm);
+  if(vm->white_cons_top == 0) 
+  {
+    return LISP_OK;
+  }
+  free_slots = MALLOC(sizeof(lisp_cons_t**) * 
+                      (vm->cons_table_size + vm->root_cons_table_size));
+  live       = MALLOC(sizeof(lisp_cons_t**) * vm->white_cons_top);
+  if(free_slots == NULL || live == NULL) 
+  {
+    if(free_slots) FREE(free_slots);
+    if(live) FREE(live);
+    return LISP_ALLOC_ERROR;
+  }
+
+  /* pin conses referenced by typed cells */
+  for(i = 0; i < vm->root_cons_top; i++) 
+  {
+    _gc_pin_cell(&vm->root_cons_table[i].cons->car);
+    _gc_pin_cell(&vm->root_cons_table[i].cons->cdr);
+  }
+  for(i = 0; i < vm->white_cons_top; i++) 
+  {
+    if(_gc_is_in_use(vm, i)) 
+    {
+      _gc_pin_cell(&vm->cons_table[i]->car);
+      _gc_pin_cell(&vm->cons_table[i]->cdr);
+    }
+  }
+  for(i = 0; i < vm->n_root_regions; i++) 
+  {
+    lisp_cell_t * cells   = *vm->root_regions[i].cells;
+    lisp_size_t   n_cells = *vm->root_regions[i].n_cells;
+    for(j = 0; j < n_cells; j++) 
+    {
+      _gc_pin_cell(&cells[j]);
+    }
+  }
+
+  /* slots of movable conses and of free conses of both tables */
+  for(i = 0; i < vm->cons_table_size; i++) 
+  {
+    if(!_gc_is_in_use(vm, i)) 
+    {
+      free_slots[n_free++] = &vm->cons_table[i];
+    }
+    else if(!vm->cons_table[i]->gc_remembered) 
+    {
+      live[n_live++] = &vm->cons_table[i];
+    }
+  }
+  for(i = vm->root_cons_top; i < vm->root_cons_table_size; i++) 
+  {
+    free_slots[n_free++] = &vm->root_cons_table[i].cons;
+  }
+  qsort(free_slots, n_free, sizeof(lisp_cons_t**), _cmp_cons_slot);
+  qsort(live,       n_live, sizeof(lisp_cons_t**), _cmp_cons_slot);
+
+  /* move the live cons with the highest address to the free cons 
+     with the lowest address until both meet */
+  while(n_moved < n_free && n_live > 0 && 
+        (uintptr_t) *free_slots[n_moved] < (uintptr_t) *live[n_live - 1]) 
+  {
+    lisp_cons_t * cons   = *live[--n_live];
+    lisp_cons_t * target = *free_slots[n_moved];
+    *target                  = *cons;
+    *live[n_live]            = target;
+    *free_slots[n_moved++]   = cons;
+    cons->gc_young           = 1;
+    cons->car.type_id        = LISP_TID_CONS;
+    cons->car.data.cons      = target;
+  }
+
+  /* fix up references and unpin */
+  for(i = 0; i < vm->root_cons_top; i++) 
+  {
+    _gc_forward_cell(&vm->root_cons_table[i].cons->car);
+    _gc_forward_cell(&vm->root_cons_table[i].cons->cdr);
+    vm->root_cons_table[i].cons->gc_remembered = 0;
+  }
+  for(i = 0; i < vm->white_cons_top; i++) 
+  {
+    if(_gc_is_in_use(vm, i)) 
+    {
+      _gc_forward_cell(&vm->cons_table[i]->car);
+      _gc_forward_cell(&vm->cons_table[i]->cdr);
+      vm->cons_table[i]->gc_remembered = 0;
+    }
+  }
+  for(i = 0; i < vm->n_root_regions; i++) 
+  {
+    lisp_cell_t * cells   = *vm->root_regions[i].cells;
+    lisp_size_t   n_cells = *vm->root_regions[i].n_cells;
+    for(j = 0; j < n_cells; j++) 
+    {
+      _gc_forward_cell(&cells[j]);
+    }
+  }
+
+  /* the old locations are free conses now */
+  for(i = 0; i < n_moved; i++) 
+  {
+    lisp_cons_t * cons = *free_slots[i];
+    cons->gc_young = 0;
+    cons->car      = lisp_nil;
+    cons->cdr      = lisp_nil;
+  }
+  for(i = 0; i < vm->cons_table_size; i++) 
+  {
+    vm->cons_table[i]->gc_cons_index = i;
+  }
+  for(i = vm->root_cons_top; i < vm->root_cons_table_size; i++) 
+  {
+    vm->root_cons_table[i].cons->gc_cons_index = i;
+  }
+  FREE(free_slots);
+  FREE(live);
+  _gc_release_free_pages(vm);
+  return LISP_OK;
+}
+
+#ifdef HAS_PTHREAD
+/*********************************************************
+ * 
+ * parallel marking
+ *
+ *********************************************************/
+/* Each cons is pushed at most once: the shared overflow stack 
+   for full deques is sized for all conses of the cons table.
+   Only the calling thread allocates memory, the memory checker 
+   is not thread safe.
+   The deques are Chase-Lev deques of fixed size: the owner pushes
+   and takes at the bottom without locking, thieves take from the
+   top with a compare and swap. Only the overflow stack is locked. */
+#define LISP_GC_MARK_DEQUE_SIZE 1024
+#define LISP_GC_MARK_DEQUE_MASK (LISP_GC_MARK_DEQUE_SIZE - 1)
+
+struct lisp_gc_mark_t;
+
+typedef struct lisp_gc_mark_worker_t
+{
+  struct lisp_gc_mark_t * mark;
+  lisp_size_t             id;
+  int                     running;
+  pthread_t               thread;
+  long                    top;
+  long                    bottom;
+  lisp_cons_t           * deque[LISP_GC_MARK_DEQUE_SIZE];
+} lisp_gc_mark_worker_t;
+
+typedef struct lisp_gc_mark_t
+{
+  lisp_gc_mark_worker_t * workers;
+  lisp_size_t             n_workers;
+  int                     n_running;
+  int                     n_idle;
+  unsigned char         * marks;
+  pthread_mutex_t         overflow_lock;
+  lisp_cons_t          ** overflow;
+  lisp_size_t             overflow_top;
+} lisp_gc_mark_t;
+
+/* owner pushes at the bottom, a full deque spills to the overflow stack */
+static void _gc_mark_push(lisp_gc_mark_worker_t * worker,
+                          lisp_cons_t           * cons)
+{
+  long b = __atomic_load_n(&worker->bottom, __ATOMIC_RELAXED);
+  long t = __atomic_load_n(&worker->top, __ATOMIC_ACQUIRE);
+  if(b - t < LISP_GC_MARK_DEQUE_SIZE) 
+  {
+    __atomic_store_n(&worker->deque[b & LISP_GC_MARK_DEQUE_MASK], 
+                     cons, 
+                     __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&worker->bottom, b + 1, __ATOMIC_RELAXED);
+  }
+  else 
+  {
+    lisp_gc_mark_t * mark = worker->mark;
+    pthread_mutex_lock(&mark->overflow_lock);
+    mark->overflow[mark->overflow_top] = cons;
+    __atomic_store_n(&mark->overflow_top, 
+                     mark->overflow_top + 1, 
+                     __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&mark->overflow_lock);
+  }
+}
+
+/* owner takes from the bottom of its deque, the last cons is 
+   raced for with the thieves */
+static int _gc_mark_take(lisp_gc_mark_worker_t * worker,
+                         lisp_cons_t          ** cons)
+{
+  long b = __atomic_load_n(&worker->bottom, __ATOMIC_RELAXED) - 1;
+  long t;
+  int  ret = 1;
+  __atomic_store_n(&worker->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  t = __atomic_load_n(&worker->top, __ATOMIC_RELAXED);
+  if(t <= b) 
+  {
+    *cons = __atomic_load_n(&worker->deque[b & LISP_GC_MARK_DEQUE_MASK], 
+                            __ATOMIC_RELAXED);
+    if(t == b) 
+    {
+      ret = __atomic_compare_exchange_n(&worker->top, &t, t + 1, 0,
+                                        __ATOMIC_SEQ_CST, 
+                                        __ATOMIC_RELAXED);
+      __atomic_store_n(&worker->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+  }
+  else 
+  {
+    ret = 0;
+    __atomic_store_n(&worker->bottom, b + 1, __ATOMIC_RELAXED);
+  }
+  return ret;
+}
+
+/* owner takes from its deque, then from the overflow stack */
+static int _gc_mark_pop(lisp_gc_mark_worker_t * worker,
+                        lisp_cons_t          ** cons)
+{
+  lisp_gc_mark_t * mark = worker->mark;
+  int              ret  = _gc_mark_take(worker, cons);
+  if(!ret && __atomic_load_n(&mark->overflow_top, __ATOMIC_ACQUIRE)) 
+  {
+    pthread_mutex_lock(&mark->overflow_lock);
+    if(mark->overflow_top) 
+    {
+      __atomic_store_n(&mark->overflow_top, 
+                       mark->overflow_top - 1, 
+                       __ATOMIC_RELEASE);
+      *cons = mark->overflow[mark->overflow_top];
+      ret = 1;
+    }
+    pthread_mutex_unlock(&mark->overflow_lock);
+  }
+  return ret;
+}
+
+/* thieves take from the top of the other deques, a lost race 
+   moves on to the next victim */
+static int _gc_mark_steal(lisp_gc_mark_worker_t * worker,
+                          lisp_cons_t          ** cons)
+{
+  lisp_gc_mark_t * mark = worker->mark;
+  lisp_size_t      i;
+  for(i = 1; i < mark->n_workers; i++) 
+  {
+    lisp_gc_mark_worker_t * victim = 
+      &mark->workers[(worker->id + i) % mark->n_workers];
+    long t = __atomic_load_n(&victim->top, __ATOMIC_ACQUIRE);
+    long b;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    b = __atomic_load_n(&victim->bottom, __ATOMIC_ACQUIRE);
+    if(t < b) 
+    {
+      *cons = __atomic_load_n(&victim->deque[t & LISP_GC_MARK_DEQUE_MASK],
+                              __ATOMIC_RELAXED);
+      if(__atomic_compare_exchange_n(&victim->top, &t, t + 1, 0,
+                                     __ATOMIC_SEQ_CST, 
+                                     __ATOMIC_RELAXED)) 
+      {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+static int _gc_mark_has_work(lisp_gc_mark_t * mark)
+{
+  lisp_size_t i;
+  for(i = 0; i < mark->n_workers; i++) 
+  {
+    if(__atomic_load_n(&mark->workers[i].bottom, __ATOMIC_ACQUIRE) >
+       __atomic_load_n(&mark->workers[i].top, __ATOMIC_ACQUIRE)) 
+    {
+      return 1;
+    }
+  }
+  return __atomic_load_n(&mark->overflow_top, __ATOMIC_ACQUIRE) > 0;
+}
+
+/* root conses are not marked, their children are part of the root scan */
+static inline void _gc_mark_visit(lisp_gc_mark_worker_t * worker,
+                                  const lisp_cell_t     * cell)
+{
+  if(LISP_IS_CONS_OBJECT(cell) && !cell->data.cons->is_root) 
+  {
+    lisp_cons_t * cons = cell->data.cons;
+    if(!__atomic_exchange_n(&worker->mark->marks[cons->gc_cons_index], 
+                            1, 
+                            __ATOMIC_RELAXED)) 
+    {
+      _gc_mark_push(worker, cons);
+    }
+  }
+}
+
+static void * _gc_mark_worker_run(void * arg)
+{
+  lisp_gc_mark_worker_t * worker = arg;
+  lisp_gc_mark_t        * mark   = worker->mark;
+  lisp_cons_t           * cons;
+  for(;;) 
+  {
+    if(_gc_mark_pop(worker, &cons) || _gc_mark_steal(worker, &cons)) 
+    {
+      _gc_mark_visit(worker, &cons->car);
+      _gc_mark_visit(worker, &cons->cdr);
+      continue;
+    }
+    /* only busy workers push, marking has finished 
+       when all workers are idle */
+    __atomic_add_fetch(&mark->n_idle, 1, __ATOMIC_SEQ_CST);
+    for(;;) 
+    {
+      if(__atomic_load_n(&mark->n_idle, __ATOMIC_SEQ_CST) == 
+         __atomic_load_n(&mark->n_running, __ATOMIC_SEQ_CST)) 
+      {
+        return NULL;
+      }
+      if(_gc_mark_has_work(mark)) 
+      {
+        __atomic_sub_fetch(&mark->n_idle, 1, __ATOMIC_SEQ_CST);
+        break;
+      }
+      sched_yield();
+    }
+  }
+}
+
+static void _gc_mark_free(lisp_gc_mark_t * mark)
+{
+  if(mark->workers) 
+  {
+    FREE(mark->workers);
+    pthread_mutex_destroy(&mark->overflow_lock);
+  }
+  if(mark->marks) 
+  {
+    FREE(mark->marks);
+  }
+  if(mark->overflow) 
+  {
+    FREE(mark->overflow);
+  }
+}
+
+static int _gc_parallel_collect(lisp_vm_t * vm)
+{
+  lisp_gc_mark_t mark;
+  lisp_size_t    i, j, n_cells;
+  lisp_cell_t  * cells;
+  _gc_sweeper_sync(vm);
+  /* unreachable conses of the last cycle */
+  while(vm->sweep_cons_top > vm->white_cons_top) 
+  {
+    _gc_sweep_cons(vm, vm->cons_table[--vm->sweep_cons_top]);
+  }
+  if(vm->white_cons_top == 0) 
+  {
+    return LISP_ALLOC_ERROR;
+  }
+  mark.n_workers    = vm->gc_mark_threads;
+  mark.n_running    = (int) mark.n_workers;
+  mark.n_idle       = 0;
+  mark.overflow_top = 0;
+  mark.workers      = MALLOC(sizeof(lisp_gc_mark_worker_t) * mark.n_workers);
+  mark.marks        = MALLOC(vm->white_cons_top);
+  mark.overflow     = MALLOC(sizeof(lisp_cons_t*) * vm->white_cons_top);
+  if(mark.workers == NULL || mark.marks == NULL || mark.overflow == NULL) 
+  {
+    if(mark.workers) FREE(mark.workers);
+    mark.workers = NULL;
+    _gc_mark_free(&mark);
+    return LISP_ALLOC_ERROR;
+  }
+  memset(mark.marks, 0, vm->white_cons_top);
+  pthread_mutex_init(&mark.overflow_lock, NULL);
+  for(i = 0; i < mark.n_workers; i++) 
+  {
+    mark.workers[i].mark    = &mark;
+    mark.workers[i].id      = i;
+    mark.workers[i].running = 0;
+    mark.workers[i].top     = 0;
+    mark.workers[i].bottom  = 0;
+  }
+
+  /* stop the world root scan, distributed over the deques */
+  for(i = 0; i < vm->root_cons_top; i++) 
+  {
+    lisp_gc_mark_worker_t * worker = &mark.workers[i % mark.n_workers];
+    _gc_mark_visit(worker, &vm->root_cons_table[i].cons->car);
+    _gc_mark_visit(worker, &vm->root_cons_table[i].cons->cdr);
+  }
+  for(i = 0; i < vm->n_root_regions; i++) 
+  {
+    cells   = *vm->root_regions[i].cells;
+    n_cells = *vm->root_regions[i].n_cells;
+    for(j = 0; j < n_cells; j++) 
+    {
+      _gc_mark_visit(&mark.workers[j % mark.n_workers], &cells[j]);
+    }
+  }
+
+  /* the calling thread is worker 0, a worker that cannot be 
+     started leaves its deque to the others */
+  for(i = 1; i < mark.n_workers; i++) 
+  {
+    if(pthread_create(&mark.workers[i].thread, 
+                      NULL, 
+                      _gc_mark_worker_run, 
+                      &mark.workers[i]) == 0) 
+    {
+      mark.workers[i].running = 1;
+    }
+    else 
+    {
+      __atomic_sub_fetch(&mark.n_running, 1, __ATOMIC_SEQ_CST);
+    }
+  }
+  _gc_mark_worker_run(&mark.workers[0]);
+  for(i = 1; i < mark.n_workers; i++) 
+  {
+    if(mark.workers[i].running) 
+    {
+      pthread_join(mark.workers[i].thread, NULL);
+    }
+  }
+
+  /* reachable conses to the front, the index of a cons above i
+     is still the index of its mark */
+  for(i = 0, j = 0; i < vm->white_cons_top; i++) 
+  {
+    if(_gc_is_in_use(vm, i) && mark.marks[i]) 
+    {
+      if(i != j) 
+      {
+        lisp_cons_t * tmp = vm->cons_table[j];
+        vm->cons_table[j] = vm->cons_table[i];
+        vm->cons_table[j]->gc_cons_index = j;
+        vm->cons_table[i] = tmp;
+        tmp->gc_cons_index = i;
+      }
+      j++;
+    }
+  }
+  _gc_mark_free(&mark);
+
+  /* unreachable and disposed conses follow, a new cycle starts */
+  for(i = j; i < vm->white_cons_top; i++) 
+  {
+    _gc_sweep_cons(vm, vm->cons_table[i]);
+  }
+  vm->black_cons_top  = 0;
+  vm->grey_cons_begin = 0;
+  vm->grey_cons_top   = 0;
+  vm->white_cons_top  = j;
+  vm->sweep_cons_top  = 0;
+  vm->gc_n_cycles++;
+  vm->gc_cycle_pending = 0;
+  _gc_reset_nursery(vm);
+  _gc_scan_roots(vm);
+  _gc_release_free_pages(vm);
+  return LISP_OK;
+}
+#endif
+
+int lisp_make_list(lisp_vm_t         * vm,
+		   lisp_cell_t       * cell,
+		   const lisp_cell_t * elems,
+		   lisp_size_t         n)
+{
+  MOCK_CALL(lisp_make_list, int);
+  *cell = lisp_nil;
+  if(n == 0) 
+  {
+    return LISP_OK;
+  }
+  else 
+  {
+    /* the conses are taken as one run of consecutive conses 
+       if there is one, linked in ascending address order */
+    lisp_size_t    i;
+    lisp_cons_t ** run;
+    lisp_cons_t  * cons;
+    int            ret = LISP_OK;
+    _gc_alloc_ticks(vm, n);
+    if(_ensure_cons_run(vm, n, &run)) 
+    {
+      return LISP_ALLOC_ERROR;
+    }
+    if(run == NULL) 
+    {
+      /* scattered free conses, one at a time from the back */
+      while(n > 0) 
+      {
+        if(_ensure_cons_table(vm)) 
+        {
+          *cell = lisp_nil;
+          return LISP_ALLOC_ERROR;
+        }
+        cons = vm->cons_table[vm->white_cons_top];
+        cons->is_root       = 0;
+        cons->gc_cons_index = vm->white_cons_top;
+        _gc_add_young(vm, cons);
+        vm->white_cons_top++;
+        cons->cdr = *cell;
+        ret       = lisp_copy_object(vm, &cons->car, &elems[n - 1]);
+        if(ret != LISP_OK) 
+        {
+          *cell = lisp_nil;
+          return ret;
+        }
+        cell->type_id   = LISP_TID_CONS;
+        cell->data.cons = cons;
+        n--;
+      }
+      return LISP_OK;
+    }
+    for(i = 0; i < n && ret == LISP_OK; i++) 
+    {
+      run[i]->is_root       = 0;
+      run[i]->gc_cons_index = vm->white_cons_top + i;
+      _gc_add_young(vm, run[i]);
+      ret = lisp_copy_object(vm, &run[i]->car, &elems[i]);
+      if(i + 1 < n && ret == LISP_OK) 
+      {
+        run[i]->cdr.type_id   = LISP_TID_CONS;
+        run[i]->cdr.data.cons = run[i + 1];
+      }
+      else 
+      {
+        run[i]->cdr = lisp_nil;
+      }
+    }
+    /* the conses of a failed copy are left to the collector */
+    vm->white_cons_top += i;
+    if(ret != LISP_OK) 
+    {
+      return ret;
+    }
+    cell->type_id   = LISP_TID_CONS;
+    cell->data.cons = run[0];
     return LISP_OK;
   }
 }
@@ -1,28 +1,138 @@
+#include "config.h"
+#ifdef HAS_MMAP
+#define _DEFAULT_SOURCE
+#endif
 #include "lisp_eval.h"
 #include "util/xmalloc.h"
 #include "util/assertion.h"
 #include "core/lisp_symbol.h"
 #include "core/lisp_lambda.h"
 #include "core/lisp_asm.h"
-#include "config.h"
+#ifdef HAS_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef HAS_MMAP
+static inline size_t _lisp_stack_map_size(size_t n_bytes)
+{
+  size_t os_page = (size_t) sysconf(_SC_PAGESIZE);
+  return (n_bytes + os_page - 1) / os_page * os_page;
+}
+
+/* map n_bytes followed by a PROT_NONE guard page, 
+   the end of the stack is adjacent to the guard page */
+static void * _lisp_map_stack(size_t n_bytes)
+{
+  size_t os_page = (size_t) sysconf(_SC_PAGESIZE);
+  size_t size    = _lisp_stack_map_size(n_bytes);
+  char * map     = mmap(NULL,
+                        size + os_page,
+                        PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                        -1,
+                        0);
+  if(map == MAP_FAILED) 
+  {
+    return NULL;
+  }
+  if(mprotect(map + size, os_page, PROT_NONE)) 
+  {
+    munmap(map, size + os_page);
+    return NULL;
+  }
+  return map + size - n_bytes;
+}
 
+static void _lisp_unmap_stack(void * stack, size_t n_bytes)
+{
+  size_t os_page = (size_t) sysconf(_SC_PAGESIZE);
+  size_t size    = _lisp_stack_map_size(n_bytes);
+  munmap((char*) stack + n_bytes - size, size + os_page);
+}
+#endif
+
+/* reserve both stacks at their maximum size,
+   on failure the stacks are left to lisp_push() and lisp_push_call() */
+static void _lisp_map_stacks(lisp_eval_env_t * env)
+{
+#ifdef HAS_MMAP
+  size_t n_stack = sizeof(lisp_cell_t) * env->max_stack_size;
+  size_t n_call  = sizeof(lisp_call_stack_entry_t) * env->max_call_stack_size;
+  lisp_cell_t             * stack      = _lisp_map_stack(n_stack);
+  lisp_call_stack_entry_t * call_stack = _lisp_map_stack(n_call);
+  if(stack == NULL || call_stack == NULL) 
+  {
+    if(stack != NULL) _lisp_unmap_stack(stack, n_stack);
+    if(call_stack != NULL) _lisp_unmap_stack(call_stack, n_call);
+    return;
+  }
+  env->stack           = stack;
+  env->stack_size      = env->max_stack_size;
+  env->call_stack      = call_stack;
+  env->call_stack_size = env->max_call_stack_size;
+  env->stack_mapped    = 1;
+#endif
+}
 
+static void _lisp_free_stacks(lisp_eval_env_t * env)
+{
+#ifdef HAS_MMAP
+  if(env->stack_mapped) 
+  {
+    _lisp_unmap_stack(env->stack, 
+                      sizeof(lisp_cell_t) * env->stack_size);
+    _lisp_unmap_stack(env->call_stack,
+                      sizeof(lisp_call_stack_entry_t) * env->call_stack_size);
+    return;
+  }
+#endif
+  if(env->stack != NULL) 
+  {
+    FREE(env->stack);
+  }
+  if(env->call_stack)
+  {
+    FREE(env->call_stack);
+  }
+}
 
-static void _init_halt(lisp_eval_env_t * env)
+static int _init_halt(lisp_eval_env_t * env)
 {
-  lisp_byte_code_t * byte_code = MALLOC_OBJECT(sizeof(lisp_byte_code_t) + 
-                                               LISP_SIZ_HALT,
-                                               1);
+  int                ret;
+  lisp_byte_code_t * byte_code = MALLOC_VM_OBJECT(env->vm,
+                                                  sizeof(lisp_byte_code_t) + 
+                                                  LISP_SIZ_HALT,
+                                                  1);
+  if(byte_code == NULL) 
+  {
+    return LISP_ALLOC_ERROR;
+  }
   byte_code->instr_size = LISP_SIZ_HALT;
+  byte_code->decoded    = NULL;
+  byte_code->native     = NULL;
+  byte_code->n_calls    = 0;
   ((lisp_instr_t*) &byte_code[1])[0] = LISP_ASM_HALT;
-  lisp_make_cons_typed(env->vm, &env->halt_lambda, LISP_TID_LAMBDA);
+  /* only referenced by env, must be protected from the collector */
+  ret = lisp_make_cons_root_typed(env->vm, 
+                                  &env->halt_lambda, 
+                                  LISP_TID_LAMBDA);
+  if(ret) 
+  {
+    FREE_OBJECT(byte_code);
+    return ret;
+  }
   LISP_CAR(&env->halt_lambda)->type_id  = LISP_TID_OBJECT;
   LISP_CAR(&env->halt_lambda)->data.ptr = byte_code;
-  lisp_push_call(env, 
-                 LISP_AS(&env->halt_lambda,
-                         lisp_lambda_t),
-                 (lisp_instr_t*)&LISP_AS(LISP_CAR(&env->halt_lambda),
-                                         lisp_byte_code_t)[1]);
+  ret = lisp_push_call(env, 
+                       LISP_AS(&env->halt_lambda,
+                               lisp_lambda_t),
+                       (lisp_instr_t*)&byte_code[1]);
+  if(ret) 
+  {
+    lisp_unset_object_root(env->vm, &env->halt_lambda);
+  }
+  return ret;
 }
 
 /* @TODO call stack 
@@ -62,7 +172,27 @@ lisp_eval_env_t * lisp_create_eval_env(lisp_vm_t * vm)
     env->call_stack      = NULL;
     env->call_stack_top  = 0;
     env->call_stack_size = 0;
-    _init_halt(env);
+    env->stack_mapped    = 0;
+    env->eval_depth      = 0;
+    if(vm->eval_stack_mmap) 
+    {
+      _lisp_map_stacks(env);
+    }
+    if(lisp_register_root_region(vm, &env->stack, &env->stack_top)) 
+    {
+      _lisp_free_stacks(env);
+      FREE(env);
+      FREE(values);
+      return NULL;
+    }
+    if(_init_halt(env)) 
+    {
+      lisp_unregister_root_region(vm, &env->stack);
+      _lisp_free_stacks(env);
+      FREE(env);
+      FREE(values);
+      return NULL;
+    }
   }
   else 
   {
@@ -75,24 +205,22 @@ void lisp_free_eval_env(lisp_eval_env_t * env)
 {
   lisp_size_t i;
   lisp_unset_object(env->vm, &env->exception);
-  lisp_unset_object(env->vm, &env->halt_lambda);
+  lisp_unset_object_root(env->vm, &env->halt_lambda);
   REQUIRE_NEQ_PTR(env, NULL);
   for(i = 0; i < env->n_values; i++) 
   {
     lisp_unset_object_root(env->vm, &env->values[i]);
   }
+  lisp_unregister_root_region(env->vm, &env->stack);
   if(env->stack != NULL) 
   {
     for(i = 0; i < env->stack_top; i++) 
     {
-      lisp_unset_object_root(env->vm, &env->stack[i]);
+      lisp_unset_object(env->vm, &env->stack[i]);
     }
-    FREE(env->stack);
-  }
-  if(env->call_stack)
-  {
-    FREE(env->call_stack);
   }
+  lisp_flush_deferred_unset(env->vm);
+  _lisp_free_stacks(env);
   FREE(env->values);
   FREE(env);
 }
@@ -106,12 +234,20 @@ int lisp_register_builtin_function(lisp_eval_env_t        * env,
   lisp_cell_t cell;
   /* @todo error check */
   /* @todo create lisp_builtin_function without regististration */
-  lisp_byte_code_t * lambda = MALLOC_OBJECT(sizeof(lisp_byte_code_t), 0);
+  lisp_byte_code_t * lambda = MALLOC_VM_OBJECT(env->vm, 
+                                                sizeof(lisp_byte_code_t), 0);
+  if(lambda == NULL) 
+  {
+    return LISP_ALLOC_ERROR;
+  }
   cell.type_id = LISP_TID_LAMBDA;
   cell.data.ptr = lambda;
   //lambda->func = func;
   //lambda->data_size = 0;
   lambda->instr_size = 0;
+  lambda->decoded    = NULL;
+  lambda->native     = NULL;
+  lambda->n_calls    = 0;
   lisp_make_symbol(env->vm, &symbol, name);
   lisp_symbol_set(env->vm, symbol.data.ptr, &cell);
   return LISP_OK;
@@ -130,9 +266,16 @@ int lisp_push(lisp_eval_env_t * env,
 {
   if(env->stack_top >= env->stack_size) 
   {
+    lisp_size_t   size;
+    lisp_cell_t * stack;
+    if(env->stack_mapped) 
+    {
+      /* mapped at the maximum size */
+      return LISP_STACK_OVERFLOW;
+    }
     if(env->stack_size == 0) 
     {
-      env->stack_size = LISP_STACK_INIT_BLOCK_SIZE;
+      size = LISP_STACK_INIT_BLOCK_SIZE;
     }
     else 
     {
@@ -140,17 +283,21 @@ int lisp_push(lisp_eval_env_t * env,
       {
         return LISP_STACK_OVERFLOW;
       }
-      env->stack_size = env->stack_size << 1;
+      size = env->stack_size << 1;
     }
-    env->stack = REALLOC(env->stack, sizeof(lisp_cell_t) * env->stack_size);
-    if(!env->stack) 
+    /* the stack is a root region and must stay valid on failure */
+    stack = REALLOC(env->stack, sizeof(lisp_cell_t) * size);
+    if(!stack) 
     {
       return LISP_ALLOC_ERROR;
     }
+    env->stack      = stack;
+    env->stack_size = size;
   }
-  return lisp_copy_object_as_root(env->vm,
-                                  &env->stack[env->stack_top++],
-                                  cell);  
+  /* the stack is scanned as root region, conses are not rooted */
+  return lisp_copy_object_as_region_root(env->vm,
+                                         &env->stack[env->stack_top++],
+                                         cell);  
 }
 
 int lisp_push_call(lisp_eval_env_t * env,
@@ -159,6 +306,10 @@ int lisp_push_call(lisp_eval_env_t * env,
 {
   if(env->call_stack_top >= env->call_stack_size) 
   {
+    if(env->stack_mapped) 
+    {
+      return LISP_STACK_OVERFLOW;
+    }
     if(env->call_stack_size == 0) 
     {
       env->call_stack_size = LISP_CALL_STACK_INIT_BLOCK_SIZE;
@@ -181,6 +332,8 @@ int lisp_push_call(lisp_eval_env_t * env,
     }
   }
   env->call_stack[env->call_stack_top].lambda = lambda;
+  env->call_stack[env->call_stack_top].nargs  = 0;
+  env->call_stack[env->call_stack_top].next_decoded = NULL;
   env->call_stack[env->call_stack_top++].next_instr = next_instr;
   env->exception = lisp_nil;
   return LISP_OK;
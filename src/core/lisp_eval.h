@@ -31,4 +31,9 @@ int lisp_push(lisp_eval_env_t * env,
 int lisp_push_call(lisp_eval_env_t * env,
                    lisp_lambda_t   * lambda,
                    lisp_instr_t    * next_instr);
+
+/** Push a call to the halt lambda of env, RET returns to the caller
+ *  of lisp_eval_lambda().
+ */
+int lisp_push_halt(lisp_eval_env_t * env);
 #endif
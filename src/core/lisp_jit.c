@@ -0,0 +1,591 @@
+#include "config.h"
+#ifdef HAS_MMAP
+#define _DEFAULT_SOURCE
+#endif
+#include "lisp_jit.h"
+#include "lisp_vm.h"
+#include "core/lisp_eval.h"
+#include "core/lisp_asm.h"
+#include "util/xmalloc.h"
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#ifdef LISP_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef LISP_JIT
+/****************************************************************************
+ * helpers called by the machine code
+ ****************************************************************************/
+/* a run of n instructions with the cell operand at arg */
+static int _lisp_jit_ldvd(lisp_eval_env_t     * env, 
+                          const unsigned char * arg,
+                          lisp_size_t           n)
+{
+  /* the operands of the byte code are not aligned */
+  lisp_cell_t cell;
+  env->n_values = 1;
+  for(; n; n--, arg+= LISP_SIZ_LDVD)
+  {
+    memcpy(&cell, arg, sizeof(lisp_cell_t));
+    lisp_copy_object_as_root(env->vm, env->values, &cell);
+  }
+  return LISP_OK;
+}
+
+static int _lisp_jit_pushd(lisp_eval_env_t     * env, 
+                           const unsigned char * arg,
+                           lisp_size_t           n)
+{
+  lisp_cell_t cell;
+  int         ret;
+  for(; n; n--, arg+= LISP_SIZ_PUSHD)
+  {
+    memcpy(&cell, arg, sizeof(lisp_cell_t));
+    if((ret = lisp_push(env, &cell)) != LISP_OK)
+    {
+      return ret;
+    }
+  }
+  return LISP_OK;
+}
+
+static int _lisp_jit_builtin(lisp_eval_env_t         * env,
+                             lisp_lambda_t           * lambda,
+                             lisp_size_t               nargs,
+                             lisp_builtin_function_t   func)
+{
+  int ret = (*func)(env, lambda, nargs);
+  while(nargs)
+  {
+    lisp_unset_object_deferred(env->vm, &env->stack[--env->stack_top]);
+    --nargs;
+  }
+  return ret;
+}
+
+/****************************************************************************
+ * templates
+ *
+ * The machine code is called as lisp_jit_function_t,
+ * the arguments are kept in callee saved registers:
+ *
+ *   rbx: env, r12: lambda, r13: nargs, r14: exit
+ ****************************************************************************/
+static const unsigned char _lisp_jit_prologue[] =
+{
+  0x53,                         /* push rbx      */
+  0x41, 0x54,                   /* push r12      */
+  0x41, 0x55,                   /* push r13      */
+  0x41, 0x56,                   /* push r14      */
+  0x48, 0x83, 0xec, 0x08,       /* sub  rsp, 8   */
+  0x48, 0x89, 0xfb,             /* mov  rbx, rdi */
+  0x49, 0x89, 0xf4,             /* mov  r12, rsi */
+  0x49, 0x89, 0xd5,             /* mov  r13, rdx */
+  0x49, 0x89, 0xce              /* mov  r14, rcx */
+};
+
+static const unsigned char _lisp_jit_epilogue[] =
+{
+  0x48, 0x83, 0xc4, 0x08,       /* add  rsp, 8   */
+  0x41, 0x5e,                   /* pop  r14      */
+  0x41, 0x5d,                   /* pop  r13      */
+  0x41, 0x5c,                   /* pop  r12      */
+  0x5b,                         /* pop  rbx      */
+  0xc3                          /* ret           */
+};
+
+/* helper(env, arg, n), return unless the result is LISP_OK */
+#define LISP_JIT_SIZ_CALL_ARG (3 + 10 + 10 + 10 + 2 + 2 + 2 + \
+                               sizeof(_lisp_jit_epilogue))
+/* helper(env, lambda, nargs, ip, exit), return unless the result 
+   is LISP_OK */
+#define LISP_JIT_SIZ_EVAL     (3 + 3 + 3 + 10 + 3 + 10 + 2 + 2 + 2 + \
+                               sizeof(_lisp_jit_epilogue))
+/* helper(env, lambda, nargs, func), return the result */
+#define LISP_JIT_SIZ_BUILTIN  (3 + 3 + 3 + 10 + 10 + 2 + \
+                               sizeof(_lisp_jit_epilogue))
+/* exit->lambda = lambda, exit->nargs = nargs, return LISP_JIT_JP */
+#define LISP_JIT_SIZ_JP       (10 + 3 + 10 + 4 + 5 + \
+                               sizeof(_lisp_jit_epilogue))
+/* return code */
+#define LISP_JIT_SIZ_RETURN   (5 + sizeof(_lisp_jit_epilogue))
+
+static inline unsigned char * _emit(unsigned char       * code,
+                                    const unsigned char * bytes,
+                                    size_t                n)
+{
+  memcpy(code, bytes, n);
+  return code + n;
+}
+
+static inline unsigned char * _emit_imm64(unsigned char * code,
+                                          const void    * value)
+{
+  memcpy(code, value, 8);
+  return code + 8;
+}
+
+/* mov rax, imm64 */
+static inline unsigned char * _emit_mov_rax(unsigned char * code,
+                                            const void    * value)
+{
+  *code++ = 0x48;
+  *code++ = 0xb8;
+  return _emit_imm64(code, value);
+}
+
+static unsigned char * _emit_return(unsigned char * code, int32_t ret)
+{
+  *code++ = 0xb8;               /* mov eax, imm32 */
+  memcpy(code, &ret, 4);
+  code+= 4;
+  return _emit(code, _lisp_jit_epilogue, sizeof(_lisp_jit_epilogue));
+}
+
+static unsigned char * _emit_call_arg(unsigned char  * code,
+                                      void           * helper,
+                                      const void     * arg,
+                                      lisp_size_t      n)
+{
+  static const unsigned char mov_rdi_rbx[] = { 0x48, 0x89, 0xdf };
+  static const unsigned char call_check[]  =
+  {
+    0xff, 0xd0,                 /* call rax      */
+    0x85, 0xc0,                 /* test eax, eax */
+    0x74, sizeof(_lisp_jit_epilogue) /* jz   over the epilogue */
+  };
+  code    = _emit(code, mov_rdi_rbx, sizeof(mov_rdi_rbx));
+  *code++ = 0x48;               /* mov rsi, imm64 */
+  *code++ = 0xbe;
+  code    = _emit_imm64(code, &arg);
+  *code++ = 0x48;               /* mov rdx, imm64 */
+  *code++ = 0xba;
+  code    = _emit_imm64(code, &n);
+  code    = _emit_mov_rax(code, &helper);
+  code    = _emit(code, call_check, sizeof(call_check));
+  return _emit(code, _lisp_jit_epilogue, sizeof(_lisp_jit_epilogue));
+}
+
+static unsigned char * _emit_builtin(unsigned char           * code,
+                                     lisp_builtin_function_t   func)
+{
+  static const unsigned char mov_args[] =
+  {
+    0x48, 0x89, 0xdf,           /* mov rdi, rbx */
+    0x4c, 0x89, 0xe6,           /* mov rsi, r12 */
+    0x4c, 0x89, 0xea            /* mov rdx, r13 */
+  };
+  static const unsigned char call_rax[] = { 0xff, 0xd0 };
+  void * helper = (void*) _lisp_jit_builtin;
+  code    = _emit(code, mov_args, sizeof(mov_args));
+  *code++ = 0x48;               /* mov rcx, imm64 */
+  *code++ = 0xb9;
+  code    = _emit_imm64(code, &func);
+  code    = _emit_mov_rax(code, &helper);
+  code    = _emit(code, call_rax, sizeof(call_rax));
+  return _emit(code, _lisp_jit_epilogue, sizeof(_lisp_jit_epilogue));
+}
+
+static unsigned char * _emit_eval(unsigned char        * code,
+                                  lisp_decoded_instr_t * ip)
+{
+  static const unsigned char mov_args[] =
+  {
+    0x48, 0x89, 0xdf,           /* mov rdi, rbx */
+    0x4c, 0x89, 0xe6,           /* mov rsi, r12 */
+    0x4c, 0x89, 0xea            /* mov rdx, r13 */
+  };
+  static const unsigned char mov_r8_r14[] = { 0x4d, 0x89, 0xf0 };
+  static const unsigned char call_check[] =
+  {
+    0xff, 0xd0,                 /* call rax      */
+    0x85, 0xc0,                 /* test eax, eax */
+    0x74, sizeof(_lisp_jit_epilogue) /* jz   over the epilogue */
+  };
+  void * helper = (void*) _lisp_jit_helper(ip->opcode);
+  code    = _emit(code, mov_args, sizeof(mov_args));
+  *code++ = 0x48;               /* mov rcx, imm64 */
+  *code++ = 0xb9;
+  code    = _emit_imm64(code, &ip);
+  code    = _emit(code, mov_r8_r14, sizeof(mov_r8_r14));
+  code    = _emit_mov_rax(code, &helper);
+  code    = _emit(code, call_check, sizeof(call_check));
+  return _emit(code, _lisp_jit_epilogue, sizeof(_lisp_jit_epilogue));
+}
+
+static unsigned char * _emit_jp(unsigned char * code,
+                                lisp_size_t     nargs,
+                                lisp_lambda_t * lambda)
+{
+  static const unsigned char store_lambda[] = { 0x49, 0x89, 0x06 };
+  static const unsigned char store_nargs[]  = { 0x49, 0x89, 0x46,
+                                                offsetof(lisp_jit_exit_t,
+                                                         nargs) };
+  code = _emit_mov_rax(code, &lambda);
+  code = _emit(code, store_lambda, sizeof(store_lambda)); /* [r14]     */
+  code = _emit_mov_rax(code, &nargs);
+  code = _emit(code, store_nargs, sizeof(store_nargs));   /* [r14 + 8] */
+  return _emit_return(code, LISP_JIT_JP);
+}
+
+/* number of instructions op starting at instr */
+static lisp_size_t _lisp_jit_run(const lisp_instr_t * instr,
+                                 const lisp_instr_t * end,
+                                 lisp_instr_t         op,
+                                 lisp_size_t          instr_size)
+{
+  lisp_size_t n = 0;
+  while(instr < end && *instr == op)
+  {
+    instr+= instr_size;
+    n++;
+  }
+  return n;
+}
+
+/* size of the machine code of instr, 0 without template */
+static size_t _lisp_jit_size(lisp_instr_t instr)
+{
+  switch(instr)
+  {
+  case LISP_ASM_LDVD:
+  case LISP_ASM_PUSHD:   return LISP_JIT_SIZ_CALL_ARG;
+  case LISP_ASM_BUILTIN: return LISP_JIT_SIZ_BUILTIN;
+  case LISP_ASM_JP:      return LISP_JIT_SIZ_JP;
+  case LISP_ASM_RET:
+  case LISP_ASM_HALT:    return LISP_JIT_SIZ_RETURN;
+  default:               return (_lisp_jit_helper(instr) != NULL ? 
+                                 LISP_JIT_SIZ_EVAL : 0);
+  }
+}
+
+/* the machine code is only entered at the start of the byte code,
+   instructions after an exit are left to the interpreter */
+static inline int _lisp_jit_is_exit(lisp_instr_t instr)
+{
+  return (instr == LISP_ASM_BUILTIN ||
+          instr == LISP_ASM_JP ||
+          instr == LISP_ASM_RET ||
+          instr == LISP_ASM_HALT ||
+          instr == LISP_ASM_CALL ||
+          instr == LISP_ASM_CALLR ||
+          instr == LISP_ASM_CALLV ||
+          instr == LISP_ASM_JPR ||
+          instr == LISP_ASM_JPV);
+}
+
+/****************************************************************************
+ * code chunks
+ *
+ * Machine code is bump allocated from chunks mapped per vm. A chunk 
+ * is executable, the pages of new code are only writable while the 
+ * code is emitted. Every block of code starts with the chunk it 
+ * belongs to and the instructions decoded for the helpers,
+ * the code follows at LISP_JIT_HEADER.
+ ****************************************************************************/
+#define LISP_JIT_HEADER 16
+
+typedef struct lisp_jit_chunk_t
+{
+  struct lisp_jit_chunk_t * next;
+  lisp_vm_t               * vm;
+  unsigned char           * map;
+  size_t                    size;
+  size_t                    top;
+  /* blocks that have not been released */
+  size_t                    n_live;
+} lisp_jit_chunk_t;
+
+static inline size_t _lisp_jit_page_size(void)
+{
+  return (size_t) sysconf(_SC_PAGESIZE);
+}
+
+static void _lisp_jit_unmap_chunk(lisp_jit_chunk_t * chunk)
+{
+  chunk->vm->mem_jit -= chunk->size;
+  munmap(chunk->map, chunk->size);
+  FREE(chunk);
+}
+
+/* change the protection of the pages of [block, block + size) */
+static int _lisp_jit_protect(unsigned char * block, size_t size, int prot)
+{
+  size_t    os_page = _lisp_jit_page_size();
+  uintptr_t begin   = (uintptr_t) block / os_page * os_page;
+  uintptr_t end     = ((uintptr_t) block + size + os_page - 1) / os_page * 
+                      os_page;
+  return mprotect((void*) begin, end - begin, prot);
+}
+
+/* writable block of size bytes including the header, 
+   decoded is released with the block */
+static unsigned char * _lisp_jit_alloc(lisp_vm_t            * vm, 
+                                       size_t                 size,
+                                       lisp_decoded_instr_t * decoded)
+{
+  lisp_jit_chunk_t * chunk = vm->jit_chunks;
+  unsigned char    * block;
+  size_t             os_page;
+  size = (size + LISP_JIT_HEADER - 1) / LISP_JIT_HEADER * LISP_JIT_HEADER;
+  if(chunk == NULL || chunk->size - chunk->top < size) 
+  {
+    os_page = _lisp_jit_page_size();
+    chunk   = MALLOC(sizeof(lisp_jit_chunk_t));
+    if(chunk == NULL) 
+    {
+      return NULL;
+    }
+    chunk->size = (size > LISP_JIT_CHUNK_SIZE ? size : LISP_JIT_CHUNK_SIZE);
+    chunk->size = (chunk->size + os_page - 1) / os_page * os_page;
+    if(lisp_heap_limit_exceeded(vm, chunk->size)) 
+    {
+      FREE(chunk);
+      return NULL;
+    }
+    chunk->map = mmap(NULL,
+                      chunk->size,
+                      PROT_READ | PROT_EXEC,
+                      MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1,
+                      0);
+    if(chunk->map == MAP_FAILED) 
+    {
+      FREE(chunk);
+      return NULL;
+    }
+    chunk->vm     = vm;
+    chunk->top    = 0;
+    chunk->n_live = 0;
+    chunk->next   = vm->jit_chunks;
+    if(chunk->next != NULL && chunk->next->n_live == 0) 
+    {
+      /* too small for the code, nothing to keep */
+      chunk->next = chunk->next->next;
+      _lisp_jit_unmap_chunk(vm->jit_chunks);
+    }
+    vm->jit_chunks = chunk;
+    vm->mem_jit  += chunk->size;
+  }
+  block = chunk->map + chunk->top;
+  if(_lisp_jit_protect(block, size, PROT_READ | PROT_WRITE)) 
+  {
+    return NULL;
+  }
+  chunk->top += size;
+  chunk->n_live++;
+  memcpy(block, &chunk, sizeof(lisp_jit_chunk_t*));
+  memcpy(block + sizeof(lisp_jit_chunk_t*), 
+         &decoded,
+         sizeof(lisp_decoded_instr_t*));
+  return block;
+}
+
+static void _lisp_jit_release(unsigned char * block)
+{
+  lisp_jit_chunk_t     * chunk;
+  lisp_jit_chunk_t    ** prev;
+  lisp_decoded_instr_t * decoded;
+  memcpy(&chunk, block, sizeof(lisp_jit_chunk_t*));
+  memcpy(&decoded, 
+         block + sizeof(lisp_jit_chunk_t*),
+         sizeof(lisp_decoded_instr_t*));
+  if(decoded != NULL)
+  {
+    FREE_OBJECT(decoded);
+  }
+  if(--chunk->n_live) 
+  {
+    return;
+  }
+  if(chunk == chunk->vm->jit_chunks) 
+  {
+    /* the chunk that is filled is reused */
+    chunk->top = 0;
+    return;
+  }
+  prev = &chunk->vm->jit_chunks;
+  while(*prev != chunk) 
+  {
+    prev = &(*prev)->next;
+  }
+  *prev = chunk->next;
+  _lisp_jit_unmap_chunk(chunk);
+}
+
+void _lisp_free_jit_chunks(lisp_vm_t * vm)
+{
+  while(vm->jit_chunks != NULL) 
+  {
+    lisp_jit_chunk_t * next = vm->jit_chunks->next;
+    _lisp_jit_unmap_chunk(vm->jit_chunks);
+    vm->jit_chunks = next;
+  }
+}
+
+int lisp_jit_compile(lisp_vm_t * vm, lisp_byte_code_t * byte_code)
+{
+  lisp_instr_t         * start = (lisp_instr_t*) &byte_code[1];
+  lisp_instr_t         * end   = start + byte_code->instr_size;
+  lisp_instr_t         * instr;
+  size_t                 size  = sizeof(_lisp_jit_prologue);
+  size_t                 n;
+  int                    has_eval = 0;
+  unsigned char        * block;
+  unsigned char        * code;
+  lisp_size_t            nargs;
+  lisp_size_t            k;
+  lisp_lambda_t        * lambda;
+  lisp_decoded_instr_t * decoded = NULL;
+  lisp_builtin_function_t func;
+  for(instr = start; instr < end; instr+= lisp_instr_size(*instr))
+  {
+    if(*instr == LISP_ASM_LDVD || 
+       *instr == LISP_ASM_PUSHD || 
+       *instr == LISP_ASM_LDVR)
+    {
+      /* one call for the run */
+      n      = lisp_instr_size(*instr);
+      instr += (_lisp_jit_run(instr, end, *instr, n) - 1) * n;
+    }
+    if((n = _lisp_jit_size(*instr)) == 0)
+    {
+      return LISP_UNSUPPORTED;
+    }
+    size    += n;
+    has_eval = has_eval || _lisp_jit_helper(*instr) != NULL;
+    if(*instr == LISP_ASM_FIXR)
+    {
+      /* FIXR S; op is one call */
+      instr+= LISP_SIZ_FIXR;
+      if(instr >= end || !LISP_IS_FIXNUM_INSTR(*instr))
+      {
+        return LISP_UNSUPPORTED;
+      }
+    }
+    if(_lisp_jit_is_exit(*instr))
+    {
+      break;
+    }
+  }
+  if(instr >= end)
+  {
+    /* no exit */
+    return LISP_UNSUPPORTED;
+  }
+  end = instr + lisp_instr_size(*instr);
+  if(has_eval && 
+     (decoded = _lisp_jit_decode(vm, byte_code, end - start)) == NULL)
+  {
+    return LISP_ALLOC_ERROR;
+  }
+  size += LISP_JIT_HEADER;
+  block = _lisp_jit_alloc(vm, size, decoded);
+  if(block == NULL)
+  {
+    if(decoded != NULL)
+    {
+      FREE_OBJECT(decoded);
+    }
+    return LISP_ALLOC_ERROR;
+  }
+  code = _emit(block + LISP_JIT_HEADER,
+               _lisp_jit_prologue,
+               sizeof(_lisp_jit_prologue));
+  /* k: index of instr in decoded */
+  for(instr = start, k = 0; instr < end; instr+= lisp_instr_size(*instr), k++)
+  {
+    switch(*instr)
+    {
+    case LISP_ASM_LDVD:
+      n = _lisp_jit_run(instr, end, LISP_ASM_LDVD, LISP_SIZ_LDVD);
+      code = _emit_call_arg(code,
+                            (void*) _lisp_jit_ldvd,
+                            LISP_INSTR_ARG(instr, lisp_cell_t),
+                            n);
+      instr+= (n - 1) * (LISP_SIZ_LDVD);
+      k    += n - 1;
+      break;
+    case LISP_ASM_PUSHD:
+      n = _lisp_jit_run(instr, end, LISP_ASM_PUSHD, LISP_SIZ_PUSHD);
+      code = _emit_call_arg(code,
+                            (void*) _lisp_jit_pushd,
+                            LISP_INSTR_ARG(instr, lisp_cell_t),
+                            n);
+      instr+= (n - 1) * (LISP_SIZ_PUSHD);
+      k    += n - 1;
+      break;
+    case LISP_ASM_BUILTIN:
+      memcpy(&func,
+             LISP_INSTR_ARG(instr, lisp_builtin_function_t),
+             sizeof(func));
+      code = _emit_builtin(code, func);
+      break;
+    case LISP_ASM_JP:
+      memcpy(&nargs, LISP_INSTR_ARG(instr, lisp_size_t), sizeof(nargs));
+      memcpy(&lambda,
+             LISP_INSTR_ARG_2(instr, lisp_size_t, lisp_lambda_t*),
+             sizeof(lambda));
+      code = _emit_jp(code, nargs, lambda);
+      break;
+    case LISP_ASM_RET:
+      code = _emit_return(code, LISP_JIT_RET);
+      break;
+    case LISP_ASM_HALT:
+      code = _emit_return(code, LISP_OK);
+      break;
+    case LISP_ASM_LDVR:
+      /* the helper evaluates the run */
+      n = _lisp_jit_run(instr, end, LISP_ASM_LDVR, LISP_SIZ_LDVR);
+      code = _emit_eval(code, &decoded[k]);
+      instr+= (n - 1) * (LISP_SIZ_LDVR);
+      k    += n - 1;
+      break;
+    case LISP_ASM_FIXR:
+      code = _emit_eval(code, &decoded[k]);
+      /* the fixnum instruction is evaluated with FIXR */
+      instr+= LISP_SIZ_FIXR;
+      k++;
+      break;
+    default:
+      code = _emit_eval(code, &decoded[k]);
+      break;
+    }
+  }
+  if(_lisp_jit_protect(block, size, PROT_READ | PROT_EXEC))
+  {
+    _lisp_jit_release(block);
+    return LISP_ALLOC_ERROR;
+  }
+  byte_code->native = block + LISP_JIT_HEADER;
+  return LISP_OK;
+}
+
+void lisp_jit_free(lisp_byte_code_t * byte_code)
+{
+  if(byte_code->native != NULL)
+  {
+    _lisp_jit_release((unsigned char*) byte_code->native - LISP_JIT_HEADER);
+    byte_code->native = NULL;
+  }
+}
+
+#else
+
+int lisp_jit_compile(lisp_vm_t * vm, lisp_byte_code_t * byte_code)
+{
+  return LISP_UNSUPPORTED;
+}
+
+void lisp_jit_free(lisp_byte_code_t * byte_code)
+{
+}
+
+void _lisp_free_jit_chunks(lisp_vm_t * vm)
+{
+}
+
+#endif
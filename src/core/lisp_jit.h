@@ -0,0 +1,82 @@
+#ifndef __LISP_JIT_H__
+#define __LISP_JIT_H__
+#include "config.h"
+#include "lisp_type.h"
+
+/* Baseline template JIT: every instruction of the byte code of a
+   lambda is translated to a fixed sequence of x86-64 machine code,
+   most of them call a helper function, up to the first BUILTIN, 
+   RET, HALT or call. Lambdas with an instruction without template 
+   are left to lisp_eval_lambda().
+   Define LISP_NO_JIT to disable the compiler. */
+#if defined(HAS_MMAP) && defined(__x86_64__) && !defined(LISP_NO_JIT)
+#define LISP_JIT
+#endif
+
+/** Size of the chunks of machine code mapped by a vm */
+#ifndef LISP_JIT_CHUNK_SIZE
+#define LISP_JIT_CHUNK_SIZE (64 * 1024)
+#endif
+
+/** Number of calls after which lisp_eval_lambda() compiles a lambda */
+#ifndef LISP_JIT_THRESHOLD
+#define LISP_JIT_THRESHOLD 64
+#endif
+
+/* Results of the machine code besides the results of builtins */
+#define LISP_JIT_JP   (-1) /* continue with the lambda of the exit */
+#define LISP_JIT_RET  (-2) /* return to the top of the call stack */
+#define LISP_JIT_CALL (-3) /* call the lambda of the exit, the return
+                              is on the call stack */
+
+/** Target of the JP or call that ended the machine code. */
+typedef struct lisp_jit_exit_t
+{
+  lisp_lambda_t * lambda;
+  lisp_size_t     nargs;
+} lisp_jit_exit_t;
+
+/** Signature of byte_code->native. */
+typedef int(*lisp_jit_function_t)(lisp_eval_env_t * env,
+                                  lisp_lambda_t   * lambda,
+                                  lisp_size_t       nargs,
+                                  lisp_jit_exit_t * exit);
+
+/** Translate byte code to machine code, stored in byte_code->native.
+ *  The code is bump allocated from chunks of LISP_JIT_CHUNK_SIZE bytes
+ *  mapped by the vm, accounted as jit_code by lisp_get_memory_usage().
+ *  @return LISP_OK, LISP_UNSUPPORTED if the byte code has an
+ *          instruction without template or the JIT is disabled,
+ *          LISP_ALLOC_ERROR
+ */
+int lisp_jit_compile(struct lisp_vm_t * vm, lisp_byte_code_t * byte_code);
+
+/** Release the machine code of byte_code, a chunk is unmapped when 
+ *  all of its code has been released. */
+void lisp_jit_free(lisp_byte_code_t * byte_code);
+
+/* Instructions without a template of their own call a helper of the
+   interpreter, defined in lisp_lambda.c */
+struct lisp_decoded_instr_t;
+
+/* decoded copy of the first instr_size bytes of byte_code, 
+   without superinstructions, released with FREE_OBJECT */
+struct lisp_decoded_instr_t * 
+_lisp_jit_decode(struct lisp_vm_t       * vm,
+                 const lisp_byte_code_t * byte_code,
+                 lisp_size_t              instr_size);
+
+/** Helper evaluating the instruction ip, the run of LDVR starting
+ *  at ip, FIXR together with the fixnum instruction that follows it. 
+ *  @return LISP_OK to continue, LISP_JIT_JP or LISP_JIT_CALL with 
+ *          exit, an error otherwise */
+typedef int(*lisp_jit_helper_t)(lisp_eval_env_t             * env,
+                                lisp_lambda_t               * lambda,
+                                lisp_size_t                   nargs,
+                                struct lisp_decoded_instr_t * ip,
+                                lisp_jit_exit_t             * exit);
+
+/* helper of opcode, NULL without helper */
+lisp_jit_helper_t _lisp_jit_helper(lisp_instr_t opcode);
+
+#endif
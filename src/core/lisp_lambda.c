@@ -5,6 +5,7 @@
 #include "core/lisp_symbol.h"
 #include "core/lisp_exception.h"
 #include "core/lisp_asm.h"
+#include "core/lisp_jit.h"
 #include <string.h>
 
 typedef struct lisp_compile_state_t
@@ -27,17 +28,41 @@ _lisp_compile_phase1_list_of_expressions(lisp_vm_t            * vm,
                                          lisp_compile_state_t * state,
                                          const lisp_cell_t    * rest);
 
+static int _lisp_compile_phase1_call(lisp_vm_t            * vm,
+                                     lisp_compile_state_t * state,
+                                     const lisp_cell_t    * expr,
+                                     int                    tail);
+
+static int _lisp_compile_phase1_arg(lisp_vm_t            * vm,
+                                    lisp_compile_state_t * state,
+                                    const lisp_cell_t    * arg);
+
 static int _lisp_compile_phase2(lisp_vm_t         * vm,
                                 lisp_cell_t       * cell,
                                 lisp_instr_t      * instr,
                                 const lisp_cell_t * expr);
 
+static int _lisp_compile_phase2_call(lisp_vm_t           * vm,
+                                     lisp_cell_t         * cell,
+                                     lisp_instr_t       ** instr,
+                                     const lisp_cell_t   * expr,
+                                     int                   tail);
+
 static int _lisp_compile_phase2_list_of_expressions(lisp_vm_t           * vm,
                                                     lisp_cell_t         * cell,
                                                     lisp_instr_t       ** instr,
                                                     lisp_size_t         * n_expr,
                                                     const lisp_cell_t   * rest);
 
+static int _lisp_compile_phase2_arg(lisp_vm_t           * vm,
+                                    lisp_cell_t         * cell,
+                                    lisp_instr_t       ** instr,
+                                    const lisp_cell_t   * arg);
+
+static int _lisp_lambda_compile(lisp_vm_t         * vm,
+                                lisp_cell_t       * cell,
+                                const lisp_cell_t * expr);
+
 static int _lisp_compile_prepend_data(lisp_vm_t         * vm,
                                       lisp_cell_t * cell,
                                       const lisp_cell_t * obj);
@@ -48,11 +73,19 @@ static int lisp_compile_alloc(lisp_vm_t     * vm,
                               lisp_instr_t ** instr,
                               lisp_size_t     instr_size)
 {
-  /* @todo check allocation */
-  lisp_byte_code_t * byte_code = MALLOC_OBJECT(sizeof(lisp_byte_code_t) + 
-                                               instr_size,
-                                               1);
+  lisp_byte_code_t * byte_code = MALLOC_VM_OBJECT(vm,
+                                                  sizeof(lisp_byte_code_t) + 
+                                                  instr_size,
+                                                  1);
+  if(byte_code == NULL) 
+  {
+    *cell = lisp_nil;
+    return LISP_ALLOC_ERROR;
+  }
   byte_code->instr_size = instr_size;
+  byte_code->decoded    = NULL;
+  byte_code->native     = NULL;
+  byte_code->n_calls    = 0;
   *instr               = (lisp_instr_t*) &byte_code[1];
   /* @todo check if it should be root ? */
   lisp_make_cons_typed(vm, cell, LISP_TID_LAMBDA);
@@ -61,6 +94,68 @@ static int lisp_compile_alloc(lisp_vm_t     * vm,
   return LISP_OK;
 }
 
+/* fixnum instruction of a lambda made by lisp_make_builtin_lambda_op(), 
+   0 for other values */
+static lisp_instr_t _lisp_fixnum_instr(const lisp_cell_t * func)
+{
+  lisp_byte_code_t * byte_code;
+  lisp_instr_t     * instr;
+  if(!LISP_IS_LAMBDA(func)) 
+  {
+    return 0;
+  }
+  byte_code = LISP_AS(LISP_CAR(func), lisp_byte_code_t);
+  instr     = (lisp_instr_t*) &byte_code[1];
+  if(byte_code->instr_size == LISP_SIZ_BUILTIN + sizeof(lisp_instr_t) &&
+     instr[0] == LISP_ASM_BUILTIN &&
+     LISP_IS_FIXNUM_INSTR(instr[LISP_SIZ_BUILTIN]))
+  {
+    return instr[LISP_SIZ_BUILTIN];
+  }
+  return 0;
+}
+
+/* fixnum instruction of a call (F A B) with two arguments, F is such 
+   a lambda or a symbol bound to one (guarded by FIXR), 0 otherwise */
+static lisp_instr_t _lisp_compile_fixnum_instr(lisp_vm_t         * vm,
+                                               const lisp_cell_t * expr)
+{
+  const lisp_cell_t * func = LISP_CAR(expr);
+  const lisp_cell_t * rest = LISP_CDR(expr);
+  if(!LISP_IS_CONS(rest) || 
+     !LISP_IS_CONS(LISP_CDR(rest)) ||
+     !LISP_IS_NIL(LISP_CDDR(rest)))
+  {
+    return 0;
+  }
+  if(LISP_IS_SYMBOL(func)) 
+  {
+    func = lisp_symbol_get(vm, LISP_AS(func, lisp_symbol_t));
+    if(func == NULL) 
+    {
+      return 0;
+    }
+  }
+  return _lisp_fixnum_instr(func);
+}
+
+/* form bound to the symbol at the head of the call expr, NULL otherwise */
+static lisp_form_t * _lisp_compile_form(lisp_vm_t         * vm,
+                                        const lisp_cell_t * expr)
+{
+  lisp_cell_t * value;
+  if(!LISP_IS_SYMBOL(LISP_CAR(expr))) 
+  {
+    return NULL;
+  }
+  value = lisp_symbol_get(vm, LISP_AS(LISP_CAR(expr), lisp_symbol_t));
+  if(value && LISP_IS_FORM(value)) 
+  {
+    return LISP_AS(value, lisp_form_t);
+  }
+  return NULL;
+}
+
 /****************************************************************************/
 static int _lisp_compile_phase1(lisp_vm_t            * vm,
                                 lisp_compile_state_t * state,
@@ -89,39 +184,58 @@ static int _lisp_compile_phase1(lisp_vm_t            * vm,
   }
   else if(LISP_IS_CONS(expr)) 
   {
-    if(LISP_IS_LAMBDA(LISP_CAR(expr)))
-    {
-      state->instr_size+= LISP_SIZ_JP;
-      return _lisp_compile_phase1_list_of_expressions(vm,
-                                                      state,
-                                                      LISP_CDR(expr));
-    }
-    else if(LISP_IS_SYMBOL(LISP_CAR(expr)))
+    lisp_form_t * form = _lisp_compile_form(vm, expr);
+    if(form != NULL) 
     {
-      lisp_cell_t * value;
-      value = lisp_symbol_get(vm, LISP_AS(LISP_CAR(expr), lisp_symbol_t));
-      if(value && LISP_IS_FORM(value)) 
-      {
-        return LISP_AS(value, lisp_form_t)->phase1(vm,
-                                                   &state->instr_size,
-                                                   expr);
-      }
-      else 
-      {
-        /* @todo: implement other cases */
-        return LISP_UNSUPPORTED;
-      }
+      return form->phase1(vm, &state->instr_size, expr);
     }
-    else 
+    return _lisp_compile_phase1_call(vm, state, expr, 1);
+  }
+  else 
+  {
+    return LISP_UNSUPPORTED;
+  }
+}
+
+/* size of a call, a tail call ends the lambda */
+static int _lisp_compile_phase1_call(lisp_vm_t            * vm,
+                                     lisp_compile_state_t * state,
+                                     const lisp_cell_t    * expr,
+                                     int                    tail)
+{
+  int ret;
+  if(_lisp_compile_fixnum_instr(vm, expr)) 
+  {
+    /* A; B; (FIXR S;) op (RET) */
+    state->instr_size+= ((LISP_IS_SYMBOL(LISP_CAR(expr)) ? LISP_SIZ_FIXR : 0) +
+                         sizeof(lisp_instr_t) + 
+                         (tail ? LISP_SIZ_RET : 0));
+  }
+  else if(LISP_IS_LAMBDA(LISP_CAR(expr))) 
+  {
+    state->instr_size+= (tail ? LISP_SIZ_JP : LISP_SIZ_CALL);
+  }
+  else if(LISP_IS_SYMBOL(LISP_CAR(expr))) 
+  {
+    state->instr_size+= (tail ? LISP_SIZ_JPR : LISP_SIZ_CALLR);
+  }
+  else if(LISP_IS_CONS(LISP_CAR(expr))) 
+  {
+    /* head; PUSHV; A; B; CALLV 2 (JPV 2) */
+    if((ret = _lisp_compile_phase1_arg(vm, state, LISP_CAR(expr))) != LISP_OK)
     {
-      /* @todo */
-      return LISP_UNSUPPORTED;
+      return ret;
     }
+    state->instr_size+= (tail ? LISP_SIZ_JPV : LISP_SIZ_CALLV);
   }
   else 
   {
+    /* @todo */
     return LISP_UNSUPPORTED;
   }
+  return _lisp_compile_phase1_list_of_expressions(vm,
+                                                  state,
+                                                  LISP_CDR(expr));
 }
 
 static int
@@ -129,19 +243,14 @@ _lisp_compile_phase1_list_of_expressions(lisp_vm_t            * vm,
                                          lisp_compile_state_t * state,
                                          const lisp_cell_t    * rest)
 {
+  int ret;
   while(!LISP_IS_NIL(rest)) 
   {
     if(LISP_IS_CONS(rest)) 
     {
-      if(LISP_IS_ATOM(LISP_CAR(rest))) 
-      {
-        /* @todo implement */
-        /* PUSHD D */
-        state->instr_size += LISP_SIZ_PUSHD;
-      }
-      else 
+      if((ret = _lisp_compile_phase1_arg(vm, state, LISP_CAR(rest))) != LISP_OK)
       {
-        /* @todo implement */
+        return ret;
       }
       rest = LISP_CDR(rest);
     }
@@ -154,6 +263,49 @@ _lisp_compile_phase1_list_of_expressions(lisp_vm_t            * vm,
   return LISP_OK;
 }
 
+/* size of the code that pushes the value of arg */
+static int _lisp_compile_phase1_arg(lisp_vm_t            * vm,
+                                    lisp_compile_state_t * state,
+                                    const lisp_cell_t    * arg)
+{
+  lisp_form_t * form;
+  lisp_size_t   form_size = 0;
+  int           ret;
+  if(LISP_IS_SYMBOL(arg)) 
+  {
+    /* LDVR S; PUSHV */
+    state->instr_size += LISP_SIZ_LDVR + LISP_SIZ_PUSHV;
+  }
+  else if(LISP_IS_CONS(arg)) 
+  {
+    if((form = _lisp_compile_form(vm, arg)) != NULL) 
+    {
+      /* CALL 0, L; PUSHV, the form is compiled to its own lambda L 
+         because its code ends with RET */
+      if((ret = form->phase1(vm, &form_size, arg)) != LISP_OK) 
+      {
+        return ret;
+      }
+      state->instr_size += LISP_SIZ_CALL + LISP_SIZ_PUSHV;
+    }
+    else 
+    {
+      /* call; PUSHV */
+      if((ret = _lisp_compile_phase1_call(vm, state, arg, 0)) != LISP_OK) 
+      {
+        return ret;
+      }
+      state->instr_size += LISP_SIZ_PUSHV;
+    }
+  }
+  else 
+  {
+    /* PUSHD D */
+    state->instr_size += LISP_SIZ_PUSHD;
+  }
+  return LISP_OK;
+}
+
 /****************************************************************************/
 static int _lisp_compile_phase2(lisp_vm_t         * vm,
                                 lisp_cell_t       * cell,
@@ -192,49 +344,93 @@ static int _lisp_compile_phase2(lisp_vm_t         * vm,
   }
   else if(LISP_IS_CONS(expr)) 
   {
-    if(LISP_IS_LAMBDA(LISP_CAR(expr)))
+    lisp_form_t * form = _lisp_compile_form(vm, expr);
+    if(form != NULL) 
     {
-      lisp_size_t n;
-      int ret = _lisp_compile_phase2_list_of_expressions(vm,
-                                                         cell,
-                                                         &instr,
-                                                         &n,
-                                                         LISP_CDR(expr));
-      if(ret == LISP_OK) 
-      {
-        LISP_SET_INSTR_2(LISP_ASM_JP, instr,
-                         lisp_size_t, n,
-                         lisp_lambda_t*,
-                         LISP_AS(LISP_CAR(expr), lisp_lambda_t));
-        return _lisp_compile_prepend_data(vm, cell, expr);
-      }
-      else 
-      {
-        return ret;
-      }
+      return form->phase2(vm, cell, instr ,expr);
     }
-    else if(LISP_IS_SYMBOL(LISP_CAR(expr)))
+    return _lisp_compile_phase2_call(vm, cell, &instr, expr, 1);
+  }
+  else 
+  {
+    return LISP_UNSUPPORTED;
+  }
+}
+
+/* Arguments and call of expr, a tail call ends the lambda:
+   (L A B) with a fixnum instruction:  A; B; op (RET)
+   (S A B) with a fixnum instruction:  A; B; FIXR S; op (RET)
+   (L A B)                             A; B; CALL 2, L  (JP 2, L)
+   (S A B)                             A; B; CALLR 2, S (JPR 2, S)
+   ((F) A B)                           (F); PUSHV; A; B; CALLV 2 (JPV 2)
+ */
+static int _lisp_compile_phase2_call(lisp_vm_t           * vm,
+                                     lisp_cell_t         * cell,
+                                     lisp_instr_t       ** instr,
+                                     const lisp_cell_t   * expr,
+                                     int                   tail)
+{
+  lisp_size_t  n;
+  lisp_instr_t op  = _lisp_compile_fixnum_instr(vm, expr);
+  int          ret = LISP_OK;
+  if(LISP_IS_CONS(LISP_CAR(expr))) 
+  {
+    ret = _lisp_compile_phase2_arg(vm, cell, instr, LISP_CAR(expr));
+  }
+  if(ret == LISP_OK) 
+  {
+    ret = _lisp_compile_phase2_list_of_expressions(vm,
+                                                   cell,
+                                                   instr,
+                                                   &n,
+                                                   LISP_CDR(expr));
+  }
+  if(ret != LISP_OK) 
+  {
+    return ret;
+  }
+  if(op != 0) 
+  {
+    if(LISP_IS_SYMBOL(LISP_CAR(expr))) 
     {
-      lisp_cell_t * value = lisp_symbol_get(vm,
-                                            LISP_AS(LISP_CAR(expr),
-                                                    lisp_symbol_t));
-      if(value && LISP_IS_FORM(value)) 
-      {
-        return LISP_AS(value, lisp_form_t)->phase2(vm, cell, instr ,expr);
-      }
-      else 
-      {
-        return LISP_UNSUPPORTED;
-      }
+      LISP_SET_INSTR(LISP_ASM_FIXR, *instr, lisp_cell_t, *LISP_CAR(expr));
+      *instr+= LISP_SIZ_FIXR;
+      ret = _lisp_compile_prepend_data(vm, cell, LISP_CAR(expr));
     }
-    else 
+    *(*instr)++ = op;
+    if(tail) 
     {
-      /* @todo */
-      return LISP_UNSUPPORTED;
+      *(*instr)++ = LISP_ASM_RET;
     }
+    return ret;
+  }
+  else if(LISP_IS_LAMBDA(LISP_CAR(expr))) 
+  {
+    LISP_SET_INSTR_2((tail ? LISP_ASM_JP : LISP_ASM_CALL), *instr,
+                     lisp_size_t, n,
+                     lisp_lambda_t*,
+                     LISP_AS(LISP_CAR(expr), lisp_lambda_t));
+    *instr+= (tail ? LISP_SIZ_JP : LISP_SIZ_CALL);
+    return _lisp_compile_prepend_data(vm, cell, LISP_CAR(expr));
+  }
+  else if(LISP_IS_SYMBOL(LISP_CAR(expr))) 
+  {
+    LISP_SET_INSTR_2((tail ? LISP_ASM_JPR : LISP_ASM_CALLR), *instr,
+                     lisp_size_t, n,
+                     lisp_cell_t, *LISP_CAR(expr));
+    *instr+= (tail ? LISP_SIZ_JPR : LISP_SIZ_CALLR);
+    return _lisp_compile_prepend_data(vm, cell, LISP_CAR(expr));
+  }
+  else if(LISP_IS_CONS(LISP_CAR(expr))) 
+  {
+    LISP_SET_INSTR((tail ? LISP_ASM_JPV : LISP_ASM_CALLV), *instr,
+                   lisp_size_t, n);
+    *instr+= (tail ? LISP_SIZ_JPV : LISP_SIZ_CALLV);
+    return LISP_OK;
   }
   else 
   {
+    /* @todo */
     return LISP_UNSUPPORTED;
   }
 }
@@ -245,23 +441,18 @@ static int _lisp_compile_phase2_list_of_expressions(lisp_vm_t           * vm,
                                                     lisp_size_t         * n_expr,
                                                     const lisp_cell_t   * rest)
 {
+  int ret;
   *n_expr = 0;
   while(!LISP_IS_NIL(rest)) 
   {
     if(LISP_IS_CONS(rest)) 
     {
-      if(LISP_IS_ATOM(LISP_CAR(rest))) 
-      {
-        /* @todo implement */
-        /* PUSHD D */
-        LISP_SET_INSTR(LISP_ASM_PUSHD, *instr, lisp_cell_t, *LISP_CAR(rest));
-        (*instr)+= LISP_SIZ_PUSHD;    
-        (*n_expr)++;
-      }
-      else 
+      if((ret = _lisp_compile_phase2_arg(vm, cell, instr, LISP_CAR(rest))) 
+         != LISP_OK) 
       {
-        /* @todo implement */
+        return ret;
       }
+      (*n_expr)++;
       rest = LISP_CDR(rest);
     }
     else
@@ -273,6 +464,60 @@ static int _lisp_compile_phase2_list_of_expressions(lisp_vm_t           * vm,
   return LISP_OK;
 }
 
+static int _lisp_compile_phase2_arg(lisp_vm_t           * vm,
+                                    lisp_cell_t         * cell,
+                                    lisp_instr_t       ** instr,
+                                    const lisp_cell_t   * arg)
+{
+  lisp_cell_t form_lambda;
+  int         ret = LISP_OK;
+  if(LISP_IS_SYMBOL(arg)) 
+  {
+    /* LDVR S
+       PUSHV
+    */
+    LISP_SET_INSTR(LISP_ASM_LDVR, *instr, lisp_cell_t, *arg);
+    (*instr)+= LISP_SIZ_LDVR;
+    *(*instr)++ = LISP_ASM_PUSHV;
+    ret = _lisp_compile_prepend_data(vm, cell, arg);
+  }
+  else if(LISP_IS_CONS(arg) && _lisp_compile_form(vm, arg) != NULL) 
+  {
+    /* CALL 0, L
+       PUSHV
+    */
+    if((ret = _lisp_lambda_compile(vm, &form_lambda, arg)) != LISP_OK) 
+    {
+      return ret;
+    }
+    LISP_SET_INSTR_2(LISP_ASM_CALL, *instr,
+                     lisp_size_t, 0,
+                     lisp_lambda_t*, LISP_AS(&form_lambda, lisp_lambda_t));
+    *instr+= LISP_SIZ_CALL;
+    *(*instr)++ = LISP_ASM_PUSHV;
+    ret = _lisp_compile_prepend_data(vm, cell, &form_lambda);
+  }
+  else if(LISP_IS_CONS(arg)) 
+  {
+    /* call
+       PUSHV
+    */
+    ret = _lisp_compile_phase2_call(vm, cell, instr, arg, 0);
+    *(*instr)++ = LISP_ASM_PUSHV;
+  }
+  else 
+  {
+    /* PUSHD D */
+    LISP_SET_INSTR(LISP_ASM_PUSHD, *instr, lisp_cell_t, *arg);
+    (*instr)+= LISP_SIZ_PUSHD;    
+    if(!LISP_IS_ATOM(arg)) 
+    {
+      ret = _lisp_compile_prepend_data(vm, cell, arg);
+    }
+  }
+  return ret;
+}
+
 static int _lisp_compile_prepend_data(lisp_vm_t         * vm,
                                       lisp_cell_t * cell,
                                       const lisp_cell_t * obj) 
@@ -289,169 +534,1394 @@ static int _lisp_compile_prepend_data(lisp_vm_t         * vm,
   return LISP_OK;
 }
 
-/****************************************************************************/
-int lisp_make_builtin_lambda(lisp_vm_t               * vm,
-                             lisp_cell_t             * cell,
-                             lisp_size_t               args_size,
-                             const lisp_cell_t       * args,
-                             lisp_builtin_function_t   func)
+/****************************************************************************/
+int lisp_make_builtin_lambda(lisp_vm_t               * vm,
+                             lisp_cell_t             * cell,
+                             lisp_size_t               args_size,
+                             const lisp_cell_t       * args,
+                             lisp_builtin_function_t   func)
+{
+  /* @todo check allocation */
+  /* @todo arguments */
+  int ret;
+  lisp_instr_t * instr;
+  ret = lisp_compile_alloc(vm,
+                           cell, 
+                           &instr,
+                           LISP_SIZ_BUILTIN + LISP_SIZ_RET);
+  if(ret == LISP_OK) 
+  {
+    LISP_SET_INSTR(LISP_ASM_BUILTIN, instr, lisp_builtin_function_t, func);
+    instr+= LISP_SIZ_BUILTIN;    
+    *instr = LISP_ASM_RET;
+  }
+  return LISP_OK;
+}
+
+int lisp_make_builtin_lambda_op(lisp_vm_t               * vm,
+                                lisp_cell_t             * cell,
+                                lisp_builtin_function_t   func,
+                                lisp_instr_t              op)
+{
+  /* BUILTIN func; op
+     op is never executed, it is read by the compiler */
+  int ret;
+  lisp_instr_t * instr;
+  REQUIRE(LISP_IS_FIXNUM_INSTR(op));
+  ret = lisp_compile_alloc(vm,
+                           cell, 
+                           &instr,
+                           LISP_SIZ_BUILTIN + sizeof(lisp_instr_t));
+  if(ret == LISP_OK) 
+  {
+    LISP_SET_INSTR(LISP_ASM_BUILTIN, instr, lisp_builtin_function_t, func);
+    instr+= LISP_SIZ_BUILTIN;    
+    *instr = op;
+  }
+  return ret;
+}
+
+int lisp_make_builtin_form(struct lisp_vm_t       * vm,
+                           lisp_cell_t            * cell,
+                           lisp_compile_phase1_t    phase1,
+                           lisp_compile_phase2_t    phase2)
+{
+  lisp_form_t * form = MALLOC_VM_OBJECT(vm, sizeof(lisp_form_t), 1);
+  if(form == NULL) 
+  {
+    *cell = lisp_nil;
+    return LISP_ALLOC_ERROR;
+  }
+  cell->type_id  = LISP_TID_FORM;
+  cell->data.ptr = form;
+  form->phase1 = phase1;
+  form->phase2 = phase2;
+  return LISP_OK;
+}
+
+
+int lisp_make_builtin_c_str(lisp_vm_t                * vm,
+			    lisp_cell_t              * cell,
+			    lisp_size_t                args_size,
+			    const char              ** args,
+			    lisp_builtin_function_t    func)
+{
+  lisp_byte_code_t * lambda = MALLOC_VM_OBJECT(vm, 
+                                                sizeof(lisp_byte_code_t),
+                                                1);
+  if(lambda == NULL) 
+  {
+    *cell = lisp_nil;
+    return LISP_ALLOC_ERROR;
+  }
+  cell->type_id  = LISP_TID_FORM;
+  cell->data.ptr = lambda;
+  lambda->instr_size = 0;
+  lambda->decoded    = NULL;
+  lambda->native     = NULL;
+  lambda->n_calls    = 0;
+  return LISP_OK;
+}
+
+
+int lisp_make_builtin_lambda_opt_args(lisp_vm_t   * vm,
+				      lisp_cell_t * cell,
+				      lisp_size_t   args_size,
+				      lisp_cell_t * args,
+				      lisp_size_t   opt_args_size,
+				      lisp_cell_t * opt_args,
+				      lisp_size_t   named_args_size,
+				      lisp_cell_t * named_args,
+				      lisp_cell_t * named_args_values,
+				      int           has_rest_args,
+				      lisp_builtin_function_t  func)
+{
+  /* @todo implement */
+  return LISP_OK;
+}
+
+/* Dispatch of lisp_eval_lambda().
+   With GCC the handlers jump to the next handler through a table of 
+   label addresses (direct threading), each handler has its own 
+   indirect branch. Otherwise a switch in a loop is used. 
+   Define LISP_NO_THREADED_DISPATCH to force the switch. */
+#if defined(__GNUC__) && !defined(LISP_NO_THREADED_DISPATCH)
+#define LISP_THREADED_DISPATCH
+#endif
+
+#ifdef LISP_THREADED_DISPATCH
+#define LISP_OP(__OP__)      _lisp_op_##__OP__
+#define LISP_OP_DEFAULT      _lisp_op_default
+#define LISP_NEXT            pc++; goto *ip->handler
+#define LISP_DISPATCH_TABLE                                     \
+  static const void * const dispatch[256] =                     \
+  {                                                             \
+    [0 ... 255]       = &&_lisp_op_default,                     \
+    [LISP_ASM_LDVD]    = &&_lisp_op_LDVD,                       \
+    [LISP_ASM_LDVR]    = &&_lisp_op_LDVR,                       \
+    [LISP_ASM_PUSHD]   = &&_lisp_op_PUSHD,                      \
+    [LISP_ASM_RET]     = &&_lisp_op_RET,                        \
+    [LISP_ASM_JP]      = &&_lisp_op_JP,                         \
+    [LISP_ASM_HALT]    = &&_lisp_op_HALT,                       \
+    [LISP_ASM_BUILTIN] = &&_lisp_op_BUILTIN,                    \
+    [LISP_ASM_PUSHV]   = &&_lisp_op_PUSHV,                      \
+    [LISP_ASM_CALL]    = &&_lisp_op_CALL,                       \
+    [LISP_ASM_CALLR]   = &&_lisp_op_CALLR,                      \
+    [LISP_ASM_JPR]     = &&_lisp_op_JPR,                        \
+    [LISP_ASM_FIXR]    = &&_lisp_op_FIXR,                       \
+    [LISP_ASM_CALLV]   = &&_lisp_op_CALLV,                      \
+    [LISP_ASM_JPV]     = &&_lisp_op_JPV,                        \
+    [LISP_ASM_LDVD_RET]  = &&_lisp_op_LDVD_RET,                 \
+    [LISP_ASM_LDVR_RET]  = &&_lisp_op_LDVR_RET,                 \
+    [LISP_ASM_PUSHD2]    = &&_lisp_op_PUSHD2,                   \
+    [LISP_ASM_PUSHDN_JP] = &&_lisp_op_PUSHDN_JP,                \
+    [LISP_ASM_ADD2]      = &&_lisp_op_ADD2,                     \
+    [LISP_ASM_SUB2]      = &&_lisp_op_SUB2,                     \
+    [LISP_ASM_MUL2]      = &&_lisp_op_MUL2,                     \
+    [LISP_ASM_LT2]       = &&_lisp_op_LT2,                      \
+    [LISP_ASM_RFRAME]    = &&_lisp_op_RFRAME                    \
+  }
+#define LISP_DISPATCH_BEGIN  goto *ip->handler;
+#define LISP_DISPATCH_END
+#else
+#define LISP_OP(__OP__)      case LISP_ASM_##__OP__
+#define LISP_OP_DEFAULT      default
+#define LISP_NEXT            break
+#define LISP_DISPATCH_TABLE  static const void * const * const dispatch = NULL
+#define LISP_DISPATCH_BEGIN  while(1) { switch(ip->opcode)
+#define LISP_DISPATCH_END    pc++; }
+#endif
+
+lisp_size_t lisp_instr_size(lisp_instr_t opcode)
+{
+  switch(opcode) 
+  {
+  case LISP_ASM_LDVD:    return LISP_SIZ_LDVD;
+  case LISP_ASM_LDVR:    return LISP_SIZ_LDVR;
+  case LISP_ASM_PUSHD:   return LISP_SIZ_PUSHD;
+  case LISP_ASM_RET:     return LISP_SIZ_RET;
+  case LISP_ASM_JP:      return LISP_SIZ_JP;
+  case LISP_ASM_HALT:    return LISP_SIZ_HALT;
+  case LISP_ASM_BUILTIN: return LISP_SIZ_BUILTIN;
+  case LISP_ASM_PUSHV:   return LISP_SIZ_PUSHV;
+  case LISP_ASM_CALL:    return LISP_SIZ_CALL;
+  case LISP_ASM_CALLR:   return LISP_SIZ_CALLR;
+  case LISP_ASM_JPR:     return LISP_SIZ_JPR;
+  case LISP_ASM_FIXR:    return LISP_SIZ_FIXR;
+  case LISP_ASM_CALLV:   return LISP_SIZ_CALLV;
+  case LISP_ASM_JPV:     return LISP_SIZ_JPV;
+  case LISP_ASM_RFRAME:  return LISP_SIZ_RFRAME;
+  case LISP_ASM_ADD2:    return LISP_SIZ_ADD2;
+  case LISP_ASM_SUB2:    return LISP_SIZ_SUB2;
+  case LISP_ASM_MUL2:    return LISP_SIZ_MUL2;
+  case LISP_ASM_LT2:     return LISP_SIZ_LT2;
+  default:               return 0;
+  }
+}
+
+/* Peephole pass over decoded instructions: replace common sequences 
+   by superinstructions. The array only shrinks, the fused slot keeps 
+   the offset of the first instruction. */
+static void _lisp_fuse_decoded_instr(lisp_decoded_instr_t * ip,
+                                     const void * const   * dispatch)
+{
+  lisp_decoded_instr_t * out = ip;
+  lisp_decoded_instr_t   jp;
+  lisp_size_t            n, k;
+  while(1) 
+  {
+    if((ip[0].opcode == LISP_ASM_LDVD || ip[0].opcode == LISP_ASM_LDVR) &&
+       ip[1].opcode == LISP_ASM_RET)
+    {
+      *out        = ip[0];
+      out->opcode = (ip[0].opcode == LISP_ASM_LDVD ? 
+                     LISP_ASM_LDVD_RET : 
+                     LISP_ASM_LDVR_RET);
+      ip+= 2;
+    }
+    else if(ip[0].opcode == LISP_ASM_PUSHD)
+    {
+      for(n = 1; ip[n].opcode == LISP_ASM_PUSHD; n++);
+      if(ip[n].opcode == LISP_ASM_JP) 
+      {
+        /* head followed by the cells, out may overlap ip */
+        jp        = ip[n];
+        jp.offset = ip[0].offset;
+        memmove(out + 1, ip, n * sizeof(lisp_decoded_instr_t));
+        for(k = 1; k <= n; k++) 
+        {
+          out[k].offset = jp.offset;
+        }
+        out[0]                = jp;
+        out[0].opcode         = LISP_ASM_PUSHDN_JP;
+        out[0].arg.jp.n_push  = n;
+        out[0].handler        = (dispatch != NULL ? 
+                                 dispatch[LISP_ASM_PUSHDN_JP] : NULL);
+        out+= n;
+        ip+= n + 1;
+      }
+      else if(n >= 2) 
+      {
+        lisp_cell_t second  = ip[1].arg.cell;
+        *out                = ip[0];
+        out->opcode         = LISP_ASM_PUSHD2;
+        out->arg.cells[1]   = second;
+        ip+= 2;
+      }
+      else 
+      {
+        *out = *ip++;
+      }
+    }
+    else 
+    {
+      *out = *ip++;
+    }
+    out->handler = (dispatch != NULL ? dispatch[out->opcode] : NULL);
+    if(out->opcode == 0) 
+    {
+      break;
+    }
+    out++;
+  }
+}
+
+/* Decode the first instr_size bytes of byte_code into an array of 
+   aligned instructions, terminated by a slot with opcode 0.
+   Decoding stops after the first unknown opcode. */
+static lisp_decoded_instr_t * 
+_lisp_decode_instrs(lisp_vm_t              * vm,
+                    const lisp_byte_code_t * byte_code,
+                    lisp_size_t              instr_size,
+                    const void * const     * dispatch)
+{
+  const lisp_instr_t   * start = (const lisp_instr_t*) &byte_code[1];
+  const lisp_instr_t   * end   = start + instr_size;
+  const lisp_instr_t   * instr;
+  lisp_size_t            size;
+  lisp_size_t            n = 0;
+  lisp_decoded_instr_t * decoded;
+  lisp_decoded_instr_t * ip;
+  for(instr = start; instr < end; instr+= size) 
+  {
+    n++;
+    if((size = lisp_instr_size(*instr)) == 0) 
+    {
+      break;
+    }
+  }
+  decoded = MALLOC_VM_OBJECT(vm, sizeof(lisp_decoded_instr_t) * (n + 1), 1);
+  if(decoded == NULL) 
+  {
+    return NULL;
+  }
+  for(instr = start, ip = decoded; n; instr+= size, ip++, n--) 
+  {
+    size        = lisp_instr_size(*instr);
+    ip->opcode  = *instr;
+    ip->fixnum  = 0;
+    ip->offset  = instr - start;
+    ip->handler = (dispatch != NULL ? dispatch[*instr] : NULL);
+    switch(*instr) 
+    {
+    case LISP_ASM_LDVD:
+    case LISP_ASM_PUSHD:
+      memcpy(&ip->arg.cell, 
+             LISP_INSTR_ARG(instr, lisp_cell_t),
+             sizeof(lisp_cell_t));
+      break;
+    case LISP_ASM_LDVR:
+      memcpy(&ip->arg.ldvr.symbol, 
+             LISP_INSTR_ARG(instr, lisp_cell_t),
+             sizeof(lisp_cell_t));
+      ip->arg.ldvr.binding = NULL;
+      ip->arg.ldvr.epoch   = 0;
+      break;
+    case LISP_ASM_BUILTIN:
+      memcpy(&ip->arg.builtin, 
+             LISP_INSTR_ARG(instr, lisp_builtin_function_t),
+             sizeof(lisp_builtin_function_t));
+      break;
+    case LISP_ASM_CALLR:
+    case LISP_ASM_JPR:
+      memcpy(&ip->arg.ldvr.nargs, 
+             LISP_INSTR_ARG(instr, lisp_size_t),
+             sizeof(lisp_size_t));
+      memcpy(&ip->arg.ldvr.symbol, 
+             LISP_INSTR_ARG_2(instr, lisp_size_t, lisp_cell_t),
+             sizeof(lisp_cell_t));
+      ip->arg.ldvr.binding = NULL;
+      ip->arg.ldvr.epoch   = 0;
+      break;
+    case LISP_ASM_FIXR:
+      memcpy(&ip->arg.ldvr.symbol, 
+             LISP_INSTR_ARG(instr, lisp_cell_t),
+             sizeof(lisp_cell_t));
+      ip->arg.ldvr.binding = NULL;
+      ip->arg.ldvr.epoch   = 0;
+      ip->arg.ldvr.nargs   = 2;
+      break;
+    case LISP_ASM_JP:
+    case LISP_ASM_CALL:
+      memcpy(&ip->arg.jp.nargs, 
+             LISP_INSTR_ARG(instr, lisp_size_t),
+             sizeof(lisp_size_t));
+      memcpy(&ip->arg.jp.lambda, 
+             LISP_INSTR_ARG_2(instr, lisp_size_t, lisp_lambda_t*),
+             sizeof(lisp_lambda_t*));
+      break;
+    case LISP_ASM_CALLV:
+    case LISP_ASM_JPV:
+      memcpy(&ip->arg.jp.nargs, 
+             LISP_INSTR_ARG(instr, lisp_size_t),
+             sizeof(lisp_size_t));
+      ip->arg.jp.lambda = NULL;
+      break;
+    }
+  }
+  ip->opcode  = 0;
+  ip->offset  = instr_size;
+  ip->handler = (dispatch != NULL ? dispatch[0] : NULL);
+  return decoded;
+}
+
+/* byte_code->decoded, with superinstructions */
+static int _lisp_decode_byte_code(lisp_vm_t          * vm,
+                                  lisp_byte_code_t   * byte_code,
+                                  const void * const * dispatch)
+{
+  byte_code->decoded = _lisp_decode_instrs(vm, 
+                                           byte_code,
+                                           byte_code->instr_size,
+                                           dispatch);
+  if(byte_code->decoded == NULL) 
+  {
+    return LISP_ALLOC_ERROR;
+  }
+  _lisp_fuse_decoded_instr(byte_code->decoded, dispatch);
+  return LISP_OK;
+}
+
+/* decoded instruction of lambda at instr */
+static inline lisp_decoded_instr_t * 
+_lisp_decoded_instr(lisp_vm_t          * vm,
+                    lisp_lambda_t      * lambda,
+                    const lisp_instr_t * instr,
+                    const void * const * dispatch)
+{
+  lisp_byte_code_t     * byte_code = LISP_AS(&lambda->car, lisp_byte_code_t);
+  lisp_decoded_instr_t * ip;
+  lisp_size_t            offset;
+  if(byte_code->decoded == NULL && 
+     _lisp_decode_byte_code(vm, byte_code, dispatch)) 
+  {
+    return NULL;
+  }
+  ip     = byte_code->decoded;
+  offset = instr - (const lisp_instr_t*) &byte_code[1];
+  while(ip->offset < offset && ip->opcode != 0) 
+  {
+    ip++;
+  }
+  return ip;
+}
+
+/* value of the symbol of LDVR, NULL if it is undefined */
+static inline lisp_cell_t * _lisp_ldvr_binding(lisp_vm_t            * vm,
+                                               lisp_decoded_instr_t * ip)
+{
+  if(ip->arg.ldvr.epoch != vm->symbol_epoch) 
+  {
+    ip->arg.ldvr.binding = lisp_symbol_get(vm, 
+                                           LISP_AS(&ip->arg.ldvr.symbol,
+                                                   lisp_symbol_t));
+    ip->arg.ldvr.epoch   = vm->symbol_epoch;
+  }
+  return ip->arg.ldvr.binding;
+}
+
+/* fixnum instruction of the value of the symbol of FIXR, 
+   recomputed with the binding */
+static inline lisp_instr_t _lisp_fixr_instr(lisp_vm_t            * vm,
+                                            lisp_decoded_instr_t * ip)
+{
+  lisp_cell_t * cell;
+  if(ip->arg.ldvr.epoch != vm->symbol_epoch) 
+  {
+    cell       = _lisp_ldvr_binding(vm, ip);
+    ip->fixnum = (cell != NULL ? _lisp_fixnum_instr(cell) : 0);
+  }
+  return ip->fixnum;
+}
+
+#ifdef LISP_JIT
+/* machine code of a lambda that is entered, 
+   hot lambdas are compiled */
+static inline lisp_jit_function_t _lisp_jit_entry(lisp_vm_t        * vm,
+                                                  lisp_byte_code_t * byte_code)
+{
+  if(byte_code->native == NULL && 
+     ++byte_code->n_calls == LISP_JIT_THRESHOLD) 
+  {
+    lisp_jit_compile(vm, byte_code);
+  }
+  return (lisp_jit_function_t) byte_code->native;
+}
+#endif
+
+/* pop the operands A and B of a fixnum instruction,
+   integers do not need reference counting */
+static inline int _lisp_pop_fixnums(lisp_eval_env_t * env,
+                                    lisp_integer_t  * a,
+                                    lisp_integer_t  * b)
+{
+  lisp_cell_t * top;
+  REQUIRE_GE_U(env->stack_top, 2u);
+  top = &env->stack[env->stack_top - 2];
+  env->stack_top-= 2;
+  if(LISP_IS_INTEGER(&top[0]) && LISP_IS_INTEGER(&top[1])) 
+  {
+    *a     = top[0].data.integer;
+    *b     = top[1].data.integer;
+    top[0] = lisp_nil;
+    top[1] = lisp_nil;
+    return LISP_OK;
+  }
+  lisp_unset_object_deferred(env->vm, &top[0]);
+  lisp_unset_object_deferred(env->vm, &top[1]);
+  return LISP_TYPE_ERROR;
+}
+
+/* pop the cells of env->stack above top */
+static inline void _lisp_pop_to(lisp_eval_env_t * env, lisp_size_t top)
+{
+  lisp_cell_t * cell;
+  while(env->stack_top > top) 
+  {
+    cell = &env->stack[--env->stack_top];
+    if(LISP_IS_OBJECT(cell)) 
+    {
+      lisp_unset_object_deferred(env->vm, cell);
+    }
+    else 
+    {
+      *cell = lisp_nil;
+    }
+  }
+}
+
+/* Tail call: the n_new arguments at the top of the stack replace 
+   the n_old arguments of the current lambda below them */
+static inline void _lisp_shift_args(lisp_eval_env_t * env,
+                                    lisp_size_t       n_old,
+                                    lisp_size_t       n_new)
+{
+  lisp_cell_t * args;
+  lisp_size_t   i;
+  if(n_old == 0) 
+  {
+    return;
+  }
+  REQUIRE_GE_U(env->stack_top, n_old + n_new);
+  args = &env->stack[env->stack_top - n_new - n_old];
+  for(i = 0; i < n_old; i++) 
+  {
+    if(LISP_IS_OBJECT(&args[i])) 
+    {
+      lisp_unset_object_deferred(env->vm, &args[i]);
+    }
+  }
+  memmove(args, args + n_old, n_new * sizeof(lisp_cell_t));
+  for(i = n_new; i < n_new + n_old; i++) 
+  {
+    args[i] = lisp_nil;
+  }
+  env->stack_top-= n_old;
+}
+
+/* release the values of the last evaluation */
+static inline void _lisp_clear_values(lisp_eval_env_t * env)
+{
+  lisp_size_t i;
+  for(i = 0; i < env->n_values; i++) 
+  {
+    lisp_unset_object_root(env->vm, &env->values[i]);
+  }
+  env->n_values = 0;
+}
+
+/* values <- value, value is an atom */
+static inline void _lisp_set_atom_value(lisp_eval_env_t   * env,
+                                        const lisp_cell_t * value)
+{
+  /* the previous values may be rooted conses */
+  _lisp_clear_values(env);
+  *env->values  = *value;
+  env->n_values = 1;
+}
+
+/* CALL: the callee returns to the instruction after ip in lambda, 
+   RET resumes at the decoded instruction without a search */
+static inline int _lisp_push_return(lisp_eval_env_t      * env,
+                                    lisp_lambda_t        * lambda,
+                                    lisp_size_t            nargs,
+                                    lisp_decoded_instr_t * ip)
+{
+  lisp_byte_code_t * byte_code = LISP_AS(&lambda->car, lisp_byte_code_t);
+  int                ret;
+  ret = lisp_push_call(env, 
+                       lambda, 
+                       (lisp_instr_t*) &byte_code[1] + ip[1].offset);
+  if(ret == LISP_OK) 
+  {
+    env->call_stack[env->call_stack_top - 1].nargs        = nargs;
+    env->call_stack[env->call_stack_top - 1].next_decoded = ip + 1;
+  }
+  return ret;
+}
+
+/* lambda bound to the symbol of CALLR or JPR, NULL and *ret on error */
+static inline lisp_lambda_t * _lisp_ldvr_lambda(lisp_eval_env_t      * env,
+                                                lisp_lambda_t        * lambda,
+                                                lisp_size_t            pc,
+                                                lisp_decoded_instr_t * ip,
+                                                int                  * ret)
+{
+  lisp_cell_t * cell = _lisp_ldvr_binding(env->vm, ip);
+  if(cell == NULL) 
+  {
+    lisp_raise_exception(env,
+                         LISP_UNDEFINED,
+                         lambda,
+                         pc,
+                         "Undefined symbol");
+    *ret = LISP_UNDEFINED;
+    return NULL;
+  }
+  if(!LISP_IS_LAMBDA(cell)) 
+  {
+    *ret = LISP_TYPE_ERROR;
+    return NULL;
+  }
+  return LISP_AS(cell, lisp_lambda_t);
+}
+
+/* lambda below the nargs arguments of CALLV or JPV, it is removed 
+   from the stack. NULL and *ret if the value is not a lambda. */
+static inline lisp_lambda_t * _lisp_pop_callee(lisp_eval_env_t * env,
+                                               lisp_size_t       nargs,
+                                               int             * ret)
+{
+  lisp_cell_t   * cell;
+  lisp_lambda_t * callee;
+  REQUIRE_GT_U(env->stack_top, nargs);
+  cell = &env->stack[env->stack_top - nargs - 1];
+  if(!LISP_IS_LAMBDA(cell)) 
+  {
+    *ret = LISP_TYPE_ERROR;
+    return NULL;
+  }
+  callee = LISP_AS(cell, lisp_lambda_t);
+  memmove(cell, cell + 1, nargs * sizeof(lisp_cell_t));
+  env->stack[--env->stack_top] = lisp_nil;
+  return callee;
+}
+
+/* Safe point at RET and JP: the cells in use are on env->stack, in 
+   env->values or reachable from the lambdas of the call stack and 
+   the running lambda. Lambdas of outer evaluations are held by C 
+   variables, nested evaluations do not end cycles. */
+static inline void _lisp_gc_safe_point(lisp_eval_env_t * env,
+                                       lisp_lambda_t   * lambda)
+{
+  lisp_size_t i;
+  if(env->vm->gc_cycle_pending && env->eval_depth == 1) 
+  {
+    lisp_gc_grey_cons(env->vm, lambda);
+    for(i = 0; i < env->call_stack_top; i++) 
+    {
+      if(env->call_stack[i].lambda != NULL) 
+      {
+        lisp_gc_grey_cons(env->vm, env->call_stack[i].lambda);
+      }
+    }
+    lisp_gc_safe_point(env->vm);
+  }
+}
+
+#ifdef LISP_JIT
+lisp_decoded_instr_t * _lisp_jit_decode(lisp_vm_t              * vm,
+                                        const lisp_byte_code_t * byte_code,
+                                        lisp_size_t              instr_size)
+{
+  return _lisp_decode_instrs(vm, byte_code, instr_size, NULL);
+}
+
+/* Helpers of the machine code, see lisp_jit_helper_t.
+   LDVR: the run of LDVR starting at ip */
+static int _lisp_jit_ldvr(lisp_eval_env_t      * env,
+                          lisp_lambda_t        * lambda,
+                          lisp_size_t            nargs,
+                          lisp_decoded_instr_t * ip,
+                          lisp_jit_exit_t      * exit)
+{
+  lisp_cell_t * cell;
+  for(; ip->opcode == LISP_ASM_LDVR; ip++) 
+  {
+    if((cell = _lisp_ldvr_binding(env->vm, ip)) == NULL) 
+    {
+      lisp_raise_exception(env,
+                           LISP_UNDEFINED,
+                           lambda,
+                           ip->offset,
+                           "Undefined symbol");
+      return LISP_UNDEFINED;
+    }
+    env->n_values = 1;
+    lisp_copy_object_as_root(env->vm, env->values, cell);
+  }
+  return LISP_OK;
+}
+
+static int _lisp_jit_pushv(lisp_eval_env_t      * env,
+                           lisp_lambda_t        * lambda,
+                           lisp_size_t            nargs,
+                           lisp_decoded_instr_t * ip,
+                           lisp_jit_exit_t      * exit)
+{
+  int ret = lisp_push(env, (env->n_values ? env->values : &lisp_nil));
+  _lisp_clear_values(env);
+  return ret;
+}
+
+/* values <- ip->opcode applied to the popped operands. The handlers 
+   of the interpreter are kept inline, a shared function slows down 
+   their dispatch. */
+static int _lisp_jit_fixnum(lisp_eval_env_t      * env,
+                            lisp_lambda_t        * lambda,
+                            lisp_size_t            nargs,
+                            lisp_decoded_instr_t * ip,
+                            lisp_jit_exit_t      * exit)
+{
+  lisp_integer_t a, b;
+  lisp_cell_t    result;
+  int            ret;
+  if((ret = _lisp_pop_fixnums(env, &a, &b)) != LISP_OK) 
+  {
+    return ret;
+  }
+  switch(ip->opcode) 
+  {
+  case LISP_ASM_ADD2:
+    if(__builtin_add_overflow(a, b, &a)) 
+    {
+      return LISP_RANGE_ERROR;
+    }
+    lisp_make_integer(&result, a);
+    break;
+  case LISP_ASM_SUB2:
+    if(__builtin_sub_overflow(a, b, &a)) 
+    {
+      return LISP_RANGE_ERROR;
+    }
+    lisp_make_integer(&result, a);
+    break;
+  case LISP_ASM_MUL2:
+    if(__builtin_mul_overflow(a, b, &a)) 
+    {
+      return LISP_RANGE_ERROR;
+    }
+    lisp_make_integer(&result, a);
+    break;
+  default:
+    /* LT2 */
+    if(a < b) 
+    {
+      lisp_make_integer(&result, 1);
+    }
+    else 
+    {
+      result = lisp_nil;
+    }
+    break;
+  }
+  _lisp_set_atom_value(env, &result);
+  return LISP_OK;
+}
+
+/* call of callee, returning to the byte code at next */
+static inline int _lisp_jit_call_exit(lisp_eval_env_t      * env,
+                                      lisp_lambda_t        * lambda,
+                                      lisp_size_t            nargs,
+                                      lisp_decoded_instr_t * next,
+                                      lisp_lambda_t        * callee,
+                                      lisp_jit_exit_t      * exit)
+{
+  lisp_byte_code_t * byte_code = LISP_AS(&lambda->car, lisp_byte_code_t);
+  int                ret;
+  ret = lisp_push_call(env, 
+                       lambda,
+                       (lisp_instr_t*) &byte_code[1] + next->offset);
+  if(ret != LISP_OK) 
+  {
+    return ret;
+  }
+  env->call_stack[env->call_stack_top - 1].nargs = nargs;
+  exit->lambda = callee;
+  return LISP_JIT_CALL;
+}
+
+/* FIXR S; op */
+static int _lisp_jit_fixr(lisp_eval_env_t      * env,
+                          lisp_lambda_t        * lambda,
+                          lisp_size_t            nargs,
+                          lisp_decoded_instr_t * ip,
+                          lisp_jit_exit_t      * exit)
+{
+  lisp_lambda_t * callee;
+  int             ret = LISP_OK;
+  if(_lisp_fixr_instr(env->vm, ip) == ip[1].opcode) 
+  {
+    return _lisp_jit_fixnum(env, lambda, nargs, ip + 1, exit);
+  }
+  /* rebound, return after the fixnum instruction */
+  if((callee = _lisp_ldvr_lambda(env, lambda, ip->offset, ip, &ret)) == NULL)
+  {
+    return ret;
+  }
+  exit->nargs = ip->arg.ldvr.nargs;
+  return _lisp_jit_call_exit(env, lambda, nargs, ip + 2, callee, exit);
+}
+
+static int _lisp_jit_call(lisp_eval_env_t      * env,
+                          lisp_lambda_t        * lambda,
+                          lisp_size_t            nargs,
+                          lisp_decoded_instr_t * ip,
+                          lisp_jit_exit_t      * exit)
+{
+  lisp_lambda_t * callee;
+  int             ret = LISP_OK;
+  if(ip->opcode == LISP_ASM_CALLR) 
+  {
+    callee      = _lisp_ldvr_lambda(env, lambda, ip->offset, ip, &ret);
+    exit->nargs = ip->arg.ldvr.nargs;
+  }
+  else 
+  {
+    callee      = (ip->opcode == LISP_ASM_CALL ?
+                   ip->arg.jp.lambda :
+                   _lisp_pop_callee(env, ip->arg.jp.nargs, &ret));
+    exit->nargs = ip->arg.jp.nargs;
+  }
+  if(callee == NULL) 
+  {
+    return ret;
+  }
+  return _lisp_jit_call_exit(env, lambda, nargs, ip + 1, callee, exit);
+}
+
+/* JPR and JPV, the interpreter replaces the arguments */
+static int _lisp_jit_jp(lisp_eval_env_t      * env,
+                        lisp_lambda_t        * lambda,
+                        lisp_size_t            nargs,
+                        lisp_decoded_instr_t * ip,
+                        lisp_jit_exit_t      * exit)
+{
+  lisp_lambda_t * callee;
+  int             ret = LISP_OK;
+  if(ip->opcode == LISP_ASM_JPR) 
+  {
+    callee      = _lisp_ldvr_lambda(env, lambda, ip->offset, ip, &ret);
+    exit->nargs = ip->arg.ldvr.nargs;
+  }
+  else 
+  {
+    callee      = _lisp_pop_callee(env, ip->arg.jp.nargs, &ret);
+    exit->nargs = ip->arg.jp.nargs;
+  }
+  if(callee == NULL) 
+  {
+    return ret;
+  }
+  exit->lambda = callee;
+  return LISP_JIT_JP;
+}
+
+lisp_jit_helper_t _lisp_jit_helper(lisp_instr_t opcode)
+{
+  switch(opcode) 
+  {
+  case LISP_ASM_LDVR:  return _lisp_jit_ldvr;
+  case LISP_ASM_PUSHV: return _lisp_jit_pushv;
+  case LISP_ASM_FIXR:  return _lisp_jit_fixr;
+  case LISP_ASM_CALL:
+  case LISP_ASM_CALLR:
+  case LISP_ASM_CALLV: return _lisp_jit_call;
+  case LISP_ASM_JPR:
+  case LISP_ASM_JPV:   return _lisp_jit_jp;
+  default:             return (LISP_IS_FIXNUM_INSTR(opcode) ? 
+                               _lisp_jit_fixnum : NULL);
+  }
+}
+#endif
+
+/* Evaluate lambda. The call stack entries above call_base are returns 
+   of CALL instructions, a callee that ends with a builtin or register 
+   code resumes at the top entry. */
+static int _lisp_eval_lambda(lisp_eval_env_t    * env,
+                             lisp_lambda_t      * lambda,
+                             lisp_size_t          nargs,
+                             lisp_size_t          call_base)
+{
+  /* @todo: define argument signature class
+     @todo: eval instead of copy 
+     @todo: use stack instead of rest 
+     @todo: remove arguments from stack after calling function
+     @todo: create function to match rest with function signature
+  */
+  LISP_DISPATCH_TABLE;
+  lisp_size_t            i;
+  int                    ret = LISP_OK;
+  lisp_decoded_instr_t * ip;
+  lisp_byte_code_t     * byte_code;
+  lisp_cell_t          * cell;
+  lisp_integer_t         a, b;
+  lisp_cell_t            result;
+  lisp_lambda_t        * callee;
+  lisp_size_t            pc = 0;
+#ifdef LISP_JIT
+  lisp_jit_exit_t        jit_exit;
+#endif
+  _lisp_clear_values(env);
+  byte_code = LISP_AS(&lambda->car, lisp_byte_code_t);
+#ifdef LISP_JIT
+  if(_lisp_jit_entry(env->vm, byte_code) != NULL) 
+  {
+    goto _lisp_native;
+  }
+#endif
+  if(byte_code->decoded == NULL && 
+     _lisp_decode_byte_code(env->vm, byte_code, dispatch)) 
+  {
+    return LISP_ALLOC_ERROR;
+  }
+  ip = byte_code->decoded;
+  LISP_DISPATCH_BEGIN
+  {
+    LISP_OP(LDVD):
+      env->n_values = 1;
+      lisp_copy_object_as_root(env->vm,
+                               env->values,
+                               &ip->arg.cell);
+      ip++;
+      LISP_NEXT;
+    LISP_OP(LDVR):
+    _lisp_ldvr:
+      env->n_values = 1;
+      REQUIRE(LISP_IS_SYMBOL(&ip->arg.ldvr.symbol));
+      cell = _lisp_ldvr_binding(env->vm, ip);
+      if(cell != NULL) 
+      {
+	lisp_copy_object_as_root(env->vm, env->values, cell);
+      }
+      else 
+      {
+	lisp_raise_exception(env,
+                             LISP_UNDEFINED,
+                             NULL,
+                             pc,
+                             "Undefined symbol %s",
+                             "xxx");
+	return LISP_UNDEFINED;
+      }
+      ip++;
+      LISP_NEXT;
+    LISP_OP(BUILTIN):
+      /*@todo stack */
+      ret = (*ip->arg.builtin)(env, lambda, nargs);
+      while(nargs)
+      {
+        lisp_unset_object_deferred(env->vm, 
+                                   &env->stack[--env->stack_top]);
+        --nargs;
+      }
+    _lisp_callee_return:
+      /* the arguments are popped, resume after the CALL */
+      if(ret != LISP_OK || env->call_stack_top == call_base) 
+      {
+        return ret;
+      }
+      goto _lisp_ret;
+    LISP_OP(LDVR_RET):
+      cell = _lisp_ldvr_binding(env->vm, ip);
+      if(cell == NULL) 
+      {
+        /* raise the exception of LDVR */
+        goto _lisp_ldvr;
+      }
+      env->n_values = 1;
+      lisp_copy_object_as_root(env->vm, env->values, cell);
+      goto _lisp_ret;
+    LISP_OP(LDVD_RET):
+      env->n_values = 1;
+      lisp_copy_object_as_root(env->vm,
+                               env->values,
+                               &ip->arg.cell);
+      /* fall through */
+    LISP_OP(RET):
+    _lisp_ret:
+      REQUIRE_GT_U(env->call_stack_top, 0u);
+      _lisp_gc_safe_point(env, lambda);
+      /* release the arguments, 
+         the caller gets its own arguments back */
+      REQUIRE_GE_U(env->stack_top, nargs);
+      _lisp_pop_to(env, env->stack_top - nargs);
+      env->call_stack_top--;
+      nargs  = env->call_stack[env->call_stack_top].nargs;
+      lambda = env->call_stack[env->call_stack_top].lambda;
+      ip     = env->call_stack[env->call_stack_top].next_decoded;
+      if(ip != NULL) 
+      {
+        LISP_NEXT;
+      }
+      /* pushed by lisp_push_call() */
+      ip = _lisp_decoded_instr(env->vm, 
+                               lambda,
+                               env->call_stack[env->call_stack_top].next_instr,
+                               dispatch);
+      if(ip == NULL) 
+      {
+        return LISP_ALLOC_ERROR;
+      }
+      LISP_NEXT;
+    LISP_OP(PUSHDN_JP):
+      for(i = 1; i <= ip->arg.jp.n_push; i++) 
+      {
+        if((ret = lisp_push(env, &ip[i].arg.cell)) != LISP_OK) 
+        {
+          return ret;
+        }
+      }
+      /* fall through */
+    LISP_OP(JP):
+      _lisp_shift_args(env, nargs, ip->arg.jp.nargs);
+      nargs  = ip->arg.jp.nargs;
+      lambda = ip->arg.jp.lambda;
+      goto _lisp_jp;
+    LISP_OP(JPR):
+      if((callee = _lisp_ldvr_lambda(env, lambda, pc, ip, &ret)) == NULL) 
+      {
+        return ret;
+      }
+      _lisp_shift_args(env, nargs, ip->arg.ldvr.nargs);
+      nargs  = ip->arg.ldvr.nargs;
+      lambda = callee;
+      goto _lisp_jp;
+    LISP_OP(JPV):
+      if((callee = _lisp_pop_callee(env, ip->arg.jp.nargs, &ret)) == NULL) 
+      {
+        return ret;
+      }
+      _lisp_shift_args(env, nargs, ip->arg.jp.nargs);
+      nargs  = ip->arg.jp.nargs;
+      lambda = callee;
+      goto _lisp_jp;
+    LISP_OP(CALL):
+      if((ret = _lisp_push_return(env, lambda, nargs, ip)) != LISP_OK) 
+      {
+        return ret;
+      }
+      nargs  = ip->arg.jp.nargs;
+      lambda = ip->arg.jp.lambda;
+      goto _lisp_jp;
+    LISP_OP(CALLV):
+      if((callee = _lisp_pop_callee(env, ip->arg.jp.nargs, &ret)) == NULL ||
+         (ret = _lisp_push_return(env, lambda, nargs, ip)) != LISP_OK) 
+      {
+        return ret;
+      }
+      nargs  = ip->arg.jp.nargs;
+      lambda = callee;
+      goto _lisp_jp;
+    LISP_OP(FIXR):
+      if(_lisp_fixr_instr(env->vm, ip) == ip[1].opcode) 
+      {
+        ip++;
+        LISP_NEXT;
+      }
+      /* the symbol has been rebound, call it and return after the 
+         fixnum instruction */
+      if((callee = _lisp_ldvr_lambda(env, lambda, pc, ip, &ret)) == NULL ||
+         (ret = _lisp_push_return(env, lambda, nargs, ip + 1)) != LISP_OK) 
+      {
+        return ret;
+      }
+      nargs  = ip->arg.ldvr.nargs;
+      lambda = callee;
+      goto _lisp_jp;
+    LISP_OP(CALLR):
+      if((callee = _lisp_ldvr_lambda(env, lambda, pc, ip, &ret)) == NULL ||
+         (ret = _lisp_push_return(env, lambda, nargs, ip)) != LISP_OK) 
+      {
+        return ret;
+      }
+      nargs  = ip->arg.ldvr.nargs;
+      lambda = callee;
+    _lisp_jp:
+      _lisp_gc_safe_point(env, lambda);
+      byte_code = LISP_AS(&lambda->car, lisp_byte_code_t);
+#ifdef LISP_JIT
+      if(_lisp_jit_entry(env->vm, byte_code) != NULL) 
+      {
+        goto _lisp_native;
+      }
+#endif
+      if(byte_code->decoded == NULL && 
+         _lisp_decode_byte_code(env->vm, byte_code, dispatch)) 
+      {
+        return LISP_ALLOC_ERROR;
+      }
+      ip = byte_code->decoded;
+      LISP_NEXT;
+    LISP_OP(PUSHD):
+      /* @todo check result and make push more efficient */
+      lisp_push(env, &ip->arg.cell);
+      //lisp_copy_object_as_root(env->vm, &env->stack[env->stack_top], LISP_INSTR_ARG(instr, lisp_cell_t));
+      //env->stack_top++;
+      ip++;
+      LISP_NEXT;
+    LISP_OP(PUSHV):
+      ret = lisp_push(env, (env->n_values ? env->values : &lisp_nil));
+      _lisp_clear_values(env);
+      if(ret != LISP_OK) 
+      {
+        return ret;
+      }
+      ip++;
+      LISP_NEXT;
+    LISP_OP(PUSHD2):
+      if((ret = lisp_push(env, &ip->arg.cells[0])) != LISP_OK || 
+         (ret = lisp_push(env, &ip->arg.cells[1])) != LISP_OK) 
+      {
+        return ret;
+      }
+      ip++;
+      LISP_NEXT;
+    LISP_OP(ADD2):
+      if((ret = _lisp_pop_fixnums(env, &a, &b)) != LISP_OK) 
+      {
+        return ret;
+      }
+      if(__builtin_add_overflow(a, b, &a)) 
+      {
+        return LISP_RANGE_ERROR;
+      }
+      lisp_make_integer(&result, a);
+      _lisp_set_atom_value(env, &result);
+      ip++;
+      LISP_NEXT;
+    LISP_OP(SUB2):
+      if((ret = _lisp_pop_fixnums(env, &a, &b)) != LISP_OK) 
+      {
+        return ret;
+      }
+      if(__builtin_sub_overflow(a, b, &a)) 
+      {
+        return LISP_RANGE_ERROR;
+      }
+      lisp_make_integer(&result, a);
+      _lisp_set_atom_value(env, &result);
+      ip++;
+      LISP_NEXT;
+    LISP_OP(MUL2):
+      if((ret = _lisp_pop_fixnums(env, &a, &b)) != LISP_OK) 
+      {
+        return ret;
+      }
+      if(__builtin_mul_overflow(a, b, &a)) 
+      {
+        return LISP_RANGE_ERROR;
+      }
+      lisp_make_integer(&result, a);
+      _lisp_set_atom_value(env, &result);
+      ip++;
+      LISP_NEXT;
+    LISP_OP(LT2):
+      if((ret = _lisp_pop_fixnums(env, &a, &b)) != LISP_OK) 
+      {
+        return ret;
+      }
+      if(a < b) 
+      {
+        lisp_make_integer(&result, 1);
+      }
+      else 
+      {
+        result = lisp_nil;
+      }
+      _lisp_set_atom_value(env, &result);
+      ip++;
+      LISP_NEXT;
+    LISP_OP(HALT):
+      return LISP_OK;
+    LISP_OP(RFRAME):
+      /* register code, the rest is not decoded */
+      ret = lisp_eval_lambda_reg(env, lambda, nargs);
+      nargs = 0;
+      goto _lisp_callee_return;
+#ifdef LISP_JIT
+    _lisp_native:
+      ret = ((lisp_jit_function_t) byte_code->native)(env, 
+                                                      lambda,
+                                                      nargs,
+                                                      &jit_exit);
+      if(ret == LISP_JIT_JP) 
+      {
+        _lisp_shift_args(env, nargs, jit_exit.nargs);
+        nargs  = jit_exit.nargs;
+        lambda = jit_exit.lambda;
+        goto _lisp_jp;
+      }
+      else if(ret == LISP_JIT_CALL) 
+      {
+        nargs  = jit_exit.nargs;
+        lambda = jit_exit.lambda;
+        goto _lisp_jp;
+      }
+      else if(ret == LISP_JIT_RET) 
+      {
+        goto _lisp_ret;
+      }
+      /* a builtin popped the arguments */
+      nargs = 0;
+      goto _lisp_callee_return;
+#endif
+    LISP_OP_DEFAULT:
+      return LISP_UNSUPPORTED;
+  }
+  LISP_DISPATCH_END
+  return LISP_UNSUPPORTED;
+}
+
+int lisp_eval_lambda(lisp_eval_env_t    * env,
+                     lisp_lambda_t      * lambda,
+                     lisp_size_t          nargs)
 {
-  /* @todo check allocation */
-  /* @todo arguments */
-  int ret;
-  lisp_instr_t * instr;
-  ret = lisp_compile_alloc(vm,
-                           cell, 
-                           &instr,
-                           LISP_SIZ_BUILTIN + LISP_SIZ_RET);
-  if(ret == LISP_OK) 
+  lisp_size_t call_base;
+  lisp_size_t stack_base;
+  int         ret;
+  REQUIRE_GT_U(env->call_stack_size, 0);
+  REQUIRE_GE_U(env->stack_top, nargs);
+  call_base  = env->call_stack_top;
+  stack_base = env->stack_top - nargs;
+  env->eval_depth++;
+  ret        = _lisp_eval_lambda(env, lambda, nargs, call_base);
+  env->eval_depth--;
+  if(ret != LISP_OK) 
   {
-    LISP_SET_INSTR(LISP_ASM_BUILTIN, instr, lisp_builtin_function_t, func);
-    instr+= LISP_SIZ_BUILTIN;    
-    *instr = LISP_ASM_RET;
+    /* drop the pending calls, the arguments and pushed values */
+    if(env->call_stack_top > call_base) 
+    {
+      env->call_stack_top = call_base;
+    }
+    _lisp_pop_to(env, stack_base);
   }
-  return LISP_OK;
+  return ret;
 }
 
-int lisp_make_builtin_form(struct lisp_vm_t       * vm,
-                           lisp_cell_t            * cell,
-                           lisp_compile_phase1_t    phase1,
-                           lisp_compile_phase2_t    phase2)
+/* replace the register reg by a copy of value, 
+   values without reference count are copied inline */
+static inline void _lisp_set_reg(lisp_vm_t         * vm,
+                                 lisp_cell_t       * reg,
+                                 const lisp_cell_t * value)
 {
-  lisp_form_t * form = MALLOC_OBJECT(sizeof(lisp_form_t), 1);
-  cell->type_id  = LISP_TID_FORM;
-  cell->data.ptr = form;
-  form->phase1 = phase1;
-  form->phase2 = phase2;
-  return LISP_OK;
+  if(reg != value) 
+  {
+    if(LISP_IS_OBJECT(reg)) 
+    {
+      lisp_unset_object(vm, reg);
+    }
+    if(LISP_IS_OBJECT(value) || LISP_IS_CONS_OBJECT(value)) 
+    {
+      lisp_copy_object_as_region_root(vm, reg, value);
+    }
+    else 
+    {
+      *reg = *value;
+    }
+  }
 }
 
-
-int lisp_make_builtin_c_str(lisp_vm_t                * vm,
-			    lisp_cell_t              * cell,
-			    lisp_size_t                args_size,
-			    const char              ** args,
-			    lisp_builtin_function_t    func)
+/* set the registers from .. to - 1 of env->stack to nil, 
+   the registers must be released */
+static inline void _lisp_clear_regs(lisp_eval_env_t * env,
+                                    lisp_size_t       from,
+                                    lisp_size_t       to)
 {
-  lisp_byte_code_t * lambda = MALLOC_OBJECT(sizeof(lisp_byte_code_t),
-					 1);
-  cell->type_id  = LISP_TID_FORM;
-  cell->data.ptr = lambda;
-  lambda->instr_size = 0;
-  return LISP_OK;
+  while(from < to) 
+  {
+    env->stack[from++] = lisp_nil;
+  }
 }
 
-
-int lisp_make_builtin_lambda_opt_args(lisp_vm_t   * vm,
-				      lisp_cell_t * cell,
-				      lisp_size_t   args_size,
-				      lisp_cell_t * args,
-				      lisp_size_t   opt_args_size,
-				      lisp_cell_t * opt_args,
-				      lisp_size_t   named_args_size,
-				      lisp_cell_t * named_args,
-				      lisp_cell_t * named_args_values,
-				      int           has_rest_args,
-				      lisp_builtin_function_t  func)
+/* Call lambda with the n registers starting at src of the frame at 
+   base with n_regs registers. The registers above the arguments hold 
+   dead temporaries, they are released and the arguments are passed 
+   in place on top of env->stack. The callee pops the arguments. */
+static int _lisp_call_reg(lisp_eval_env_t * env,
+                          lisp_lambda_t   * lambda,
+                          lisp_size_t       base,
+                          lisp_size_t       n_regs,
+                          lisp_size_t       src,
+                          lisp_size_t       n)
 {
-  /* @todo implement */
-  return LISP_OK;
+  lisp_instr_t * instr = (lisp_instr_t*) &LISP_AS(&lambda->car, 
+                                                  lisp_byte_code_t)[1];
+  lisp_size_t    call_top;
+  int            ret;
+  _lisp_pop_to(env, base + src + n);
+  if(*instr == LISP_ASM_BUILTIN) 
+  {
+    _lisp_clear_values(env);
+    ret = (*LISP_INSTR_ARG(instr, lisp_builtin_function_t))(env, 
+                                                            lambda,
+                                                            n);
+  }
+  else if(*instr == LISP_ASM_RFRAME) 
+  {
+    ret = lisp_eval_lambda_reg(env, lambda, n);
+  }
+  else 
+  {
+    /* stack code returns to a halt frame */
+    call_top = env->call_stack_top;
+    ret      = lisp_push_halt(env);
+    if(ret == LISP_OK) 
+    {
+      ret = lisp_eval_lambda(env, lambda, n);
+    }
+    env->call_stack_top = call_top;
+  }
+  _lisp_pop_to(env, base + src);
+  _lisp_clear_regs(env, base + src, base + n_regs);
+  env->stack_top = base + n_regs;
+  return ret;
 }
 
-int lisp_eval_lambda(lisp_eval_env_t    * env,
-                     lisp_lambda_t      * lambda,
-                     lisp_size_t          nargs)
+int lisp_eval_lambda_reg(lisp_eval_env_t * env,
+                         lisp_lambda_t   * lambda,
+                         lisp_size_t       nargs)
 {
-  /* @todo: define argument signature class
-     @todo: eval instead of copy 
-     @todo: use stack instead of rest 
-     @todo: remove arguments from stack after calling function
-     @todo: create function to match rest with function signature
-  */
-  lisp_size_t    i;
-  int            ret;
-  lisp_instr_t * instr;
-  lisp_cell_t  * cell;
+  lisp_instr_t * instr = (lisp_instr_t*) &LISP_AS(&lambda->car,
+                                                  lisp_byte_code_t)[1];
+  lisp_size_t    base;
+  lisp_size_t    n_regs;
   lisp_size_t    pc = 0;
-  REQUIRE_GT_U(env->call_stack_size, 0);
-  for(i = 0; i < env->n_values; i++) 
+  lisp_cell_t  * cell;
+  int            ret;
+  REQUIRE_GE_U(env->stack_top, nargs);
+  _lisp_clear_values(env);
+  base = env->stack_top - nargs;
+  if(*instr != LISP_ASM_RFRAME) 
   {
-    lisp_unset_object_root(env->vm, &env->values[i]);
+    _lisp_pop_to(env, base);
+    return LISP_UNSUPPORTED;
   }
-  env->n_values = 0;
-  instr = (lisp_instr_t*) &(LISP_AS(&lambda->car,
-                                    lisp_byte_code_t)[1]);
+  n_regs = *LISP_INSTR_ARG(instr, lisp_size_t);
+  if(nargs > n_regs) 
+  {
+    _lisp_pop_to(env, base);
+    return LISP_UNSUPPORTED;
+  }
+  while(base + n_regs > env->stack_size) 
+  {
+    /* grow the stack, the registers are cleared below */
+    env->stack_top = env->stack_size;
+    ret = lisp_push(env, &lisp_nil);
+    env->stack_top = base + nargs;
+    if(ret != LISP_OK) 
+    {
+      _lisp_pop_to(env, base);
+      return ret;
+    }
+  }
+  _lisp_clear_regs(env, base + nargs, base + n_regs);
+  env->stack_top = base + n_regs;
+  instr+= LISP_SIZ_RFRAME;
   while(1) 
   {
     switch(*instr) 
     {
-    case LISP_ASM_LDVD:
-      env->n_values = 1;
-      lisp_copy_object_as_root(env->vm,
-                               env->values,
-                               LISP_INSTR_ARG(instr, lisp_cell_t));
-      instr+= LISP_SIZ_LDVD;
+    case LISP_ASM_RMOVD:
+      _lisp_set_reg(env->vm,
+                    &env->stack[base + *LISP_INSTR_ARG_N(instr, 0, 
+                                                         lisp_size_t)],
+                    LISP_INSTR_ARG_N(instr, 1, lisp_cell_t));
+      instr+= LISP_SIZ_RMOVD;
       break;
-    case LISP_ASM_LDVR:
-      env->n_values = 1;
-      REQUIRE(LISP_IS_SYMBOL(LISP_INSTR_ARG(instr, lisp_cell_t)));
-      cell = lisp_symbol_get(env->vm, 
-                             LISP_AS(LISP_INSTR_ARG(instr, lisp_cell_t),
+    case LISP_ASM_RMOVR:
+      cell = lisp_symbol_get(env->vm,
+                             LISP_AS(LISP_INSTR_ARG_N(instr, 1, 
+                                                      lisp_cell_t),
                                      lisp_symbol_t));
-      if(cell != NULL) 
-      {
-	lisp_copy_object_as_root(env->vm, env->values, cell);
-      }
-      else 
+      if(cell == NULL) 
       {
-	lisp_raise_exception(env,
+        lisp_raise_exception(env,
                              LISP_UNDEFINED,
-                             NULL,
+                             lambda,
                              pc,
-                             "Undefined symbol %s",
-                             "xxx");
-	return LISP_UNDEFINED;
+                             "Undefined symbol");
+        _lisp_pop_to(env, base);
+        return LISP_UNDEFINED;
       }
-      instr+= LISP_SIZ_LDVR;
+      _lisp_set_reg(env->vm,
+                    &env->stack[base + *LISP_INSTR_ARG_N(instr, 0, 
+                                                         lisp_size_t)],
+                    cell);
+      instr+= LISP_SIZ_RMOVR;
       break;
-    case LISP_ASM_BUILTIN:
-      /*@todo stack */
-      ret = (*LISP_INSTR_ARG(instr, lisp_builtin_function_t))(env, lambda, nargs);
-      while(nargs)
+    case LISP_ASM_RMOV:
+      _lisp_set_reg(env->vm,
+                    &env->stack[base + *LISP_INSTR_ARG_N(instr, 0, 
+                                                         lisp_size_t)],
+                    &env->stack[base + *LISP_INSTR_ARG_N(instr, 1, 
+                                                         lisp_size_t)]);
+      instr+= LISP_SIZ_RMOV;
+      break;
+    case LISP_ASM_RCALL:
+      ret = _lisp_call_reg(env,
+                           *LISP_INSTR_ARG_N(instr, 3, lisp_lambda_t*),
+                           base,
+                           n_regs,
+                           *LISP_INSTR_ARG_N(instr, 1, lisp_size_t),
+                           *LISP_INSTR_ARG_N(instr, 2, lisp_size_t));
+      if(ret != LISP_OK) 
       {
-        lisp_unset_object_root(env->vm, &env->stack[--env->stack_top]);
-        --nargs;
+        _lisp_pop_to(env, base);
+        return ret;
       }
-      instr+= LISP_SIZ_BUILTIN;
-      return ret;
-      break;
-    case LISP_ASM_RET:
-      REQUIRE_GT_U(env->call_stack_top, 0u);
-      env->call_stack_top--;
-      instr = env->call_stack[env->call_stack_top].next_instr;
-      lambda = env->call_stack[env->call_stack_top].lambda;
-      break;
-    case LISP_ASM_JP:
-      nargs = *LISP_INSTR_ARG(instr, lisp_size_t);
-      lambda = *LISP_INSTR_ARG_2(instr, lisp_size_t, lisp_lambda_t*);
-      instr = (lisp_instr_t*) &(LISP_AS(&lambda->car,
-                                        lisp_byte_code_t)[1]);
-      break;
-    case LISP_ASM_PUSHD:
-      /* @todo check result and make push more efficient */
-      lisp_push(env, LISP_INSTR_ARG(instr, lisp_cell_t));
-      //lisp_copy_object_as_root(env->vm, &env->stack[env->stack_top], LISP_INSTR_ARG(instr, lisp_cell_t));
-      //env->stack_top++;
-      instr+= LISP_SIZ_PUSHD;
+      _lisp_set_reg(env->vm,
+                    &env->stack[base + *LISP_INSTR_ARG_N(instr, 0, 
+                                                         lisp_size_t)],
+                    (env->n_values ? env->values : &lisp_nil));
+      instr+= LISP_SIZ_RCALL;
       break;
-    case LISP_ASM_HALT:
+    case LISP_ASM_RRET:
+      _lisp_clear_values(env);
+      env->n_values = 1;
+      lisp_copy_object_as_root(env->vm,
+                               env->values,
+                               &env->stack[base + 
+                                           *LISP_INSTR_ARG(instr, 
+                                                           lisp_size_t)]);
+      _lisp_pop_to(env, base);
       return LISP_OK;
     default:
+      _lisp_pop_to(env, base);
       return LISP_UNSUPPORTED;
     }
     pc++;
   }
-  return LISP_UNSUPPORTED;
 }
 
 /****************
@@ -692,6 +2162,13 @@ int lisp_eval_lambda(lisp_eval_env_t    * env,
 int lisp_lambda_compile(lisp_eval_env_t   * env,
 			lisp_cell_t       * cell,
 			const lisp_cell_t * expr)
+{
+  return _lisp_lambda_compile(env->vm, cell, expr);
+}
+
+static int _lisp_lambda_compile(lisp_vm_t         * vm,
+                                lisp_cell_t       * cell,
+                                const lisp_cell_t * expr)
 {
   *cell = lisp_nil;
   lisp_compile_state_t state;
@@ -699,7 +2176,7 @@ int lisp_lambda_compile(lisp_eval_env_t   * env,
   lisp_byte_code_t * byte_code;
 
   state.instr_size = 0;
-  ret = _lisp_compile_phase1(env->vm,
+  ret = _lisp_compile_phase1(vm,
                              &state,
                              expr);
   if(ret != LISP_OK) 
@@ -709,30 +2186,197 @@ int lisp_lambda_compile(lisp_eval_env_t   * env,
     return ret;
   }
   /* @todo check ret */
-  /* @todo check allocation */
   /* @todo remove halt */
-  byte_code = MALLOC_OBJECT(sizeof(lisp_byte_code_t) + 
-                            state.instr_size,
-                            1);
+  byte_code = MALLOC_VM_OBJECT(vm,
+                               sizeof(lisp_byte_code_t) + 
+                               state.instr_size,
+                               1);
+  if(byte_code == NULL) 
+  {
+    return LISP_ALLOC_ERROR;
+  }
   byte_code->instr_size = state.instr_size;
-  lisp_make_cons_typed(env->vm, cell, LISP_TID_LAMBDA);
+  byte_code->decoded    = NULL;
+  byte_code->native     = NULL;
+  byte_code->n_calls    = 0;
+  lisp_make_cons_typed(vm, cell, LISP_TID_LAMBDA);
   LISP_CAR(cell)->type_id  = LISP_TID_OBJECT;
   LISP_CAR(cell)->data.ptr = byte_code;
-  lisp_make_cons_car_cdr(env->vm, LISP_CDR(cell), &lisp_nil, &lisp_nil);
+  lisp_make_cons_car_cdr(vm, LISP_CDR(cell), &lisp_nil, &lisp_nil);
   /*@todo check ret */
-  ret = _lisp_compile_phase2(env->vm,
+  ret = _lisp_compile_phase2(vm,
                              cell,
                              (lisp_instr_t*) &byte_code[1],
                              expr);
   if(ret != LISP_OK) 
   {
     /* @todo exception */
+    FREE_OBJECT(byte_code);
+    *LISP_CAR(cell) = lisp_nil;
+    lisp_unset_object(vm, cell);
+    *cell = lisp_nil;
+    return ret;
+  }
+  return LISP_OK;
+}
+
+/****************************************************************************
+ * Register code
+ *
+ * An expression is compiled to register dst, the registers from next
+ * are unused. The arguments of a call are compiled to consecutive 
+ * registers:
+ *
+ * (L1 A (L2 S B))
+ *
+ * start:  RFRAME 5
+ *         RMOVD  R1, A
+ *         RMOVR  R3, S
+ *         RMOVD  R4, B
+ *         RCALL  R2, R3, 2, L2
+ *         RCALL  R0, R1, 2, L1
+ *         RRET   R0
+ *
+ * With instr NULL only the size and the number of registers are 
+ * computed.
+ */
+static int _lisp_compile_reg(lisp_vm_t          * vm,
+                             lisp_cell_t        * cell,
+                             lisp_instr_t      ** instr,
+                             lisp_size_t        * instr_size,
+                             lisp_size_t        * n_regs,
+                             const lisp_cell_t  * expr,
+                             lisp_size_t          dst,
+                             lisp_size_t          next)
+{
+  const lisp_cell_t * rest;
+  lisp_size_t         n;
+  lisp_instr_t        opcode;
+  int                 ret;
+  if(next > *n_regs) 
+  {
+    *n_regs = next;
+  }
+  if(LISP_IS_NIL(expr)) 
+  {
+    return LISP_COMPILATION_ERROR;
+  }
+  else if(LISP_IS_ATOM(expr) || 
+          LISP_IS_SYMBOL(expr) || 
+          LISP_IS_OBJECT(expr)) 
+  {
+    /* RMOVD dst, expr or RMOVR dst, expr */
+    *instr_size+= LISP_SIZ_RMOVD;
+    if(instr == NULL) 
+    {
+      return LISP_OK;
+    }
+    opcode = (LISP_IS_SYMBOL(expr) ? LISP_ASM_RMOVR : LISP_ASM_RMOVD);
+    **instr = opcode;
+    *LISP_INSTR_ARG_N(*instr, 0, lisp_size_t) = dst;
+    *LISP_INSTR_ARG_N(*instr, 1, lisp_cell_t) = *expr;
+    *instr+= LISP_SIZ_RMOVD;
+    return (LISP_IS_ATOM(expr) ? 
+            LISP_OK : 
+            _lisp_compile_prepend_data(vm, cell, expr));
+  }
+  else if(LISP_IS_CONS(expr) && LISP_IS_LAMBDA(LISP_CAR(expr))) 
+  {
+    /* arguments to next ... next + n - 1
+       RCALL dst, next, n, lambda */
+    n = 0;
+    for(rest = LISP_CDR(expr); !LISP_IS_NIL(rest); rest = LISP_CDR(rest)) 
+    {
+      if(!LISP_IS_CONS(rest)) 
+      {
+        return LISP_UNSUPPORTED;
+      }
+      n++;
+    }
+    if(next + n > *n_regs) 
+    {
+      *n_regs = next + n;
+    }
+    n = 0;
+    for(rest = LISP_CDR(expr); !LISP_IS_NIL(rest); rest = LISP_CDR(rest)) 
+    {
+      ret = _lisp_compile_reg(vm, cell, instr, instr_size, n_regs,
+                              LISP_CAR(rest),
+                              next + n,
+                              next + n + 1);
+      if(ret != LISP_OK) 
+      {
+        return ret;
+      }
+      n++;
+    }
+    *instr_size+= LISP_SIZ_RCALL;
+    if(instr == NULL) 
+    {
+      return LISP_OK;
+    }
+    **instr = LISP_ASM_RCALL;
+    *LISP_INSTR_ARG_N(*instr, 0, lisp_size_t)    = dst;
+    *LISP_INSTR_ARG_N(*instr, 1, lisp_size_t)    = next;
+    *LISP_INSTR_ARG_N(*instr, 2, lisp_size_t)    = n;
+    *LISP_INSTR_ARG_N(*instr, 3, lisp_lambda_t*) = LISP_AS(LISP_CAR(expr),
+                                                          lisp_lambda_t);
+    *instr+= LISP_SIZ_RCALL;
+    return _lisp_compile_prepend_data(vm, cell, LISP_CAR(expr));
+  }
+  else 
+  {
+    /* @todo forms */
+    return LISP_UNSUPPORTED;
+  }
+}
+
+int lisp_lambda_compile_reg(lisp_eval_env_t   * env,
+                            lisp_cell_t       * cell,
+                            const lisp_cell_t * expr)
+{
+  lisp_size_t        instr_size = LISP_SIZ_RFRAME + LISP_SIZ_RRET;
+  lisp_size_t        n_regs     = 1;
+  lisp_byte_code_t * byte_code;
+  lisp_instr_t     * instr;
+  int                ret;
+  *cell = lisp_nil;
+  ret = _lisp_compile_reg(env->vm, NULL, NULL, &instr_size, &n_regs,
+                          expr, 0, 1);
+  if(ret != LISP_OK) 
+  {
+    return ret;
+  }
+  byte_code = MALLOC_VM_OBJECT(env->vm,
+                               sizeof(lisp_byte_code_t) + instr_size,
+                               1);
+  if(byte_code == NULL) 
+  {
+    return LISP_ALLOC_ERROR;
+  }
+  byte_code->instr_size = instr_size;
+  byte_code->decoded    = NULL;
+  byte_code->native     = NULL;
+  byte_code->n_calls    = 0;
+  lisp_make_cons_typed(env->vm, cell, LISP_TID_LAMBDA);
+  LISP_CAR(cell)->type_id  = LISP_TID_OBJECT;
+  LISP_CAR(cell)->data.ptr = byte_code;
+  lisp_make_cons_car_cdr(env->vm, LISP_CDR(cell), &lisp_nil, &lisp_nil);
+  instr = (lisp_instr_t*) &byte_code[1];
+  LISP_SET_INSTR(LISP_ASM_RFRAME, instr, lisp_size_t, n_regs);
+  instr+= LISP_SIZ_RFRAME;
+  instr_size = 0;
+  ret = _lisp_compile_reg(env->vm, cell, &instr, &instr_size, &n_regs,
+                          expr, 0, 1);
+  if(ret != LISP_OK) 
+  {
     FREE_OBJECT(byte_code);
     *LISP_CAR(cell) = lisp_nil;
     lisp_unset_object(env->vm, cell);
     *cell = lisp_nil;
     return ret;
   }
+  LISP_SET_INSTR(LISP_ASM_RRET, instr, lisp_size_t, 0);
   return LISP_OK;
 }
 
@@ -830,6 +2474,79 @@ int lisp_lambda_disassemble(lisp_vm_t     * vm,
                     "PUSHD");
       instr+= LISP_SIZ_HALT;
       break;
+    case LISP_ASM_PUSHV:
+      _disass_instr(vm, last, "PUSHV");
+      instr+= LISP_SIZ_PUSHV;
+      break;
+    case LISP_ASM_CALL:
+      lisp_make_integer(&tmp, *LISP_INSTR_ARG(instr, lisp_size_t));
+      _disass_instr1(vm, last, &tmp, "CALL");
+      instr+= LISP_SIZ_CALL;
+      break;
+    case LISP_ASM_CALLR:
+      lisp_make_integer(&tmp, *LISP_INSTR_ARG(instr, lisp_size_t));
+      _disass_instr1(vm, last, &tmp, "CALLR");
+      instr+= LISP_SIZ_CALLR;
+      break;
+    case LISP_ASM_JPR:
+      lisp_make_integer(&tmp, *LISP_INSTR_ARG(instr, lisp_size_t));
+      _disass_instr1(vm, last, &tmp, "JPR");
+      instr+= LISP_SIZ_JPR;
+      break;
+    case LISP_ASM_FIXR:
+      _disass_instr1(vm, last, LISP_INSTR_ARG(instr, lisp_cell_t), "FIXR");
+      instr+= LISP_SIZ_FIXR;
+      break;
+    case LISP_ASM_CALLV:
+      lisp_make_integer(&tmp, *LISP_INSTR_ARG(instr, lisp_size_t));
+      _disass_instr1(vm, last, &tmp, "CALLV");
+      instr+= LISP_SIZ_CALLV;
+      break;
+    case LISP_ASM_JPV:
+      lisp_make_integer(&tmp, *LISP_INSTR_ARG(instr, lisp_size_t));
+      _disass_instr1(vm, last, &tmp, "JPV");
+      instr+= LISP_SIZ_JPV;
+      break;
+    case LISP_ASM_ADD2:
+      _disass_instr(vm, last, "ADD2");
+      instr+= LISP_SIZ_ADD2;
+      break;
+    case LISP_ASM_SUB2:
+      _disass_instr(vm, last, "SUB2");
+      instr+= LISP_SIZ_SUB2;
+      break;
+    case LISP_ASM_MUL2:
+      _disass_instr(vm, last, "MUL2");
+      instr+= LISP_SIZ_MUL2;
+      break;
+    case LISP_ASM_LT2:
+      _disass_instr(vm, last, "LT2");
+      instr+= LISP_SIZ_LT2;
+      break;
+    case LISP_ASM_RFRAME:
+      _disass_instr(vm, last, "RFRAME");
+      instr+= LISP_SIZ_RFRAME;
+      break;
+    case LISP_ASM_RMOVD:
+      _disass_instr(vm, last, "RMOVD");
+      instr+= LISP_SIZ_RMOVD;
+      break;
+    case LISP_ASM_RMOVR:
+      _disass_instr(vm, last, "RMOVR");
+      instr+= LISP_SIZ_RMOVR;
+      break;
+    case LISP_ASM_RMOV:
+      _disass_instr(vm, last, "RMOV");
+      instr+= LISP_SIZ_RMOV;
+      break;
+    case LISP_ASM_RCALL:
+      _disass_instr(vm, last, "RCALL");
+      instr+= LISP_SIZ_RCALL;
+      break;
+    case LISP_ASM_RRET:
+      _disass_instr(vm, last, "RRET");
+      instr+= LISP_SIZ_RRET;
+      break;
     default:
       return LISP_UNSUPPORTED;
     }
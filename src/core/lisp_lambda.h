@@ -11,6 +11,14 @@ int lisp_make_builtin_lambda(struct lisp_vm_t       * vm,
                              const lisp_cell_t      * args,
                              lisp_builtin_function_t  func);
 
+/** Builtin lambda with a fixnum instruction (LISP_ASM_ADD2, ...).
+ *  Calls with two arguments are compiled to the instruction, 
+ *  other calls to func. */
+int lisp_make_builtin_lambda_op(struct lisp_vm_t       * vm,
+                                lisp_cell_t            * cell,
+                                lisp_builtin_function_t  func,
+                                lisp_instr_t             op);
+
 int lisp_make_builtin_form(struct lisp_vm_t       * vm,
                            lisp_cell_t            * cell,
                            lisp_compile_phase1_t    phase1,
@@ -42,6 +50,20 @@ int lisp_lambda_compile(lisp_eval_env_t   * env,
                         lisp_cell_t       * cell,
                         const lisp_cell_t * expr);
 
+/** Evaluate a lambda in register code (see lisp_asm.h).
+ *  The nargs arguments on top of env->stack are the first registers
+ *  of the frame, the frame is popped when the lambda returns.
+ */
+int lisp_eval_lambda_reg(lisp_eval_env_t        * env,
+                         lisp_lambda_t          * lambda,
+                         lisp_size_t              nargs);
+
+/** Compile expr to register code.
+ */
+int lisp_lambda_compile_reg(lisp_eval_env_t   * env,
+                            lisp_cell_t       * cell,
+                            const lisp_cell_t * expr);
+
 int lisp_lambda_disassemble(struct lisp_vm_t * vm,
                             lisp_cell_t * cell,
                             lisp_lambda_t * lambda);
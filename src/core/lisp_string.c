@@ -12,10 +12,10 @@ int lisp_make_string(lisp_vm_t         * vm,
                      const lisp_char_t * cstr)
 {
   size_t size = strlen(cstr);
-  lisp_string_t * str = MALLOC_OBJECT(sizeof(lisp_string_t), 1);
+  lisp_string_t * str = MALLOC_VM_OBJECT(vm, sizeof(lisp_string_t), 1);
   if(str)
   {
-    str->data  = MALLOC_OBJECT(sizeof(lisp_char_t) * (size+1), 1);
+    str->data  = MALLOC_VM_OBJECT(vm, sizeof(lisp_char_t) * (size+1), 1);
     if(str->data)
     {
       str->begin = 0;
@@ -61,8 +61,13 @@ int lisp_make_substring(lisp_vm_t           * vm,
     *target  = lisp_nil; /* @todo exception */
     return LISP_RANGE_ERROR;
   }
+  lisp_string_t * substr = MALLOC_VM_OBJECT(vm, sizeof(lisp_string_t), 1);
+  if(substr == NULL) 
+  {
+    *target  = lisp_nil;
+    return LISP_ALLOC_ERROR;
+  }
   ((lisp_ref_count_t *) str->data)[-1]++;
-  lisp_string_t * substr = MALLOC_OBJECT(sizeof(lisp_string_t), 1);
   substr->data  = str->data;
   substr->begin = a;
   substr->end   = b;
@@ -94,8 +99,21 @@ int lisp_va_sprintf(lisp_vm_t   * vm,
   va_list va2;
   va_copy(va2, va);
   size = vsnprintf(NULL, 0, fmt, va);
-  lisp_string_t * str = MALLOC_OBJECT(sizeof(lisp_string_t), 1);
-  str->data  = MALLOC_OBJECT(sizeof(lisp_char_t) * (size+1), 1);;
+  lisp_string_t * str = MALLOC_VM_OBJECT(vm, sizeof(lisp_string_t), 1);
+  if(str == NULL) 
+  {
+    va_end(va2);
+    *cell = lisp_nil;
+    return -1;
+  }
+  str->data  = MALLOC_VM_OBJECT(vm, sizeof(lisp_char_t) * (size+1), 1);
+  if(str->data == NULL) 
+  {
+    FREE_OBJECT(str);
+    va_end(va2);
+    *cell = lisp_nil;
+    return -1;
+  }
   str->begin = 0;
   str->end   = size;
   ret = vsprintf(str->data, fmt, va2);
@@ -15,10 +15,20 @@ int lisp_make_symbol(lisp_vm_t         * vm,
   uint32_t seed = 1;
   uint32_t code;
   lisp_ref_count_t * ref;
+  size_t entry_size = (sizeof(hash_table_entry_t) + sizeof(lisp_symbol_t) +
+                       sizeof(lisp_ref_count_t) + len + 1);
   murmur_hash3_x86_32 (  cstr,
                          len,
                          seed,
                          &code);
+  if(lisp_heap_limit_exceeded(vm, entry_size) &&
+     hash_table_find_func(&vm->symbols, 
+                          cstr, 
+                          code, 
+                          vm->symbols.eq_function) == NULL) 
+  {
+    return LISP_ALLOC_ERROR;
+  }
   ref = hash_table_find_or_insert_func(&vm->symbols,
                                        cstr,
                                        sizeof(lisp_symbol_t) +
@@ -31,6 +41,10 @@ int lisp_make_symbol(lisp_vm_t         * vm,
   {
     return LISP_ALLOC_ERROR;
   }
+  if(inserted) 
+  {
+    vm->mem_symbols += entry_size;
+  }
   ref[0]++;
   cell->type_id  =  LISP_TID_SYMBOL;
   cell->data.ptr = &ref[1];
@@ -134,13 +148,16 @@ int lisp_symbol_set(lisp_vm_t         * vm,
   if(LISP_IS_NIL(&symbol->binding))
   {
     lisp_make_cons_root_car_cdr(vm, &symbol->binding, obj, &lisp_nil);
+    vm->symbol_epoch++;
   }
   else 
   {
-    lisp_cons_set_car_cdr(vm, 
-			  LISP_AS(&symbol->binding, lisp_cons_t),
-			  obj,
-			  NULL);
+    lisp_cons_t * cons = LISP_AS(&symbol->binding, lisp_cons_t);
+    if(LISP_IS_LAMBDA(&cons->car) || LISP_IS_LAMBDA(obj)) 
+    {
+      vm->symbol_epoch++;
+    }
+    lisp_cons_set_car_cdr(vm, cons, obj, NULL);
   }
   return LISP_OK;
 }
@@ -168,6 +185,7 @@ int lisp_symbol_unset(lisp_vm_t * vm,
   else 
   {
     lisp_cons_t * cons = LISP_AS(&symbol->binding, lisp_cons_t);
+    vm->symbol_epoch++;
     lisp_unset_object(vm, &cons->car);
     if(LISP_IS_NIL(&cons->cdr))
     {
@@ -193,6 +211,9 @@ void lisp_symbol_destruct(lisp_vm_t * vm, void * ptr)
 {
   if(LISP_IS_NIL(& ((lisp_symbol_t*)ptr)->binding))
   {
+    vm->mem_symbols -= (sizeof(hash_table_entry_t) + sizeof(lisp_symbol_t) +
+                        sizeof(lisp_ref_count_t) + 
+                        ((lisp_symbol_t*)ptr)->size + 1);
     hash_table_remove_func(&vm->symbols,
 			   (char*)ptr + sizeof(lisp_symbol_t),
 			   ((lisp_symbol_t*)ptr)->code,
@@ -48,6 +48,11 @@ lisp_closure_t * lisp_symbol_current_closure(lisp_vm_t     * vm,
 					     lisp_symbol_t * symbol);
 
 
+/** Bind obj to symbol. 
+ *  vm->symbol_epoch is incremented if the symbol was unbound or 
+ *  if the old or the new value is a lambda (code compiled for the 
+ *  function bound to symbol is invalid), a new value of a bound 
+ *  symbol is stored in the same cell. */
 int lisp_symbol_set(lisp_vm_t         * vm,
 		    lisp_symbol_t     * symbol,
 		    const lisp_cell_t * obj);
@@ -57,6 +62,7 @@ int lisp_symbol_set(lisp_vm_t         * vm,
 lisp_cell_t * lisp_symbol_get(lisp_vm_t           * vm,
 			      const lisp_symbol_t * symbol);
 
+/** Remove the binding of symbol, increments vm->symbol_epoch */
 int lisp_symbol_unset(lisp_vm_t * vm,
 		      lisp_symbol_t * symbol);
 
@@ -7,6 +7,7 @@
 #include "core/lisp_symbol.h"
 #include "core/lisp_lambda.h"
 #include "core/lisp_exception.h"
+#include "core/lisp_jit.h"
 #include <string.h>
 
 const lisp_cell_t lisp_nil =
@@ -26,6 +27,8 @@ static int _lisp_register_cons_type(lisp_vm_t         * vm,
 
 static void _destruct_string(lisp_vm_t * vm, void * ptr);
 
+static void _destruct_byte_code(lisp_vm_t * vm, void * ptr);
+
 /*****************************************************************************
  * 
  * types
@@ -134,7 +137,7 @@ int _lisp_init_types(lisp_vm_t * vm)
   int err = 0;
   err |= _lisp_register_object_type(vm, 
                                     "OBJECT",
-                                    NULL,
+                                    _destruct_byte_code,
                                     NULL,
                                     LISP_TID_OBJECT);
 
@@ -184,6 +187,7 @@ int _lisp_init_types(lisp_vm_t * vm)
     return LISP_ALLOC_ERROR;
   }
   vm->symbols.user_data = vm;
+  vm->symbol_epoch      = 1;
   return LISP_OK;
 }
 
@@ -203,6 +207,21 @@ static void _destruct_string(lisp_vm_t * vm, void * ptr)
   FREE_OBJECT(ptr);
 }
 
+/*****************************************************************************
+ * 
+ * byte code
+ * 
+ *****************************************************************************/
+static void _destruct_byte_code(lisp_vm_t * vm, void * ptr)
+{
+  if(((lisp_byte_code_t*) ptr)->decoded != NULL) 
+  {
+    FREE_OBJECT(((lisp_byte_code_t*) ptr)->decoded);
+  }
+  lisp_jit_free((lisp_byte_code_t*) ptr);
+  FREE_OBJECT(ptr);
+}
+
 /*****************************************************************************
  * 
  * integer
@@ -2,6 +2,7 @@
 #define __LISP_TYPES_H__
 #include <stdlib.h>
 #include <stdint.h>
+#include "config.h"
 
 
 typedef size_t         lisp_size_t;
@@ -15,6 +16,18 @@ struct lisp_cons_t;
 struct lisp_vm_t;
 struct lisp_lambda_t;
 
+/* LISP_COMPACT_CELL: cells and conses are packed to 4 byte alignment.
+   A cell takes 12 instead of 16 bytes, a cons 28 instead of 40 bytes.
+   The cons index is limited to 29 bits, a cons table holds at most 
+   LISP_MAX_CONS_INDEX (2^29 - 1) conses. 
+*/
+#ifdef LISP_COMPACT_CELL
+#pragma pack(push, 4)
+#define LISP_MAX_CONS_INDEX ((lisp_size_t)0x1fffffff)
+#else
+#define LISP_MAX_CONS_INDEX ((lisp_size_t)(SIZE_MAX >> 3))
+#endif
+
 typedef struct lisp_cell_t 
 {
   lisp_type_id_t type_id;
@@ -36,12 +49,25 @@ typedef struct lisp_string_t
 
 typedef struct lisp_cons_t 
 {
+#ifdef LISP_COMPACT_CELL
+  uint32_t    is_root : 1;
+  uint32_t    gc_young : 1;
+  uint32_t    gc_remembered : 1;
+  uint32_t    gc_cons_index : 29;
+#else
   lisp_size_t is_root : 1;
-  lisp_size_t gc_cons_index : sizeof(lisp_size_t)*8 - 1;
+  lisp_size_t gc_young : 1;
+  lisp_size_t gc_remembered : 1;
+  lisp_size_t gc_cons_index : sizeof(lisp_size_t)*8 - 3;
+#endif
   lisp_cell_t car;
   lisp_cell_t cdr;
 } lisp_cons_t;
 
+#ifdef LISP_COMPACT_CELL
+#pragma pack(pop)
+#endif
+
 typedef lisp_cons_t lisp_lambda_t;
 typedef lisp_cons_t lisp_exception_t;
 
@@ -51,10 +77,17 @@ typedef struct lisp_root_cons_t
   lisp_ref_count_t   ref_count;
 } lisp_root_cons_t;
 
+struct lisp_decoded_instr_t;
+
 typedef struct lisp_call_stack_entry_t
 {
-  lisp_lambda_t * lambda;
-  lisp_instr_t  * next_instr;
+  lisp_lambda_t               * lambda;
+  lisp_instr_t                * next_instr;
+  /* decoded instruction at next_instr if known, NULL for entries 
+     of lisp_push_call() */
+  struct lisp_decoded_instr_t * next_decoded;
+  /* arguments of lambda, 0 for halt entries */
+  lisp_size_t                   nargs;
 } lisp_call_stack_entry_t;
 
 typedef struct lisp_eval_env_t
@@ -73,6 +106,11 @@ typedef struct lisp_eval_env_t
   lisp_size_t                      call_stack_top;
   lisp_size_t                      call_stack_size;
   lisp_size_t                      max_call_stack_size;
+  /* both stacks are mapped at their maximum size */
+  int                              stack_mapped;
+  /* nested lisp_eval_lambda() calls, gc safe points are only taken 
+     by the outermost one */
+  lisp_size_t                      eval_depth;
 
   lisp_cell_t                      halt_lambda;
 
@@ -111,6 +149,13 @@ typedef struct lisp_type_t
 typedef struct lisp_byte_code_t
 {
   lisp_size_t instr_size;
+  /** aligned copy of the instructions made by the first 
+   *  lisp_eval_lambda(), see lisp_asm.h */
+  struct lisp_decoded_instr_t * decoded;
+  /** machine code of lisp_jit_compile(), see lisp_jit.h */
+  void                        * native;
+  /** number of calls, the lambda is compiled at LISP_JIT_THRESHOLD */
+  lisp_size_t                   n_calls;
   //lisp_size_t data_size;
   /*@todo remove func use byte code instead */
   //lisp_builtin_function_t  func;
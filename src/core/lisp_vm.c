@@ -1,7 +1,9 @@
+#include "config.h"
 #include "lisp_vm.h"
 #include "util/xmalloc.h"
 #include "util/murmur_hash3.h"
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
@@ -10,24 +12,37 @@
 
 lisp_vm_param_t lisp_vm_default_param = 
 {
-  1024, 1024 
+  1024, 1024, 0, 0, LISP_CONS_PAGE_SIZE, 0, 0, 0, 0, 0, 0, 0
 };
 
-static void lisp_init_cons_gc(lisp_vm_t * vm);
+static void lisp_init_cons_gc(lisp_vm_t * vm, const lisp_vm_param_t * param);
 static void lisp_free_cons_gc_unset_car_cdr(lisp_vm_t * vm);
 static void lisp_free_cons_gc(lisp_vm_t * vm);
 static void _lisp_create_vm_cleanup(lisp_vm_t * vm);
+static int  _lisp_init_object_slabs(lisp_vm_t * vm);
+static void _lisp_free_object_slabs(lisp_vm_t * vm);
 
 /* defined in lisp_type.c */
 int _lisp_init_types(lisp_vm_t * vm);
 
+/* defined in lisp_cons.c */
+void _lisp_init_cons_arena(lisp_vm_t * vm, const lisp_vm_param_t * param);
+void _lisp_free_cons_pages(lisp_vm_t * vm);
+void _lisp_init_cons_sweeper(lisp_vm_t * vm, const lisp_vm_param_t * param);
+void _lisp_stop_cons_sweeper(lisp_vm_t * vm);
+
+/* defined in lisp_jit.c */
+void _lisp_free_jit_chunks(lisp_vm_t * vm);
+
 /* cleanup on failure */
 static void _lisp_create_vm_cleanup(lisp_vm_t * vm)
 {
+  _lisp_stop_cons_sweeper(vm);
   if(vm->types != NULL) 
   {
     FREE(vm->types);
   }
+  _lisp_free_object_slabs(vm);
   FREE(vm);
 }
 
@@ -40,8 +55,24 @@ lisp_vm_t * lisp_create_vm(lisp_vm_param_t * param)
     return NULL;
   }
 
+  ret->gc_sweeper   = NULL;
+  ret->object_slabs = NULL;
+  ret->jit_chunks   = NULL;
+  ret->mem_jit      = 0;
+  ret->types        = NULL;
+  ret->deferred_unset_top = 0;
+  ret->heap_limit  = param->heap_limit;
+  ret->eval_stack_mmap = param->eval_stack_mmap;
+  ret->mem_objects = 0;
+  ret->mem_symbols = 0;
+  /* no buckets until the symbol table is initialized */
+  memset(&ret->symbols, 0, sizeof(hash_table_t));
+  if(_lisp_init_object_slabs(ret)) 
+  {
+    _lisp_create_vm_cleanup(ret);
+    return NULL;
+  }
   /* init type system */
-  ret->types      = NULL;
   ret->types_size = 256;
   ret->types      = MALLOC(sizeof(lisp_type_t) * ret->types_size);
   if(ret->types      == NULL) 
@@ -50,7 +81,7 @@ lisp_vm_t * lisp_create_vm(lisp_vm_param_t * param)
     return NULL;
   }
   /* init conses */
-  lisp_init_cons_gc(ret);
+  lisp_init_cons_gc(ret, param);
 
   lisp_size_t i;
   for(i = 0; i < ret->types_size; i++) 
@@ -71,6 +102,8 @@ lisp_vm_t * lisp_create_vm(lisp_vm_param_t * param)
 void lisp_free_vm(lisp_vm_t * vm)
 {
   lisp_size_t i;
+  _lisp_stop_cons_sweeper(vm);
+  lisp_flush_deferred_unset(vm);
   lisp_free_cons_gc_unset_car_cdr(vm);
   hash_table_finalize(&vm->symbols);
   lisp_free_cons_gc(vm);
@@ -87,15 +120,20 @@ void lisp_free_vm(lisp_vm_t * vm)
     }
   }
   FREE(vm->types);
+  _lisp_free_jit_chunks(vm);
+  _lisp_free_object_slabs(vm);
   FREE(vm);
 }
 
-void lisp_init_cons_gc(lisp_vm_t * vm)
+void lisp_init_cons_gc(lisp_vm_t * vm, const lisp_vm_param_t * param)
 {
   /* init cons pages */
-  vm->cons_page_size       = LISP_CONS_PAGE_SIZE;
+  vm->cons_page_size       = (param->cons_page_size ? 
+                              param->cons_page_size : 
+                              LISP_CONS_PAGE_SIZE);
   vm->cons_pages           = NULL;
   vm->n_cons_pages         = 0;
+  _lisp_init_cons_arena(vm, param);
 
   vm->cons_table           = NULL;
   vm->cons_table_size      = 0;
@@ -108,6 +146,31 @@ void lisp_init_cons_gc(lisp_vm_t * vm)
   vm->root_cons_table      = NULL;
   vm->root_cons_table_size = 0;
   vm->root_cons_top        = 0;
+
+  vm->root_regions         = NULL;
+  vm->n_root_regions       = 0;
+
+  vm->sweep_cons_top       = 0;
+  vm->gc_roots_scanned     = 0;
+  vm->gc_release_pending   = 0;
+  vm->gc_release_page      = 0;
+  vm->gc_n_cycles          = 0;
+  vm->gc_alloc_interval    = param->gc_alloc_interval;
+  vm->gc_alloc_step_size   = param->gc_alloc_step_size;
+  vm->gc_alloc_count       = 0;
+  vm->gc_cycle_pending     = 0;
+
+  vm->gc_generational      = param->gc_generational;
+  vm->gc_nursery_overflow  = 0;
+  vm->gc_nursery           = NULL;
+  vm->gc_nursery_top       = 0;
+  vm->gc_nursery_size      = 0;
+  vm->gc_remembered        = NULL;
+  vm->gc_remembered_top    = 0;
+  vm->gc_remembered_size   = 0;
+
+  vm->gc_mark_threads      = param->gc_mark_threads;
+  _lisp_init_cons_sweeper(vm, param);
 }
 
 static void lisp_free_cons_gc_unset_car_cdr(lisp_vm_t * vm)
@@ -125,6 +188,12 @@ static void lisp_free_cons_gc_unset_car_cdr(lisp_vm_t * vm)
       lisp_unset_object(vm, &vm->cons_table[i]->car);
       lisp_unset_object(vm, &vm->cons_table[i]->cdr);
     }
+    /* unreachable conses that have not been swept yet */
+    for(i = vm->white_cons_top; i < vm->sweep_cons_top; i++) 
+    {
+      lisp_unset_object(vm, &vm->cons_table[i]->car);
+      lisp_unset_object(vm, &vm->cons_table[i]->cdr);
+    }
   }
   if(vm->root_cons_table)
   {
@@ -138,7 +207,6 @@ static void lisp_free_cons_gc_unset_car_cdr(lisp_vm_t * vm)
 
 static void lisp_free_cons_gc(lisp_vm_t * vm)
 {
-  size_t i;
   if(vm->cons_table)
   {
     FREE(vm->cons_table);
@@ -147,14 +215,19 @@ static void lisp_free_cons_gc(lisp_vm_t * vm)
   {
     FREE(vm->root_cons_table);
   }
-  for(i = 0; i < vm->n_cons_pages; i++) 
+  if(vm->root_regions)
+  {
+    FREE(vm->root_regions);
+  }
+  if(vm->gc_nursery)
   {
-    FREE(vm->cons_pages[i]);
+    FREE(vm->gc_nursery);
   }
-  if(vm->cons_pages) 
+  if(vm->gc_remembered)
   {
-    FREE(vm->cons_pages);
+    FREE(vm->gc_remembered);
   }
+  _lisp_free_cons_pages(vm);
 }
 
 lisp_size_t lisp_object_to_c_str(lisp_vm_t * vm, 
@@ -176,10 +249,272 @@ lisp_size_t lisp_object_to_c_str(lisp_vm_t * vm,
  * Object
  * 
  *****************************************************************************/
+/* Objects are preceded by their block size, the vm they are 
+   accounted to and the reference count.
+   Small objects of a vm are taken from slabs of their size class 
+   owned by the vm, the slabs are released by lisp_free_vm(). 
+   Blocks freed by the thread that created the vm go to the free 
+   lists of the vm. Blocks freed by other threads, e.g. the background 
+   sweeper, are pushed to lock-free return stacks, which the vm takes 
+   over when a free list runs empty.
+   Large objects and objects without a vm are allocated with malloc. */
+#define LISP_OBJECT_N_CLASSES 9
+#define LISP_OBJECT_LARGE     LISP_OBJECT_N_CLASSES
+#define LISP_OBJECT_SLAB_SIZE (64 * 1024)
+/* the first bytes of a slab link the slabs of a vm */
+#define LISP_OBJECT_SLAB_LINK 16
+
+#ifdef HAS_PTHREAD
+#define LISP_THREAD_LOCAL __thread
+#else
+#define LISP_THREAD_LOCAL
+#endif
+
+typedef struct lisp_object_header_t
+{
+  size_t             size;
+  struct lisp_vm_t * vm;
+  /* directly in front of the object, see LISP_OBJECT_REFCOUNT */
+  lisp_ref_count_t   ref_count;
+} lisp_object_header_t;
+
+typedef struct lisp_object_slabs_t
+{
+  /* address of lisp_object_thread in the thread that created the vm */
+  const char * owner;
+  void       * free_list[LISP_OBJECT_N_CLASSES];
+  char       * slab_top[LISP_OBJECT_N_CLASSES];
+  char       * slab_end[LISP_OBJECT_N_CLASSES];
+  /* blocks and bytes freed by other threads */
+  void       * returned[LISP_OBJECT_N_CLASSES];
+  size_t       returned_size;
+  void       * slabs;
+  /* blocks freed by the owner while deferring, 
+     see _lisp_defer_object_frees() */
+  int          deferring;
+  void       * deferred;
+} lisp_object_slabs_t;
+
+/* block sizes including the header */
+static const size_t lisp_object_class_size[LISP_OBJECT_N_CLASSES] = 
+{
+  32, 48, 64, 96, 128, 192, 256, 384, 512
+};
+
+/* identifies the calling thread by its address */
+static LISP_THREAD_LOCAL char lisp_object_thread;
+
+static int _lisp_init_object_slabs(lisp_vm_t * vm)
+{
+  lisp_size_t c;
+  vm->object_slabs = MALLOC(sizeof(lisp_object_slabs_t));
+  if(vm->object_slabs == NULL) 
+  {
+    return LISP_ALLOC_ERROR;
+  }
+  vm->object_slabs->owner         = &lisp_object_thread;
+  vm->object_slabs->returned_size = 0;
+  vm->object_slabs->slabs         = NULL;
+  vm->object_slabs->deferring     = 0;
+  vm->object_slabs->deferred      = NULL;
+  for(c = 0; c < LISP_OBJECT_N_CLASSES; c++) 
+  {
+    vm->object_slabs->free_list[c] = NULL;
+    vm->object_slabs->slab_top[c]  = NULL;
+    vm->object_slabs->slab_end[c]  = NULL;
+    vm->object_slabs->returned[c]  = NULL;
+  }
+  return LISP_OK;
+}
+
+static void _lisp_free_object_slabs(lisp_vm_t * vm)
+{
+  void * slab;
+  if(vm->object_slabs == NULL) 
+  {
+    return;
+  }
+  while((slab = vm->object_slabs->slabs) != NULL) 
+  {
+    vm->object_slabs->slabs = *(void**) slab;
+    free(slab);
+  }
+  FREE(vm->object_slabs);
+  vm->object_slabs = NULL;
+}
+
+static inline size_t _lisp_object_size_class(size_t total)
+{
+  size_t c;
+  for(c = 0; c < LISP_OBJECT_N_CLASSES; c++) 
+  {
+    if(total <= lisp_object_class_size[c]) 
+    {
+      break;
+    }
+  }
+  return c;
+}
+
+static inline void * _lisp_alloc_slab_block(lisp_vm_t * vm, size_t c)
+{
+  lisp_object_slabs_t * slabs = vm->object_slabs;
+  void                * block = slabs->free_list[c];
+  size_t                total = lisp_object_class_size[c];
+#ifdef HAS_PTHREAD
+  if(block == NULL && 
+     __atomic_load_n(&slabs->returned[c], __ATOMIC_RELAXED) != NULL) 
+  {
+    block = __atomic_exchange_n(&slabs->returned[c], NULL, __ATOMIC_ACQUIRE);
+    vm->mem_objects -= __atomic_exchange_n(&slabs->returned_size, 
+                                           0, 
+                                           __ATOMIC_RELAXED);
+  }
+#endif
+  if(block != NULL) 
+  {
+    slabs->free_list[c] = *(void**) block;
+    return block;
+  }
+  if(slabs->slab_top[c] == NULL || 
+     slabs->slab_end[c] - slabs->slab_top[c] < (ptrdiff_t) total) 
+  {
+    /* the rest of the last slab is left unused */
+    char * slab = malloc(LISP_OBJECT_SLAB_SIZE);
+    if(slab == NULL) 
+    {
+      return NULL;
+    }
+    *(void**) slab      = slabs->slabs;
+    slabs->slabs        = slab;
+    slabs->slab_top[c]  = slab + LISP_OBJECT_SLAB_LINK;
+    slabs->slab_end[c]  = slab + LISP_OBJECT_SLAB_SIZE;
+  }
+  block = slabs->slab_top[c];
+  slabs->slab_top[c] += total;
+  return block;
+}
+
+static inline lisp_object_header_t * _lisp_alloc_object_block(lisp_vm_t * vm,
+                                                              size_t      size)
+{
+  size_t                 total = sizeof(lisp_object_header_t) + size;
+  size_t                 c     = _lisp_object_size_class(total);
+  lisp_object_header_t * header;
+  if(c != LISP_OBJECT_LARGE) 
+  {
+    total = lisp_object_class_size[c];
+  }
+  if(vm != NULL && lisp_heap_limit_exceeded(vm, total)) 
+  {
+    return NULL;
+  }
+  if(vm == NULL || c == LISP_OBJECT_LARGE) 
+  {
+    header = malloc(total);
+  }
+  else 
+  {
+    header = _lisp_alloc_slab_block(vm, c);
+  }
+  if(header != NULL) 
+  {
+    header->size = total;
+    header->vm   = vm;
+    if(vm != NULL) 
+    {
+      vm->mem_objects += total;
+    }
+  }
+  return header;
+}
+
+static inline void _lisp_free_object_block(lisp_object_header_t * header)
+{
+  size_t                total = header->size;
+  size_t                c     = _lisp_object_size_class(total);
+  lisp_vm_t           * vm    = header->vm;
+  lisp_object_slabs_t * slabs;
+  if(vm == NULL) 
+  {
+    free(header);
+    return;
+  }
+  slabs = vm->object_slabs;
+  if(slabs->owner == &lisp_object_thread && slabs->deferring) 
+  {
+    /* linked behind the header, released by another thread */
+    *(void**) &header[1] = slabs->deferred;
+    slabs->deferred      = header;
+    return;
+  }
+  if(slabs->owner == &lisp_object_thread) 
+  {
+    vm->mem_objects -= total;
+    if(c == LISP_OBJECT_LARGE) 
+    {
+      free(header);
+    }
+    else 
+    {
+      *(void**) header    = slabs->free_list[c];
+      slabs->free_list[c] = header;
+    }
+    return;
+  }
+#ifdef HAS_PTHREAD
+  if(c == LISP_OBJECT_LARGE) 
+  {
+    free(header);
+  }
+  else 
+  {
+    *(void**) header = __atomic_load_n(&slabs->returned[c], __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&slabs->returned[c], 
+                                       (void**) header, 
+                                       header, 
+                                       0,
+                                       __ATOMIC_RELEASE,
+                                       __ATOMIC_RELAXED)) 
+    {
+    }
+  }
+  __atomic_add_fetch(&slabs->returned_size, total, __ATOMIC_RELAXED);
+#endif
+}
+
+/* Blocks of vm freed by the calling thread are collected instead of 
+   released until _lisp_take_deferred_objects(), e.g. to release them 
+   in the background sweeper. Used by lisp_cons.c. */
+void _lisp_defer_object_frees(lisp_vm_t * vm)
+{
+  vm->object_slabs->deferring = 1;
+}
+
+void * _lisp_take_deferred_objects(lisp_vm_t * vm)
+{
+  void * list = vm->object_slabs->deferred;
+  vm->object_slabs->deferring = 0;
+  vm->object_slabs->deferred  = NULL;
+  return list;
+}
+
+/* release a list of deferred blocks, may be called by any thread */
+void _lisp_free_deferred_objects(void * list)
+{
+  while(list != NULL) 
+  {
+    lisp_object_header_t * header = list;
+    list = *(void**) &header[1];
+    _lisp_free_object_block(header);
+  }
+}
+
 #ifdef DEBUG
 #include "util/mock.h"
 void * lisp_malloc_object( const char      * file,
 			   int               line, 
+			   lisp_vm_t       * vm,
 			   size_t            size,
 			   lisp_ref_count_t  rcount )
 {
@@ -188,8 +523,12 @@ void * lisp_malloc_object( const char      * file,
   {
     MOCK_CALL(memchecker, void*);
   }
-  lisp_ref_count_t * obj = malloc(sizeof(lisp_ref_count_t) + size);
-  obj[0] = rcount;
+  lisp_object_header_t * obj = _lisp_alloc_object_block(vm, size);
+  if(obj == NULL) 
+  {
+    return NULL;
+  }
+  obj->ref_count = rcount;
   memcheck_register_alloc(file, line, obj);
   return &obj[1];
 }
@@ -198,27 +537,75 @@ void lisp_free_object( const char    * file,
 		       int             line,
 		       void          * obj)
 {
-  memcheck_register_freed(file, line, (lisp_ref_count_t*) obj - 1);
-  free((lisp_ref_count_t*) obj - 1);
+  memcheck_register_freed(file, line, (lisp_object_header_t*) obj - 1);
+  _lisp_free_object_block((lisp_object_header_t*) obj - 1);
 }
 
 #else 
 
-void * lisp_malloc_object( size_t size, lisp_ref_count_t rcount)
+void * lisp_malloc_object( lisp_vm_t      * vm, 
+                           size_t           size, 
+                           lisp_ref_count_t rcount)
 {
-  lisp_ref_count_t * obj = malloc(sizeof(lisp_ref_count_t) + size);
-  obj[0] = rcount;
+  lisp_object_header_t * obj = _lisp_alloc_object_block(vm, size);
+  if(obj == NULL) 
+  {
+    return NULL;
+  }
+  obj->ref_count = rcount;
   return &obj[1];
 }
 
 
 void lisp_free_object( void * obj)
 {
-  free((lisp_ref_count_t*) obj - 1);
+  _lisp_free_object_block((lisp_object_header_t*) obj - 1);
 }
 
 #endif
 
+/*****************************************************************************
+ * 
+ * memory accounting
+ * 
+ *****************************************************************************/
+void lisp_get_memory_usage(const lisp_vm_t * vm, lisp_memory_usage_t * usage)
+{
+  usage->cons_pages  = (vm->n_cons_pages * vm->cons_page_size * 
+                        sizeof(lisp_cons_t));
+  usage->cons_tables = ((vm->cons_table_size + vm->gc_sweep_lent) * 
+                        sizeof(lisp_cons_t*) +
+                        vm->root_cons_table_size * sizeof(lisp_root_cons_t) +
+                        vm->n_cons_pages * sizeof(lisp_cons_t*) +
+                        vm->gc_nursery_size * sizeof(lisp_cons_t*) +
+                        vm->gc_remembered_size * sizeof(lisp_cons_t*));
+  usage->objects     = vm->mem_objects;
+#ifdef HAS_PTHREAD
+  /* freed by other threads, not yet taken over by the vm */
+  usage->objects    -= __atomic_load_n(&vm->object_slabs->returned_size,
+                                       __ATOMIC_RELAXED);
+#endif
+  usage->symbols     = (vm->mem_symbols + 
+                        (vm->symbols.hash_array[0].n_buckets + 
+                         vm->symbols.hash_array[1].n_buckets) * 
+                        sizeof(hash_table_bucket_t));
+  usage->jit_code    = vm->mem_jit;
+  usage->total       = (usage->cons_pages + usage->cons_tables + 
+                        usage->objects + usage->symbols + 
+                        usage->jit_code);
+}
+
+int lisp_heap_limit_exceeded(const lisp_vm_t * vm, size_t n_bytes)
+{
+  lisp_memory_usage_t usage;
+  if(vm->heap_limit == 0) 
+  {
+    return 0;
+  }
+  lisp_get_memory_usage(vm, &usage);
+  return usage.total + n_bytes > vm->heap_limit;
+}
+
 static inline void _lisp_copy_object( lisp_vm_t   * vm,
 				      lisp_cell_t * target,
 				      const lisp_cell_t * source)
@@ -357,6 +744,30 @@ int lisp_unset_object_root(lisp_vm_t * vm, lisp_cell_t * target)
   return LISP_OK;
 }
 
+int lisp_unset_object_deferred(lisp_vm_t * vm, lisp_cell_t * target)
+{
+  if(LISP_IS_OBJECT(target)) 
+  {
+    if(vm->deferred_unset_top == LISP_DEFERRED_UNSET_SIZE) 
+    {
+      lisp_flush_deferred_unset(vm);
+    }
+    vm->deferred_unset[vm->deferred_unset_top++] = *target;
+  }
+  *target = lisp_nil;
+  return LISP_OK;
+}
+
+void lisp_flush_deferred_unset(lisp_vm_t * vm)
+{
+  /* destructors may append to the buffer */
+  while(vm->deferred_unset_top) 
+  {
+    lisp_cell_t cell = vm->deferred_unset[--vm->deferred_unset_top];
+    lisp_unset_object(vm, &cell);
+  }
+}
+
 /*******************************************************************
  * 
  * object compare
@@ -20,6 +20,21 @@
 #include "lisp_type.h"
 #include "util/hash_table.h"
 
+struct lisp_gc_sweeper_t;
+struct lisp_object_slabs_t;
+struct lisp_jit_chunk_t;
+
+/** Capacity of the buffer of lisp_unset_object_deferred() */
+#define LISP_DEFERRED_UNSET_SIZE 256
+
+/** Cells that are scanned as part of the root set, 
+ *  see lisp_register_root_region() */
+typedef struct lisp_root_region_t
+{
+  lisp_cell_t ** cells;
+  lisp_size_t  * n_cells;
+} lisp_root_region_t;
+
 typedef struct lisp_vm_t 
 {
   /* @todo move to continiation */
@@ -36,6 +51,9 @@ typedef struct lisp_vm_t
   lisp_size_t     types_size;
 
   hash_table_t    symbols;
+  /* incremented when the binding cons of a symbol changes,
+     invalidates the caches of LDVR */
+  lisp_size_t     symbol_epoch;
 
   /* cons data and garbage collector */
   lisp_cons_t               ** cons_table;
@@ -51,22 +69,154 @@ typedef struct lisp_vm_t
   lisp_size_t                  root_cons_table_size;
   lisp_size_t                  root_cons_top;
 
+  lisp_root_region_t         * root_regions;
+  lisp_size_t                  n_root_regions;
+
 
   lisp_cons_t               ** cons_pages;
   lisp_size_t                  n_cons_pages;
   lisp_size_t                  cons_page_size;
 
+  /* optional mmap reservation for cons pages */
+  void                       * cons_arena;
+  size_t                       cons_arena_stride;
+  lisp_size_t                  cons_arena_n_pages;
+  lisp_size_t                  cons_arena_top;
+  lisp_cons_t               ** cons_arena_free_pages;
+  lisp_size_t                  n_cons_arena_free_pages;
+
+  /* incremental collector */
+  lisp_size_t                  sweep_cons_top;
+  int                          gc_roots_scanned;
+  /* the sweep has finished, free pages are released by the next 
+     lisp_gc_step() calls, gc_release_page is the next page examined */
+  int                          gc_release_pending;
+  lisp_size_t                  gc_release_page;
+  lisp_size_t                  gc_n_cycles;
+  lisp_size_t                  gc_alloc_interval;
+  lisp_size_t                  gc_alloc_step_size;
+  lisp_size_t                  gc_alloc_count;
+  /* the marking has been finished by an allocation driven step,
+     the cycle ends at the next safe point, see lisp_gc_safe_point() */
+  int                          gc_cycle_pending;
+
+  /* generational collector, see lisp_gc_minor() */
+  int                          gc_generational;
+  int                          gc_nursery_overflow;
+  lisp_cons_t               ** gc_nursery;
+  lisp_size_t                  gc_nursery_top;
+  lisp_size_t                  gc_nursery_size;
+  lisp_cons_t               ** gc_remembered;
+  lisp_size_t                  gc_remembered_top;
+  lisp_size_t                  gc_remembered_size;
+
+  /* parallel marking, see lisp_gc_collect() */
+  lisp_size_t                  gc_mark_threads;
+
+  /* background sweeper, conses lent to the sweeper are 
+     not in the cons table */
+  struct lisp_gc_sweeper_t   * gc_sweeper;
+  lisp_size_t                  gc_sweep_lent;
+
+  /* deferred reference count decrements, 
+     see lisp_unset_object_deferred() */
+  lisp_cell_t                  deferred_unset[LISP_DEFERRED_UNSET_SIZE];
+  lisp_size_t                  deferred_unset_top;
+
+  /* memory accounting, see lisp_get_memory_usage() */
+  size_t                       heap_limit;
+  size_t                       mem_objects;
+  size_t                       mem_symbols;
+
+  /* size-class slabs of small objects, see MALLOC_VM_OBJECT() */
+  struct lisp_object_slabs_t * object_slabs;
+
+  /* chunks of machine code, the first one is filled, 
+     see lisp_jit_compile() */
+  struct lisp_jit_chunk_t    * jit_chunks;
+  size_t                       mem_jit;
+
+  /* eval envs reserve their stacks with mmap */
+  int                          eval_stack_mmap;
+
 } lisp_vm_t;
 
 typedef struct lisp_vm_param_t
 {
   size_t data_stack_size;
   size_t call_stack_size;
+  /** Number of allocated conses between two allocation driven 
+   *  gc steps (0: disabled). 
+   *  These steps sweep and mark, the cycle is ended by the evaluator
+   *  at a safe point, see lisp_gc_safe_point() */
+  size_t gc_alloc_interval;
+  /** Number of conses processed by an allocation driven gc step */
+  size_t gc_alloc_step_size;
+  /** Number of conses per cons page (0: default) */
+  size_t cons_page_size;
+  /** Number of conses reserved in a single mmap arena (0: disabled). 
+   *  The pages of the arena are committed on demand.
+   *  If the arena is exhausted or mmap is not available, 
+   *  cons pages are allocated with malloc. */
+  size_t cons_arena_size;
+  /** Advise transparent huge pages for the arena */
+  int    cons_arena_huge_pages;
+  /** Track new conses in a nursery for lisp_gc_minor() */
+  int    gc_generational;
+  /** Number of threads marking in lisp_gc_collect() (0, 1: serial) */
+  size_t gc_mark_threads;
+  /** Sweep unreachable conses in a background thread. 
+   *  Object cells of the conses are still unset by the calling 
+   *  thread when the conses are taken back, the memory of freed 
+   *  objects is released by the background thread. */
+  int    gc_background_sweep;
+  /** Maximum number of bytes held by the vm (0: unlimited), 
+   *  see lisp_get_memory_usage().
+   *  Allocations of cons pages and objects that would exceed the limit
+   *  fail with LISP_ALLOC_ERROR. */
+  size_t heap_limit;
+  /** Reserve the data and call stacks of eval envs at their maximum 
+   *  size with mmap, followed by a PROT_NONE guard page. 
+   *  The stacks never move and pushes never reallocate, they still
+   *  check the bound and fail with LISP_STACK_OVERFLOW. The guard page
+   *  only catches writes past the stack that bypass a push.
+   *  Without mmap the stacks grow with realloc. */
+  int    eval_stack_mmap;
 } lisp_vm_param_t;
 
+/** Bytes held by a vm */
+typedef struct lisp_memory_usage_t
+{
+  /** cons pages */
+  size_t cons_pages;
+  /** cons table, root cons table, page list, nursery and remembered set */
+  size_t cons_tables;
+  /** objects allocated with MALLOC_VM_OBJECT() including headers */
+  size_t objects;
+  /** entries and buckets of the symbol table */
+  size_t symbols;
+  /** mapped chunks of machine code, see lisp_jit_compile() */
+  size_t jit_code;
+  size_t total;
+} lisp_memory_usage_t;
+
 extern lisp_vm_param_t lisp_vm_default_param;
 
 lisp_vm_t * lisp_create_vm( lisp_vm_param_t * param);
+
+/**
+ * Query the number of bytes held by the vm.
+ * Memory of the vm structure, the type table and of eval envs is 
+ * not included.
+ */
+void lisp_get_memory_usage(const lisp_vm_t     * vm, 
+                           lisp_memory_usage_t * usage);
+
+/**
+ * @return non zero if allocating n_bytes would exceed the 
+ *         heap_limit of the vm
+ */
+int lisp_heap_limit_exceeded(const lisp_vm_t * vm, size_t n_bytes);
 void lisp_free_vm(   lisp_vm_t * vm);
 
 
@@ -134,6 +284,29 @@ int lisp_unset_object(lisp_vm_t * vm,
 int lisp_unset_object_root(lisp_vm_t * vm,
 			   lisp_cell_t * target);
 
+/**
+ * Like lisp_unset_object(), but the reference count of an object is 
+ * not decremented at once. The cell is appended to a buffer of 
+ * the vm and released by the next lisp_flush_deferred_unset().
+ * Until then the object stays alive, so an object that is copied 
+ * again before the flush is neither destructed nor reallocated.
+ *
+ * The buffer is flushed when it is full, by lisp_gc_step(), 
+ * lisp_gc_collect(), lisp_gc_minor() and when an eval env or 
+ * the vm is freed.
+ * @return LISP_OK
+ */
+int lisp_unset_object_deferred(lisp_vm_t   * vm,
+                               lisp_cell_t * target);
+
+/**
+ * Apply the decrements buffered by lisp_unset_object_deferred() and
+ * run the destructors of objects without references. 
+ * Destructors may defer further decrements, they are applied 
+ * by the same call.
+ */
+void lisp_flush_deferred_unset(lisp_vm_t * vm);
+
 /*****************************************************************************
  * 
  * compare objects
@@ -266,6 +439,147 @@ int lisp_make_list(lisp_vm_t         * vm,
 		   const lisp_cell_t * elems,
 		   lisp_size_t         n);
 
+/*****************************************************************
+ *
+ * garbage collector
+ *
+ *****************************************************************/
+/**
+ * Perform a bounded step of the incremental tri-color collector.
+ *
+ * At most n_conses unswept conses are released and at most 
+ * n_conses grey conses are blackened. If the grey set is exhausted 
+ * the cycle ends: the remaining white conses become unswept,
+ * black conses turn white and the children of the root set are 
+ * greyed for the next cycle.
+ *
+ * Conses that are neither reachable from the root set nor rooted
+ * are reclaimed, i.e. non-root conses held in C variables
+ * are not protected.
+ * 
+ * When the unswept conses of the last cycle are exhausted, 
+ * cons pages without conses in use are released by the next calls
+ * of this function, each call examines the pages of n_conses 
+ * conses (at least one page). Allocation driven steps never 
+ * release pages.
+ *
+ * If gc_alloc_interval is set in lisp_vm_param_t, the marking work 
+ * is also done during cons allocation. The cycle then ends with the
+ * next call of this function or at the next safe point of the 
+ * evaluator, see lisp_gc_safe_point().
+ *
+ * @param  vm       virtual machine context
+ * @param  n_conses maximum number of conses processed 
+ * @return LISP_OK
+ */
+int lisp_gc_step(lisp_vm_t * vm, lisp_size_t n_conses);
+
+/**
+ * Safe point of an evaluator, called when all cells in use are 
+ * reachable from the root set, the root regions or the conses 
+ * passed to lisp_gc_grey_cons() by the caller.
+ * If an allocation driven step has finished the marking 
+ * (vm->gc_cycle_pending), the conses greyed since then are marked 
+ * with at most gc_alloc_step_size conses processed and the cycle 
+ * ends as in lisp_gc_step().
+ * lisp_eval_lambda() calls it at RET and JP, the lambdas of the 
+ * call stack are greyed before. Conses held by the host in C 
+ * variables during the evaluation must be rooted.
+ * @return 1 if the cycle has ended, 0 otherwise
+ */
+int lisp_gc_safe_point(lisp_vm_t * vm);
+
+/**
+ * Protect a cons from the running cycle as the write barrier does,
+ * e.g. a lambda that is evaluated.
+ */
+void lisp_gc_grey_cons(lisp_vm_t * vm, lisp_cons_t * cons);
+
+/**
+ * Register an array of cells as implicit roots, e.g. an eval stack.
+ * *cells and *n_cells are read whenever the root set is scanned,
+ * so the array may be reallocated and resized.
+ * Conses in the region are not moved to the root table. They must be
+ * stored with lisp_copy_object_as_region_root() and can be released
+ * with lisp_unset_object().
+ * @return LISP_OK or LISP_ALLOC_ERROR
+ */
+int lisp_register_root_region(lisp_vm_t    * vm,
+                              lisp_cell_t ** cells,
+                              lisp_size_t  * n_cells);
+
+void lisp_unregister_root_region(lisp_vm_t    * vm,
+                                 lisp_cell_t ** cells);
+
+/**
+ * Copy source to a cell of a registered root region.
+ * Conses are only protected from the running gc cycle by the 
+ * write barrier, the root set is unchanged.
+ * @return LISP_OK
+ */
+int lisp_copy_object_as_region_root(lisp_vm_t         * vm,
+                                    lisp_cell_t       * target,
+                                    const lisp_cell_t * source);
+
+/**
+ * Run the collector until the current cycle has finished and
+ * all unreachable conses have been swept.
+ * Cons pages without conses in use are released.
+ *
+ * If gc_mark_threads is set in lisp_vm_param_t, the running cycle is
+ * abandoned: the root set is scanned by the calling thread and 
+ * gc_mark_threads threads mark the conses reachable from it 
+ * with work stealing. The table is then partitioned into reachable
+ * and unreachable conses and a new cycle starts. The calling thread
+ * waits for the workers, the whole collection is one pause.
+ * Without pthreads or if the mark state cannot be allocated 
+ * the serial collector is used.
+ * @return LISP_OK
+ */
+int lisp_gc_collect(lisp_vm_t * vm);
+
+/**
+ * Minor collection of the conses allocated since the last 
+ * minor collection or the end of the last gc cycle (young conses).
+ *
+ * Young conses are reachable if they can be reached through young 
+ * conses from the children of the root set, from the root regions or 
+ * from the remembered set. The remembered set holds old non-root conses 
+ * that got a young car or cdr, it is maintained by the write barrier.
+ * Reachable young conses are promoted in place, unreachable ones are
+ * swept and returned to the free conses of the cons table at once.
+ * The work is proportional to the number of young conses, 
+ * the size of the root set and the remembered set.
+ *
+ * Like lisp_gc_step(), the function must only be called when all 
+ * conses in use are reachable. Without gc_generational in 
+ * lisp_vm_param_t there are no young conses.
+ *
+ * @param  vm virtual machine context
+ * @return LISP_OK
+ */
+int lisp_gc_minor(lisp_vm_t * vm);
+
+/**
+ * Full collection followed by compaction of the cons pages.
+ *
+ * Live non-root conses are moved from the pages with the highest 
+ * addresses to free conses with the lowest addresses, pages left 
+ * without conses in use are released. References from conses, 
+ * from root conses (e.g. symbol bindings) and from the root regions 
+ * (e.g. eval stacks) are fixed up. Root conses are not moved.
+ * Conses referenced by a typed cell (lambdas, exceptions) are pinned,
+ * since byte code and call stacks hold their addresses.
+ *
+ * Any other pointer to a non-root cons becomes invalid, so the 
+ * function must not be called while such a pointer is in use, 
+ * e.g. during evaluation.
+ *
+ * @param  vm virtual machine context
+ * @return LISP_OK or LISP_ALLOC_ERROR (nothing is moved)
+ */
+int lisp_gc_compact(lisp_vm_t * vm);
+
 /*****************************************************************
  *
  * integer
@@ -290,6 +604,7 @@ lisp_size_t lisp_object_to_c_str(lisp_vm_t * vm, char * buff, size_t maxn, const
 #ifdef DEBUG
 void * lisp_malloc_object( const char      * file,
                            int               line, 
+                           lisp_vm_t       * vm,
                            size_t            size,
                            lisp_ref_count_t  rcount);
 
@@ -297,23 +612,29 @@ void lisp_free_object( const char    * file,
                        int             line,
                        void          * ptr);
 
-#define MALLOC_OBJECT(SIZE, RCOUNT) lisp_malloc_object(__FILE__,        \
-                                                       __LINE__,        \
-                                                       (SIZE),          \
-                                                       (RCOUNT))
+#define MALLOC_VM_OBJECT(VM, SIZE, RCOUNT) lisp_malloc_object(__FILE__,  \
+                                                              __LINE__,  \
+                                                              (VM),      \
+                                                              (SIZE),    \
+                                                              (RCOUNT))
 
 #define FREE_OBJECT(PTR) lisp_free_object(__FILE__,__LINE__,(PTR))
 
 #else
 
-void * lisp_malloc_object( size_t           size,
+void * lisp_malloc_object( lisp_vm_t      * vm,
+                           size_t           size,
                            lisp_ref_count_t rcount );
 
 void lisp_free_object( void * ptr);
 
 /** Create a managed object of size SIZE with reference count RCOUNT
+ *  that is accounted to VM (may be NULL), see heap_limit.
+ *  Small objects of a vm are taken from slabs of the vm, they must 
+ *  not outlive it. FREE_OBJECT() may be called from any thread.
  */
-#define MALLOC_OBJECT(SIZE, RCOUNT) lisp_malloc_object((SIZE),(RCOUNT))
+#define MALLOC_VM_OBJECT(VM, SIZE, RCOUNT) \
+  lisp_malloc_object((VM),(SIZE),(RCOUNT))
 
 /** 
  * Free a managed object.
@@ -323,4 +644,9 @@ void lisp_free_object( void * ptr);
 
 #endif
 
+/** Create a managed object of size SIZE with reference count RCOUNT
+ *  that is not accounted to a vm
+ */
+#define MALLOC_OBJECT(SIZE, RCOUNT) MALLOC_VM_OBJECT(NULL, (SIZE), (RCOUNT))
+
 #endif
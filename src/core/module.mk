@@ -5,4 +5,5 @@ SRC+= src/core/lisp_vm.c\
       src/core/lisp_string.c\
       src/core/lisp_eval.c\
       src/core/lisp_cons.c\
-      src/core/lisp_lambda.c
+      src/core/lisp_lambda.c\
+      src/core/lisp_jit.c
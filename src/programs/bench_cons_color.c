@@ -0,0 +1,242 @@
+/* Microbenchmark: colour transitions of the cons table layout
+   compared with a prototype of side bitmaps.
+
+   cons table:  every colour move swaps two entries of vm->cons_table
+                and updates gc_cons_index of both conses
+                (_insert_black_cons, _insert_root_cons, _ensure_not_white).
+   bitmap:      conses stay in place, the colour is a bit in a bitmap
+                indexed by the position of the cons in its page.
+
+   usage: bench_cons_color [n_conses] [n_ops]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "core/lisp_vm.h"
+
+/*****************************************************************
+ *
+ * bitmap prototype
+ *
+ *****************************************************************/
+typedef struct bitmap_heap_t
+{
+  lisp_cons_t      * conses;
+  lisp_size_t        n_conses;
+  uint64_t         * root_bits;
+  uint64_t         * black_bits;
+  lisp_ref_count_t * root_count;
+  lisp_cons_t     ** grey_stack;
+  lisp_size_t        grey_top;
+} bitmap_heap_t;
+
+#define BIT_WORD(I) ((I) >> 6)
+#define BIT_MASK(I) ((uint64_t)1 << ((I) & 63))
+
+static int bitmap_heap_init(bitmap_heap_t * heap, lisp_size_t n)
+{
+  lisp_size_t n_words = (n + 63) / 64;
+  lisp_size_t i;
+  heap->n_conses   = n;
+  heap->conses     = malloc(sizeof(lisp_cons_t) * n);
+  heap->root_bits  = calloc(n_words, sizeof(uint64_t));
+  heap->black_bits = calloc(n_words, sizeof(uint64_t));
+  heap->root_count = calloc(n, sizeof(lisp_ref_count_t));
+  heap->grey_stack = malloc(sizeof(lisp_cons_t*) * n);
+  heap->grey_top   = 0;
+  if(!heap->conses || !heap->root_bits || !heap->black_bits ||
+     !heap->root_count || !heap->grey_stack)
+  {
+    return LISP_ALLOC_ERROR;
+  }
+  for(i = 0; i < n; i++)
+  {
+    heap->conses[i].car = lisp_nil;
+    heap->conses[i].cdr = lisp_nil;
+  }
+  return LISP_OK;
+}
+
+static void bitmap_heap_free(bitmap_heap_t * heap)
+{
+  free(heap->conses);
+  free(heap->root_bits);
+  free(heap->black_bits);
+  free(heap->root_count);
+  free(heap->grey_stack);
+}
+
+static inline lisp_size_t bitmap_index(bitmap_heap_t * heap,
+                                       const lisp_cons_t * cons)
+{
+  return (lisp_size_t)(cons - heap->conses);
+}
+
+static inline void bitmap_grey(bitmap_heap_t * heap, lisp_cons_t * cons)
+{
+  lisp_size_t i = bitmap_index(heap, cons);
+  if(!(heap->black_bits[BIT_WORD(i)] & BIT_MASK(i)))
+  {
+    /* grey = black bit set and on the mark stack */
+    heap->black_bits[BIT_WORD(i)] |= BIT_MASK(i);
+    heap->grey_stack[heap->grey_top++] = cons;
+  }
+}
+
+static inline void bitmap_grey_cell(bitmap_heap_t * heap, lisp_cell_t * cell)
+{
+  if(LISP_IS_CONS(cell))
+  {
+    bitmap_grey(heap, cell->data.cons);
+  }
+}
+
+static inline void bitmap_root(bitmap_heap_t * heap, lisp_cons_t * cons)
+{
+  lisp_size_t i = bitmap_index(heap, cons);
+  if(!heap->root_count[i]++)
+  {
+    heap->root_bits[BIT_WORD(i)] |= BIT_MASK(i);
+    /* write barrier */
+    bitmap_grey_cell(heap, &cons->car);
+    bitmap_grey_cell(heap, &cons->cdr);
+  }
+}
+
+static inline void bitmap_unroot(bitmap_heap_t * heap, lisp_cons_t * cons)
+{
+  lisp_size_t i = bitmap_index(heap, cons);
+  if(!--heap->root_count[i])
+  {
+    heap->root_bits[BIT_WORD(i)]  &= ~BIT_MASK(i);
+    heap->black_bits[BIT_WORD(i)] |= BIT_MASK(i);
+  }
+}
+
+static void bitmap_mark(bitmap_heap_t * heap)
+{
+  lisp_size_t w, n_words = (heap->n_conses + 63) / 64;
+  memset(heap->black_bits, 0, sizeof(uint64_t) * n_words);
+  for(w = 0; w < n_words; w++)
+  {
+    uint64_t bits = heap->root_bits[w];
+    while(bits)
+    {
+      lisp_size_t i = w * 64 + __builtin_ctzll(bits);
+      bitmap_grey_cell(heap, &heap->conses[i].car);
+      bitmap_grey_cell(heap, &heap->conses[i].cdr);
+      bits &= bits - 1;
+    }
+  }
+  while(heap->grey_top)
+  {
+    lisp_cons_t * cons = heap->grey_stack[--heap->grey_top];
+    bitmap_grey_cell(heap, &cons->car);
+    bitmap_grey_cell(heap, &cons->cdr);
+  }
+}
+
+/*****************************************************************
+ *
+ * benchmark
+ *
+ *****************************************************************/
+static double seconds(clock_t a, clock_t b)
+{
+  return (double)(b - a) / CLOCKS_PER_SEC;
+}
+
+static void report(const char * name, double t, lisp_size_t n)
+{
+  printf("%-30s %10.3f ms %8.2f ns/op\n", name, t * 1e3, t * 1e9 / n);
+}
+
+int main(int argc, const char ** argv)
+{
+  lisp_size_t     n_conses = (argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000);
+  lisp_size_t     n_ops    = (argc > 2 ? strtoul(argv[2], NULL, 10) : 4000000);
+  lisp_size_t     i, n_cycles = 5;
+  lisp_vm_t     * vm;
+  lisp_cell_t     head, * cells;
+  bitmap_heap_t   heap;
+  lisp_size_t   * order;
+  clock_t         t0;
+
+  vm    = lisp_create_vm(&lisp_vm_default_param);
+  cells = malloc(sizeof(lisp_cell_t) * n_conses);
+  order = malloc(sizeof(lisp_size_t) * n_ops);
+  if(vm == NULL || cells == NULL || order == NULL ||
+     bitmap_heap_init(&heap, n_conses))
+  {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  srand(1);
+  for(i = 0; i < n_ops; i++)
+  {
+    order[i] = (lisp_size_t)rand() % n_conses;
+  }
+
+  /* reachable list of n_conses conses in both heaps */
+  lisp_make_cons_root(vm, &head);
+  for(i = 0; i < n_conses; i++)
+  {
+    lisp_make_cons_car_cdr(vm, &cells[i], &lisp_nil, LISP_CDR(&head));
+    lisp_cons_set_car_cdr(vm, head.data.cons, NULL, &cells[i]);
+    if(i)
+    {
+      heap.conses[i].cdr.type_id   = LISP_TID_CONS;
+      heap.conses[i].cdr.data.cons = &heap.conses[i - 1];
+    }
+  }
+  lisp_gc_collect(vm);
+  bitmap_root(&heap, &heap.conses[n_conses - 1]);
+
+  printf("%lu conses, %lu operations, %lu bytes per cons\n",
+         (unsigned long) n_conses,
+         (unsigned long) n_ops,
+         (unsigned long) sizeof(lisp_cons_t));
+
+  /* root / unroot of random conses */
+  t0 = clock();
+  for(i = 0; i < n_ops; i++)
+  {
+    lisp_cons_t * cons = cells[order[i]].data.cons;
+    lisp_cons_root(vm, cons);
+    lisp_cons_unroot(vm, cons);
+  }
+  report("cons table root/unroot", seconds(t0, clock()), n_ops);
+
+  t0 = clock();
+  for(i = 0; i < n_ops; i++)
+  {
+    lisp_cons_t * cons = &heap.conses[order[i]];
+    bitmap_root(&heap, cons);
+    bitmap_unroot(&heap, cons);
+  }
+  report("bitmap root/unroot", seconds(t0, clock()), n_ops);
+
+  /* full marking cycles */
+  t0 = clock();
+  for(i = 0; i < n_cycles; i++)
+  {
+    lisp_gc_step(vm, n_conses + 1);
+  }
+  report("cons table mark cycle", seconds(t0, clock()), n_cycles * n_conses);
+
+  t0 = clock();
+  for(i = 0; i < n_cycles; i++)
+  {
+    bitmap_mark(&heap);
+  }
+  report("bitmap mark cycle", seconds(t0, clock()), n_cycles * n_conses);
+
+  lisp_unset_object_root(vm, &head);
+  lisp_free_vm(vm);
+  bitmap_heap_free(&heap);
+  free(cells);
+  free(order);
+  return 0;
+}
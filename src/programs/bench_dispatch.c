@@ -0,0 +1,188 @@
+/* Microbenchmark: instruction dispatch of lisp_eval_lambda.
+
+   push:  n_instr PUSHD of an integer followed by BUILTIN,
+          the builtin pops the arguments.
+   load:  n_instr LDVD of an integer followed by HALT.
+   deref: n_instr LDVR of a bound symbol followed by HALT.
+
+   The dispatch variant is chosen when the library is compiled,
+   build with -DLISP_NO_THREADED_DISPATCH to measure the switch.
+   The interpreted lambdas are kept from the JIT, the JIT rows
+   run the same byte code translated by lisp_jit_compile().
+
+   usage: bench_dispatch [n_instr] [n_calls]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "core/lisp_vm.h"
+#include "core/lisp_eval.h"
+#include "core/lisp_lambda.h"
+#include "core/lisp_symbol.h"
+#include "core/lisp_asm.h"
+#include "core/lisp_jit.h"
+
+static int bench_builtin(lisp_eval_env_t     * env,
+                         const lisp_lambda_t * lambda,
+                         lisp_size_t           nargs)
+{
+  return LISP_OK;
+}
+
+/* lambda with n instructions op and a final instruction last,
+   the operands are integers or arg */
+static int make_lambda(lisp_vm_t         * vm,
+                       lisp_cell_t       * cell,
+                       lisp_size_t         n,
+                       lisp_instr_t        op,
+                       lisp_instr_t        last,
+                       const lisp_cell_t * arg)
+{
+  lisp_size_t        i;
+  lisp_size_t        size = n * (LISP_SIZ_PUSHD) + LISP_SIZ_BUILTIN;
+  lisp_byte_code_t * byte_code;
+  lisp_instr_t     * instr;
+  lisp_cell_t        value;
+  byte_code = MALLOC_VM_OBJECT(vm, sizeof(lisp_byte_code_t) + size, 1);
+  if(byte_code == NULL)
+  {
+    return LISP_ALLOC_ERROR;
+  }
+  byte_code->instr_size = size;
+  byte_code->decoded    = NULL;
+  byte_code->native     = NULL;
+  byte_code->n_calls    = 0;
+  instr = (lisp_instr_t*) &byte_code[1];
+  for(i = 0; i < n; i++)
+  {
+    if(arg != NULL)
+    {
+      value = *arg;
+    }
+    else
+    {
+      lisp_make_integer(&value, (lisp_integer_t) i);
+    }
+    LISP_SET_INSTR(op, instr, lisp_cell_t, value);
+    instr+= LISP_SIZ_PUSHD;
+  }
+  if(last == LISP_ASM_BUILTIN)
+  {
+    LISP_SET_INSTR(LISP_ASM_BUILTIN, instr,
+                   lisp_builtin_function_t, bench_builtin);
+  }
+  else
+  {
+    *instr = last;
+  }
+  if(lisp_make_cons_root_typed(vm, cell, LISP_TID_LAMBDA))
+  {
+    FREE_OBJECT(byte_code);
+    return LISP_ALLOC_ERROR;
+  }
+  LISP_CAR(cell)->type_id  = LISP_TID_OBJECT;
+  LISP_CAR(cell)->data.ptr = byte_code;
+  return LISP_OK;
+}
+
+static lisp_byte_code_t * byte_code_of(lisp_cell_t * lambda)
+{
+  return LISP_AS(LISP_CAR(lambda), lisp_byte_code_t);
+}
+
+static double seconds(clock_t a, clock_t b)
+{
+  return (double)(b - a) / CLOCKS_PER_SEC;
+}
+
+/* n_calls evaluations of lambda */
+static double run(lisp_eval_env_t * env,
+                  lisp_cell_t     * lambda,
+                  lisp_size_t       nargs,
+                  lisp_size_t       n_calls)
+{
+  lisp_size_t i;
+  clock_t     t0 = clock();
+  for(i = 0; i < n_calls; i++)
+  {
+    lisp_eval_lambda(env, LISP_AS(lambda, lisp_lambda_t), nargs);
+  }
+  return seconds(t0, clock());
+}
+
+static void report(const char * name, double t, lisp_size_t n)
+{
+  printf("%-20s %10.3f ms %8.2f ns/instr %8.2f Minstr/s\n",
+         name, t * 1e3, t * 1e9 / n, n / t * 1e-6);
+}
+
+int main(int argc, const char ** argv)
+{
+  lisp_size_t       n_instr = (argc > 1 ? strtoul(argv[1], NULL, 10) : 64);
+  lisp_size_t       n_calls = (argc > 2 ? strtoul(argv[2], NULL, 10) : 200000);
+  lisp_vm_t       * vm;
+  lisp_eval_env_t * env;
+  lisp_cell_t       push, load, deref;
+  lisp_cell_t       symbol, value;
+
+  vm  = lisp_create_vm(&lisp_vm_default_param);
+  env = (vm != NULL ? lisp_create_eval_env(vm) : NULL);
+  lisp_make_integer(&value, 1);
+  if(env == NULL ||
+     lisp_make_symbol(vm, &symbol, "a") ||
+     lisp_symbol_set(vm, LISP_AS(&symbol, lisp_symbol_t), &value) ||
+     make_lambda(vm, &push, n_instr, LISP_ASM_PUSHD, LISP_ASM_BUILTIN, 
+                 NULL) ||
+     make_lambda(vm, &load, n_instr, LISP_ASM_LDVD,  LISP_ASM_HALT, 
+                 NULL) ||
+     make_lambda(vm, &deref, n_instr, LISP_ASM_LDVR,  LISP_ASM_HALT, 
+                 &symbol))
+  {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  printf("%lu instructions, %lu calls\n",
+         (unsigned long) n_instr + 1,
+         (unsigned long) n_calls);
+
+  /* past the threshold, never promoted */
+  byte_code_of(&push)->n_calls = LISP_JIT_THRESHOLD;
+  byte_code_of(&load)->n_calls = LISP_JIT_THRESHOLD;
+  byte_code_of(&deref)->n_calls = LISP_JIT_THRESHOLD;
+  report("PUSHD / BUILTIN", 
+         run(env, &push, n_instr, n_calls), 
+         n_calls * (n_instr + 1));
+  report("LDVD / HALT", 
+         run(env, &load, 0, n_calls), 
+         n_calls * (n_instr + 1));
+  report("LDVR / HALT", 
+         run(env, &deref, 0, n_calls), 
+         n_calls * (n_instr + 1));
+
+  if(lisp_jit_compile(vm, byte_code_of(&push)) == LISP_OK &&
+     lisp_jit_compile(vm, byte_code_of(&load)) == LISP_OK &&
+     lisp_jit_compile(vm, byte_code_of(&deref)) == LISP_OK)
+  {
+    report("JIT PUSHD / BUILTIN", 
+           run(env, &push, n_instr, n_calls), 
+           n_calls * (n_instr + 1));
+    report("JIT LDVD / HALT", 
+           run(env, &load, 0, n_calls), 
+           n_calls * (n_instr + 1));
+    report("JIT LDVR / HALT", 
+           run(env, &deref, 0, n_calls), 
+           n_calls * (n_instr + 1));
+  }
+  else
+  {
+    printf("JIT unsupported\n");
+  }
+
+  lisp_unset_object_root(vm, &push);
+  lisp_unset_object_root(vm, &load);
+  lisp_unset_object_root(vm, &deref);
+  lisp_unset_object(vm, &symbol);
+  lisp_free_eval_env(env);
+  lisp_free_vm(vm);
+  return 0;
+}
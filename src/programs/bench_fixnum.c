@@ -0,0 +1,187 @@
+/* Benchmark: fixnum instructions compared with calls of builtins.
+
+   For each of +, -, * and < with two integer arguments:
+
+   instr:   the compiled call (f a b), PUSHD a; PUSHD b; op; RET
+   symbol:  the compiled call (s a b) of a symbol bound to f,
+            PUSHD a; PUSHD b; FIXR s; op; RET
+   builtin: the call through the builtin lambda as the compiler 
+            emits it for other argument counts, PUSHD a; PUSHD b; JP f
+
+   Both lambdas are kept from the JIT to measure the interpreter.
+
+   usage: bench_fixnum [n_calls]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "core/lisp_vm.h"
+#include "core/lisp_eval.h"
+#include "core/lisp_lambda.h"
+#include "core/lisp_asm.h"
+#include "core/lisp_jit.h"
+#include "core/lisp_symbol.h"
+#include "builtin/builtin_arithmetic.h"
+
+typedef int(*make_func_t)(lisp_vm_t * vm, lisp_cell_t * cell);
+
+static lisp_byte_code_t * byte_code_of(lisp_cell_t * lambda)
+{
+  return LISP_AS(LISP_CAR(lambda), lisp_byte_code_t);
+}
+
+/* PUSHD a; PUSHD b; JP 2 func */
+static int make_builtin_call(lisp_vm_t   * vm,
+                             lisp_cell_t * cell,
+                             lisp_cell_t * func,
+                             lisp_cell_t * a,
+                             lisp_cell_t * b)
+{
+  lisp_size_t        size = 2 * (LISP_SIZ_PUSHD) + LISP_SIZ_JP;
+  lisp_byte_code_t * byte_code;
+  lisp_instr_t     * instr;
+  byte_code = MALLOC_VM_OBJECT(vm, sizeof(lisp_byte_code_t) + size, 1);
+  if(byte_code == NULL)
+  {
+    return LISP_ALLOC_ERROR;
+  }
+  byte_code->instr_size = size;
+  byte_code->decoded    = NULL;
+  byte_code->native     = NULL;
+  byte_code->n_calls    = 0;
+  instr = (lisp_instr_t*) &byte_code[1];
+  LISP_SET_INSTR(LISP_ASM_PUSHD, instr, lisp_cell_t, *a);
+  instr+= LISP_SIZ_PUSHD;
+  LISP_SET_INSTR(LISP_ASM_PUSHD, instr, lisp_cell_t, *b);
+  instr+= LISP_SIZ_PUSHD;
+  LISP_SET_INSTR_2(LISP_ASM_JP, instr,
+                   lisp_size_t, 2,
+                   lisp_lambda_t*, LISP_AS(func, lisp_lambda_t));
+  if(lisp_make_cons_root_typed(vm, cell, LISP_TID_LAMBDA))
+  {
+    FREE_OBJECT(byte_code);
+    return LISP_ALLOC_ERROR;
+  }
+  LISP_CAR(cell)->type_id  = LISP_TID_OBJECT;
+  LISP_CAR(cell)->data.ptr = byte_code;
+  return LISP_OK;
+}
+
+/* (func a b) compiled as root */
+static int make_instr_call(lisp_eval_env_t * env,
+                           lisp_cell_t     * cell,
+                           lisp_cell_t     * func,
+                           lisp_cell_t     * a,
+                           lisp_cell_t     * b)
+{
+  lisp_cell_t elems[3];
+  lisp_cell_t expr;
+  lisp_cell_t lambda;
+  int         ret;
+  elems[0] = *func;
+  elems[1] = *a;
+  elems[2] = *b;
+  lisp_make_list_root(env->vm, &expr, elems, 3);
+  ret = lisp_lambda_compile(env, &lambda, &expr);
+  lisp_unset_object_root(env->vm, &expr);
+  if(ret == LISP_OK)
+  {
+    lisp_copy_object_as_root(env->vm, cell, &lambda);
+    lisp_unset_object(env->vm, &lambda);
+  }
+  return ret;
+}
+
+static double seconds(clock_t a, clock_t b)
+{
+  return (double)(b - a) / CLOCKS_PER_SEC;
+}
+
+static void run(lisp_eval_env_t * env,
+                const char      * name,
+                lisp_cell_t     * lambda,
+                lisp_size_t       n_calls)
+{
+  lisp_size_t i;
+  clock_t     t0;
+  double      t;
+  int         ret = LISP_OK;
+  byte_code_of(lambda)->n_calls = LISP_JIT_THRESHOLD;
+  t0 = clock();
+  for(i = 0; i < n_calls && ret == LISP_OK; i++)
+  {
+    lisp_push_halt(env);
+    ret = lisp_eval_lambda(env, LISP_AS(lambda, lisp_lambda_t), 0);
+    env->call_stack_top = 0;
+  }
+  t = seconds(t0, clock());
+  if(ret != LISP_OK)
+  {
+    printf("%-20s error %d\n", name, ret);
+    return;
+  }
+  printf("%-20s %10.3f ms %8.2f ns/call\n",
+         name, t * 1e3, t * 1e9 / n_calls);
+}
+
+int main(int argc, const char ** argv)
+{
+  static const struct 
+  {
+    const char  * name;
+    make_func_t   make;
+  } funcs[] =
+  {
+    { "+", lisp_make_func_plus  },
+    { "-", lisp_make_func_minus },
+    { "*", lisp_make_func_times },
+    { "<", lisp_make_func_less  }
+  };
+  lisp_size_t       n_calls = (argc > 1 ? strtoul(argv[1], NULL, 10) : 2000000);
+  lisp_vm_t       * vm;
+  lisp_eval_env_t * env;
+  lisp_cell_t       func, a, b;
+  lisp_cell_t       symbol, instr_call, symbol_call, builtin_call;
+  char              name[32];
+  size_t            i;
+
+  vm  = lisp_create_vm(&lisp_vm_default_param);
+  env = (vm != NULL ? lisp_create_eval_env(vm) : NULL);
+  if(env == NULL)
+  {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  lisp_make_integer(&a, 3);
+  lisp_make_integer(&b, 4);
+  printf("%lu calls\n", (unsigned long) n_calls);
+  for(i = 0; i < sizeof(funcs) / sizeof(funcs[0]); i++)
+  {
+    if(funcs[i].make(vm, &func) ||
+       lisp_make_symbol(vm, &symbol, funcs[i].name) ||
+       lisp_symbol_set(vm, LISP_AS(&symbol, lisp_symbol_t), &func) ||
+       make_instr_call(env, &instr_call, &func, &a, &b) ||
+       make_instr_call(env, &symbol_call, &symbol, &a, &b) ||
+       make_builtin_call(vm, &builtin_call, &func, &a, &b))
+    {
+      fprintf(stderr, "out of memory\n");
+      return 1;
+    }
+    byte_code_of(&func)->n_calls = LISP_JIT_THRESHOLD;
+    snprintf(name, sizeof(name), "instr   (%s a b)", funcs[i].name);
+    run(env, name, &instr_call, n_calls);
+    snprintf(name, sizeof(name), "symbol  (%s a b)", funcs[i].name);
+    run(env, name, &symbol_call, n_calls);
+    snprintf(name, sizeof(name), "builtin (%s a b)", funcs[i].name);
+    run(env, name, &builtin_call, n_calls);
+    lisp_unset_object_root(vm, &instr_call);
+    lisp_unset_object_root(vm, &symbol_call);
+    lisp_symbol_unset(vm, LISP_AS(&symbol, lisp_symbol_t));
+    lisp_unset_object(vm, &symbol);
+    lisp_unset_object_root(vm, &builtin_call);
+    lisp_unset_object(vm, &func);
+  }
+  lisp_free_eval_env(env);
+  lisp_free_vm(vm);
+  return 0;
+}
@@ -0,0 +1,130 @@
+/* Benchmark: pause times and throughput of lisp_gc_collect
+   with serial and parallel marking.
+
+   The heap is a reachable binary tree of n_conses conses.
+   Each round the mutator allocates n_garbage unreachable conses,
+   then lisp_gc_collect runs with the world stopped.
+
+   pause:       wall clock time of one lisp_gc_collect
+   mark:        reachable conses per second of pause
+   throughput:  conses allocated per second of mutator and pause time
+
+   usage: bench_gc_pause [n_conses] [n_garbage] [n_rounds]
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "core/lisp_vm.h"
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+/* breadth first, every new cons is reachable as soon as it is made */
+static int make_tree(lisp_vm_t   * vm,
+                     lisp_cell_t * root,
+                     lisp_size_t   n_conses)
+{
+  lisp_cons_t ** queue = malloc(sizeof(lisp_cons_t*) * n_conses);
+  lisp_size_t    head = 0, tail = 0, n = 1;
+  lisp_cell_t    left, right;
+  if(queue == NULL || lisp_make_cons_root(vm, root))
+  {
+    free(queue);
+    return LISP_ALLOC_ERROR;
+  }
+  queue[tail++] = root->data.cons;
+  while(n < n_conses)
+  {
+    left = right = lisp_nil;
+    if(lisp_make_cons(vm, &left))
+    {
+      break;
+    }
+    queue[tail++] = left.data.cons;
+    if(++n < n_conses)
+    {
+      if(lisp_make_cons(vm, &right))
+      {
+        break;
+      }
+      queue[tail++] = right.data.cons;
+      n++;
+    }
+    lisp_cons_set_car_cdr(vm, queue[head++], &left, &right);
+  }
+  free(queue);
+  return (n == n_conses ? LISP_OK : LISP_ALLOC_ERROR);
+}
+
+static int run(size_t      n_threads,
+               lisp_size_t n_conses,
+               lisp_size_t n_garbage,
+               lisp_size_t n_rounds)
+{
+  lisp_vm_param_t param = lisp_vm_default_param;
+  lisp_vm_t     * vm;
+  lisp_cell_t     root, garbage;
+  lisp_size_t     i, j;
+  double          t0, t1, pause, max_pause = 0, sum_pause = 0, total = 0;
+  param.gc_mark_threads = n_threads;
+  vm = lisp_create_vm(&param);
+  if(vm == NULL || make_tree(vm, &root, n_conses))
+  {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  lisp_gc_collect(vm);
+  for(i = 0; i < n_rounds; i++)
+  {
+    t0 = now();
+    for(j = 0; j < n_garbage; j++)
+    {
+      lisp_make_cons(vm, &garbage);
+    }
+    t1 = now();
+    lisp_gc_collect(vm);
+    pause  = now() - t1;
+    total += now() - t0;
+    sum_pause += pause;
+    if(pause > max_pause)
+    {
+      max_pause = pause;
+    }
+  }
+  printf("%2lu threads  pause %8.3f ms max %8.3f ms  "
+         "mark %8.2f Mconses/s  throughput %8.2f Mconses/s\n",
+         (unsigned long) n_threads,
+         sum_pause * 1e3 / n_rounds,
+         max_pause * 1e3,
+         (double) n_conses * n_rounds / sum_pause * 1e-6,
+         (double) n_garbage * n_rounds / total * 1e-6);
+  lisp_unset_object_root(vm, &root);
+  lisp_free_vm(vm);
+  return 0;
+}
+
+int main(int argc, const char ** argv)
+{
+  lisp_size_t n_conses  = (argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000);
+  lisp_size_t n_garbage = (argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000);
+  lisp_size_t n_rounds  = (argc > 3 ? strtoul(argv[3], NULL, 10) : 10);
+  size_t      threads[] = { 1, 2, 4, 8 };
+  size_t      i;
+  printf("%lu reachable conses, %lu garbage conses, %lu rounds\n",
+         (unsigned long) n_conses,
+         (unsigned long) n_garbage,
+         (unsigned long) n_rounds);
+  for(i = 0; i < sizeof(threads) / sizeof(threads[0]); i++)
+  {
+    if(run(threads[i], n_conses, n_garbage, n_rounds))
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
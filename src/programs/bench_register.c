@@ -0,0 +1,235 @@
+/* Benchmark: stack machine (lisp_eval_lambda) compared with
+   register code (lisp_eval_lambda_reg).
+
+   sum:     (+ 1 2 ... n_args), one call of a builtin with many
+            arguments.
+   nested:  balanced tree of (+ a b) of depth 'depth', arithmetic
+            with intermediate results.
+   chain:   L_0 = (+ 1 2), L_i = (L_i-1), calls of compiled lambdas.
+
+   Programs that the compiler of a mode does not support are reported
+   as unsupported, wrong results are reported as wrong. The register
+   evaluator uses a switch, build with -DLISP_NO_THREADED_DISPATCH for
+   the same dispatch in both modes.
+
+   usage: bench_register [n_calls] [n_args] [depth]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "core/lisp_vm.h"
+#include "core/lisp_eval.h"
+#include "core/lisp_lambda.h"
+#include "builtin/builtin_arithmetic.h"
+
+#define CHAIN_LENGTH 16
+
+typedef int(*compile_t)(lisp_eval_env_t   * env,
+                        lisp_cell_t       * cell,
+                        const lisp_cell_t * expr);
+
+typedef int(*eval_t)(lisp_eval_env_t * env,
+                     lisp_lambda_t   * lambda,
+                     lisp_size_t       nargs);
+
+/* compile expr as a root */
+static int compile_root(lisp_eval_env_t   * env,
+                        compile_t           compile,
+                        lisp_cell_t       * cell,
+                        const lisp_cell_t * expr)
+{
+  lisp_cell_t lambda;
+  int         ret = compile(env, &lambda, expr);
+  if(ret == LISP_OK)
+  {
+    lisp_copy_object_as_root(env->vm, cell, &lambda);
+    lisp_unset_object(env->vm, &lambda);
+  }
+  else
+  {
+    *cell = lisp_nil;
+  }
+  return ret;
+}
+
+/* (+ 1 2 ... n) */
+static void make_sum(lisp_vm_t   * vm,
+                     lisp_cell_t * expr,
+                     lisp_cell_t * plus,
+                     lisp_size_t   n)
+{
+  lisp_cell_t * elems = malloc(sizeof(lisp_cell_t) * (n + 1));
+  lisp_size_t   i;
+  elems[0] = *plus;
+  for(i = 1; i <= n; i++)
+  {
+    lisp_make_integer(&elems[i], (lisp_integer_t) i);
+  }
+  lisp_make_list_root(vm, expr, elems, n + 1);
+  free(elems);
+}
+
+/* (+ (+ ...) (+ ...)) */
+static void make_nested(lisp_vm_t   * vm,
+                        lisp_cell_t * expr,
+                        lisp_cell_t * plus,
+                        lisp_size_t   depth)
+{
+  lisp_cell_t elems[3];
+  if(depth == 0)
+  {
+    lisp_make_integer(expr, 1);
+    return;
+  }
+  elems[0] = *plus;
+  make_nested(vm, &elems[1], plus, depth - 1);
+  make_nested(vm, &elems[2], plus, depth - 1);
+  lisp_make_list_root(vm, expr, elems, 3);
+  lisp_unset_object_root(vm, &elems[1]);
+  lisp_unset_object_root(vm, &elems[2]);
+}
+
+/* L_0 = (+ 1 2), L_i = (L_i-1) */
+static int make_chain(lisp_eval_env_t * env,
+                      compile_t         compile,
+                      lisp_cell_t     * chain,
+                      lisp_cell_t     * plus)
+{
+  lisp_cell_t expr;
+  lisp_cell_t elems[3];
+  lisp_size_t i;
+  int         ret;
+  elems[0] = *plus;
+  lisp_make_integer(&elems[1], 1);
+  lisp_make_integer(&elems[2], 2);
+  lisp_make_list_root(env->vm, &expr, elems, 3);
+  ret = compile_root(env, compile, &chain[0], &expr);
+  lisp_unset_object_root(env->vm, &expr);
+  for(i = 1; i < CHAIN_LENGTH && ret == LISP_OK; i++)
+  {
+    lisp_make_list_root(env->vm, &expr, &chain[i - 1], 1);
+    ret = compile_root(env, compile, &chain[i], &expr);
+    lisp_unset_object_root(env->vm, &expr);
+  }
+  return ret;
+}
+
+static double seconds(clock_t a, clock_t b)
+{
+  return (double)(b - a) / CLOCKS_PER_SEC;
+}
+
+static void run(lisp_eval_env_t * env,
+                const char      * name,
+                eval_t            eval,
+                lisp_cell_t     * lambda,
+                int               compiled,
+                lisp_integer_t    expected,
+                lisp_size_t       n_calls)
+{
+  lisp_size_t i;
+  clock_t     t0;
+  double      t;
+  int         ret = LISP_OK;
+  if(compiled != LISP_OK)
+  {
+    printf("%-20s unsupported\n", name);
+    return;
+  }
+  t0 = clock();
+  for(i = 0; i < n_calls && ret == LISP_OK; i++)
+  {
+    lisp_push_halt(env);
+    ret = eval(env, LISP_AS(lambda, lisp_lambda_t), 0);
+    env->call_stack_top = 0;
+  }
+  if(ret != LISP_OK)
+  {
+    printf("%-20s error %d\n", name, ret);
+    return;
+  }
+  t = seconds(t0, clock());
+  if(env->n_values == 0 || 
+     !LISP_IS_INTEGER(env->values) || 
+     env->values->data.integer != expected)
+  {
+    printf("%-20s wrong result\n", name);
+    return;
+  }
+  printf("%-20s %10.3f ms %8.2f ns/call\n",
+         name, t * 1e3, t * 1e9 / n_calls);
+}
+
+int main(int argc, const char ** argv)
+{
+  lisp_size_t       n_calls = (argc > 1 ? strtoul(argv[1], NULL, 10) : 200000);
+  lisp_size_t       n_args  = (argc > 2 ? strtoul(argv[2], NULL, 10) : 16);
+  lisp_size_t       depth   = (argc > 3 ? strtoul(argv[3], NULL, 10) : 4);
+  lisp_vm_t       * vm;
+  lisp_eval_env_t * env;
+  lisp_cell_t       plus, sum, nested;
+  lisp_cell_t       stack_sum, reg_sum;
+  lisp_cell_t       stack_nested, reg_nested;
+  lisp_cell_t       stack_chain[CHAIN_LENGTH], reg_chain[CHAIN_LENGTH];
+  int               ret_stack_sum, ret_reg_sum;
+  int               ret_stack_nested, ret_reg_nested;
+  int               ret_stack_chain, ret_reg_chain;
+  lisp_size_t       i;
+
+  vm  = lisp_create_vm(&lisp_vm_default_param);
+  env = (vm != NULL ? lisp_create_eval_env(vm) : NULL);
+  if(env == NULL || lisp_make_func_plus(vm, &plus))
+  {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  make_sum(vm, &sum, &plus, n_args);
+  make_nested(vm, &nested, &plus, depth);
+  ret_stack_sum    = compile_root(env, lisp_lambda_compile,
+                                  &stack_sum, &sum);
+  ret_reg_sum      = compile_root(env, lisp_lambda_compile_reg,
+                                  &reg_sum, &sum);
+  ret_stack_nested = compile_root(env, lisp_lambda_compile,
+                                  &stack_nested, &nested);
+  ret_reg_nested   = compile_root(env, lisp_lambda_compile_reg,
+                                  &reg_nested, &nested);
+  ret_stack_chain  = make_chain(env, lisp_lambda_compile,
+                                stack_chain, &plus);
+  ret_reg_chain    = make_chain(env, lisp_lambda_compile_reg,
+                                reg_chain, &plus);
+  printf("%lu calls, sum of %lu arguments, nested depth %lu, "
+         "chain of %d lambdas\n",
+         (unsigned long) n_calls,
+         (unsigned long) n_args,
+         (unsigned long) depth,
+         CHAIN_LENGTH);
+
+  run(env, "stack sum",    lisp_eval_lambda,     &stack_sum,
+      ret_stack_sum, n_args * (n_args + 1) / 2, n_calls);
+  run(env, "register sum", lisp_eval_lambda_reg, &reg_sum,
+      ret_reg_sum, n_args * (n_args + 1) / 2, n_calls);
+  run(env, "stack nested", lisp_eval_lambda,     &stack_nested,
+      ret_stack_nested, 1l << depth, n_calls);
+  run(env, "register nested", lisp_eval_lambda_reg, &reg_nested,
+      ret_reg_nested, 1l << depth, n_calls);
+  run(env, "stack chain",  lisp_eval_lambda,
+      &stack_chain[CHAIN_LENGTH - 1], ret_stack_chain, 3, n_calls);
+  run(env, "register chain", lisp_eval_lambda_reg,
+      &reg_chain[CHAIN_LENGTH - 1], ret_reg_chain, 3, n_calls);
+
+  for(i = 0; i < CHAIN_LENGTH; i++)
+  {
+    lisp_unset_object_root(vm, &stack_chain[i]);
+    lisp_unset_object_root(vm, &reg_chain[i]);
+  }
+  lisp_unset_object_root(vm, &stack_sum);
+  lisp_unset_object_root(vm, &reg_sum);
+  lisp_unset_object_root(vm, &stack_nested);
+  lisp_unset_object_root(vm, &reg_nested);
+  lisp_unset_object_root(vm, &sum);
+  lisp_unset_object_root(vm, &nested);
+  lisp_unset_object(vm, &plus);
+  lisp_free_eval_env(env);
+  lisp_free_vm(vm);
+  return 0;
+}
@@ -13,6 +13,7 @@ void test_type(unit_context_t * ctx);
 void test_vm(unit_context_t * ctx);
 void test_exception(unit_context_t * ctx);
 void test_cons(unit_context_t * ctx);
+void test_gc(unit_context_t * ctx);
 void test_symbol(unit_context_t * ctx);
 void test_string(unit_context_t * ctx);
 void test_eval(unit_context_t * ctx);
@@ -40,6 +41,7 @@ int main(int argc, const char ** argv)
   test_vm(ctx);
   test_exception(ctx);
   test_cons(ctx);
+  test_gc(ctx);
   test_symbol(ctx);
   test_string(ctx);
   test_lambda(ctx);
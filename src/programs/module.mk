@@ -1,3 +1,8 @@
 SRC_MAIN+=src/programs/optimize_hash_table.c
+SRC_MAIN+=src/programs/bench_cons_color.c
+SRC_MAIN+=src/programs/bench_dispatch.c
+SRC_MAIN+=src/programs/bench_register.c
+SRC_MAIN+=src/programs/bench_fixnum.c
+SRC_MAIN+=src/programs/bench_gc_pause.c
 SRC_MAIN+=src/programs/lisp_test.c
 
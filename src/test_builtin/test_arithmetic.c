@@ -3,6 +3,12 @@
 #include "builtin/builtin_arithmetic.h"
 #include "core/lisp_eval.h"
 #include "core/lisp_lambda.h"
+#include "core/lisp_asm.h"
+#include "core/lisp_symbol.h"
+#include "core/lisp_jit.h"
+#include "test_core/context.h"
+#include "test_core/lisp_assertion.h"
+#include <limits.h>
 
 static void test_plus_empty(unit_test_t * tst)
 {
@@ -53,9 +59,562 @@ static void test_plus_int_int(unit_test_t * tst)
 }
 
 
+/* compile (func a b), check the fixnum instruction and the result,
+   expected NULL for nil */
+static void assert_fixnum_call(unit_test_t         * tst,
+                               lisp_unit_context_t * ctx,
+                               lisp_cell_t         * func,
+                               const char          * instr,
+                               lisp_integer_t        a,
+                               lisp_integer_t        b,
+                               const lisp_cell_t   * expected)
+{
+  lisp_cell_t lambda;
+  ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env,
+                                        &lambda, 
+                                        LIST(ctx, 
+                                             func,
+                                             INTEGER(ctx, a),
+                                             INTEGER(ctx, b),
+                                             NULL)));
+  ASSERT_DISASM(tst,
+                ctx,
+                &lambda,
+                NULL,
+                LIST(ctx, 
+                     SYMBOL(ctx, "PUSHD"),
+                     SYMBOL(ctx, "PUSHD"),
+                     SYMBOL(ctx, instr),
+                     SYMBOL(ctx, "RET"),
+                     NULL));
+  lisp_push_halt(ctx->env);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&lambda, lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_U(tst, ctx->env->n_values, 1u);
+  if(expected == NULL) 
+  {
+    ASSERT(tst, LISP_IS_NIL(ctx->env->values));
+  }
+  else 
+  {
+    ASSERT(tst, lisp_eq_object(ctx->env->values, expected));
+  }
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  lisp_unset_object(ctx->vm, &lambda);
+}
+
+static void test_fixnum_instr(unit_test_t * tst)
+{
+  lisp_unit_context_t * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                       tst);
+  lisp_cell_t           plus, minus, times, less;
+  lisp_cell_t           lambda;
+  ASSERT_IS_OK(tst, lisp_make_func_plus(ctx->vm, &plus));
+  ASSERT_IS_OK(tst, lisp_make_func_minus(ctx->vm, &minus));
+  ASSERT_IS_OK(tst, lisp_make_func_times(ctx->vm, &times));
+  ASSERT_IS_OK(tst, lisp_make_func_less(ctx->vm, &less));
+  assert_fixnum_call(tst, ctx, &plus,  "ADD2", 2, 3, INTEGER(ctx, 5));
+  assert_fixnum_call(tst, ctx, &minus, "SUB2", 2, 3, INTEGER(ctx, -1));
+  assert_fixnum_call(tst, ctx, &times, "MUL2", 2, 3, INTEGER(ctx, 6));
+  assert_fixnum_call(tst, ctx, &less,  "LT2",  2, 3, INTEGER(ctx, 1));
+  assert_fixnum_call(tst, ctx, &less,  "LT2",  3, 3, NULL);
+
+  /* other calls use the builtin */
+  ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env,
+                                        &lambda, 
+                                        LIST(ctx, 
+                                             &minus,
+                                             INTEGER(ctx, 10),
+                                             INTEGER(ctx, 1),
+                                             INTEGER(ctx, 2),
+                                             NULL)));
+  ASSERT_DISASM(tst,
+                ctx,
+                &lambda,
+                NULL,
+                LIST(ctx, 
+                     SYMBOL(ctx, "PUSHD"),
+                     SYMBOL(ctx, "PUSHD"),
+                     SYMBOL(ctx, "PUSHD"),
+                     SYMBOL(ctx, "JP"),
+                     NULL));
+  lisp_push_halt(ctx->env);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&lambda, lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 7);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  lisp_unset_object(ctx->vm, &lambda);
+
+  /* no integer */
+  ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env,
+                                        &lambda, 
+                                        LIST(ctx, 
+                                             &plus,
+                                             INTEGER(ctx, 1),
+                                             NIL(ctx),
+                                             NULL)));
+  lisp_push_halt(ctx->env);
+  ASSERT_EQ_I(tst, 
+              lisp_eval_lambda(ctx->env, LISP_AS(&lambda, lisp_lambda_t), 0),
+              LISP_TYPE_ERROR);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  lisp_unset_object(ctx->vm, &lambda);
+
+  lisp_unset_object(ctx->vm, &plus);
+  lisp_unset_object(ctx->vm, &minus);
+  lisp_unset_object(ctx->vm, &times);
+  lisp_unset_object(ctx->vm, &less);
+  lisp_free_unit_context(ctx);
+}
+
+/* compile (func a b), the fixnum instruction overflows */
+static void assert_fixnum_overflow(unit_test_t         * tst,
+                                   lisp_unit_context_t * ctx,
+                                   lisp_cell_t         * func,
+                                   lisp_integer_t        a,
+                                   lisp_integer_t        b)
+{
+  lisp_cell_t lambda;
+  ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env,
+                                        &lambda, 
+                                        LIST(ctx, 
+                                             func,
+                                             INTEGER(ctx, a),
+                                             INTEGER(ctx, b),
+                                             NULL)));
+  lisp_push_halt(ctx->env);
+  ASSERT_EQ_I(tst, 
+              lisp_eval_lambda(ctx->env, LISP_AS(&lambda, lisp_lambda_t), 0),
+              LISP_RANGE_ERROR);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  lisp_unset_object(ctx->vm, &lambda);
+}
+
+static void test_fixnum_instr_overflow(unit_test_t * tst)
+{
+  lisp_unit_context_t * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                       tst);
+  lisp_cell_t           plus, minus, times;
+  ASSERT_IS_OK(tst, lisp_make_func_plus(ctx->vm, &plus));
+  ASSERT_IS_OK(tst, lisp_make_func_minus(ctx->vm, &minus));
+  ASSERT_IS_OK(tst, lisp_make_func_times(ctx->vm, &times));
+  assert_fixnum_overflow(tst, ctx, &plus,  INT_MAX, 1);
+  assert_fixnum_overflow(tst, ctx, &plus,  INT_MIN, -1);
+  assert_fixnum_overflow(tst, ctx, &minus, INT_MIN, 1);
+  assert_fixnum_overflow(tst, ctx, &minus, 0, INT_MIN);
+  assert_fixnum_overflow(tst, ctx, &times, INT_MAX, 2);
+  assert_fixnum_overflow(tst, ctx, &times, INT_MIN, -1);
+  /* the limits themselves */
+  assert_fixnum_call(tst, ctx, &plus,  "ADD2", INT_MAX - 1, 1, 
+                     INTEGER(ctx, INT_MAX));
+  assert_fixnum_call(tst, ctx, &minus, "SUB2", INT_MIN + 1, 1, 
+                     INTEGER(ctx, INT_MIN));
+  lisp_unset_object(ctx->vm, &plus);
+  lisp_unset_object(ctx->vm, &minus);
+  lisp_unset_object(ctx->vm, &times);
+  lisp_free_unit_context(ctx);
+}
+
+static void test_builtin_minus_times_less(unit_test_t * tst)
+{
+  lisp_unit_context_t * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                       tst);
+  lisp_cell_t           func;
+  ASSERT_IS_OK(tst, lisp_make_func_minus(ctx->vm, &func));
+  lisp_push_integer(ctx->env, 4);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&func, lisp_lambda_t),
+                                     1));
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, -4);
+  lisp_unset_object(ctx->vm, &func);
+
+  ASSERT_IS_OK(tst, lisp_make_func_times(ctx->vm, &func));
+  lisp_push_integer(ctx->env, 2);
+  lisp_push_integer(ctx->env, 3);
+  lisp_push_integer(ctx->env, 4);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&func, lisp_lambda_t),
+                                     3));
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 24);
+  lisp_unset_object(ctx->vm, &func);
+
+  ASSERT_IS_OK(tst, lisp_make_func_less(ctx->vm, &func));
+  lisp_push_integer(ctx->env, 1);
+  lisp_push_integer(ctx->env, 2);
+  lisp_push_integer(ctx->env, 2);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&func, lisp_lambda_t),
+                                     3));
+  ASSERT(tst, LISP_IS_NIL(ctx->env->values));
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  lisp_unset_object(ctx->vm, &func);
+  lisp_free_unit_context(ctx);
+}
+
+/* compile and evaluate expr, no CALL is left on the call stack,
+   the halt entry is popped if the lambda returns */
+static void assert_eval(unit_test_t         * tst,
+                        lisp_unit_context_t * ctx,
+                        lisp_cell_t         * lambda,
+                        const lisp_cell_t   * expr,
+                        int                   expected)
+{
+  lisp_size_t call_stack_top;
+  ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env, lambda, expr));
+  lisp_push_halt(ctx->env);
+  call_stack_top = ctx->env->call_stack_top;
+  ASSERT_EQ_I(tst, 
+              lisp_eval_lambda(ctx->env, LISP_AS(lambda, lisp_lambda_t), 0),
+              expected);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  ASSERT_LE_U(tst, ctx->env->call_stack_top, call_stack_top);
+  ctx->env->call_stack_top = 1;
+}
+
+static void test_nested_calls(unit_test_t * tst)
+{
+  lisp_unit_context_t * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                       tst);
+  lisp_cell_t           plus, minus, times;
+  lisp_cell_t           inner, lambda;
+  ASSERT_IS_OK(tst, lisp_make_func_plus(ctx->vm, &plus));
+  ASSERT_IS_OK(tst, lisp_make_func_minus(ctx->vm, &minus));
+  ASSERT_IS_OK(tst, lisp_make_func_times(ctx->vm, &times));
+
+  /* (+ (* 2 3) (- 10 (+ 1 2 3)) 5) */
+  assert_eval(tst, ctx, &lambda,
+              LIST(ctx, 
+                   &plus,
+                   LIST(ctx, &times, INTEGER(ctx, 2), INTEGER(ctx, 3), NULL),
+                   LIST(ctx, &minus, 
+                        INTEGER(ctx, 10),
+                        LIST(ctx, &plus, 
+                             INTEGER(ctx, 1), 
+                             INTEGER(ctx, 2), 
+                             INTEGER(ctx, 3),
+                             NULL),
+                        NULL),
+                   INTEGER(ctx, 5),
+                   NULL),
+              LISP_OK);
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 15);
+  ASSERT_DISASM(tst,
+                ctx,
+                &lambda,
+                NULL,
+                LIST(ctx, 
+                     SYMBOL(ctx, "PUSHD"),
+                     SYMBOL(ctx, "PUSHD"),
+                     SYMBOL(ctx, "MUL2"),
+                     SYMBOL(ctx, "PUSHV"),
+                     SYMBOL(ctx, "PUSHD"),
+                     SYMBOL(ctx, "PUSHD"),
+                     SYMBOL(ctx, "PUSHD"),
+                     SYMBOL(ctx, "PUSHD"),
+                     SYMBOL(ctx, "CALL"),
+                     SYMBOL(ctx, "PUSHV"),
+                     SYMBOL(ctx, "SUB2"),
+                     SYMBOL(ctx, "PUSHV"),
+                     SYMBOL(ctx, "PUSHD"),
+                     SYMBOL(ctx, "JP"),
+                     NULL));
+  lisp_unset_object(ctx->vm, &lambda);
+
+  /* compiled lambdas return to the CALL: (* (L) (L)), L = (+ 1 2) */
+  ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env,
+                                        &inner, 
+                                        LIST(ctx, &plus, 
+                                             INTEGER(ctx, 1),
+                                             INTEGER(ctx, 2),
+                                             NULL)));
+  assert_eval(tst, ctx, &lambda,
+              LIST(ctx, 
+                   &times,
+                   LIST(ctx, &inner, NULL),
+                   LIST(ctx, &inner, NULL),
+                   NULL),
+              LISP_OK);
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 9);
+  lisp_unset_object(ctx->vm, &lambda);
+
+  /* the error of a nested call drops the pending arguments */
+  assert_eval(tst, ctx, &lambda,
+              LIST(ctx, 
+                   &plus,
+                   INTEGER(ctx, 1),
+                   LIST(ctx, &plus, 
+                        INTEGER(ctx, 1), 
+                        INTEGER(ctx, 2), 
+                        NIL(ctx),
+                        NULL),
+                   NULL),
+              LISP_TYPE_ERROR);
+  lisp_unset_object(ctx->vm, &lambda);
+
+  lisp_unset_object(ctx->vm, &inner);
+  lisp_unset_object(ctx->vm, &plus);
+  lisp_unset_object(ctx->vm, &minus);
+  lisp_unset_object(ctx->vm, &times);
+  lisp_free_unit_context(ctx);
+}
+
+/* each call returns to its slot of the decoded byte code */
+static void test_many_nested_calls(unit_test_t * tst)
+{
+  lisp_unit_context_t * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                       tst);
+  lisp_cell_t           plus, lambda;
+  lisp_cell_t         * expr = INTEGER(ctx, 0);
+  lisp_size_t           i;
+  ASSERT_IS_OK(tst, lisp_make_func_plus(ctx->vm, &plus));
+  /* (+ 1 1 (+ 1 1 ... 0)) */
+  for(i = 0; i < 100; i++) 
+  {
+    expr = LIST(ctx, &plus, INTEGER(ctx, 1), INTEGER(ctx, 1), expr, NULL);
+  }
+  assert_eval(tst, ctx, &lambda, expr, LISP_OK);
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 200);
+  lisp_unset_object(ctx->vm, &lambda);
+  lisp_unset_object(ctx->vm, &plus);
+  lisp_free_unit_context(ctx);
+}
+
+/* (+ 1 2) with the symbol + bound to the builtin */
+static void test_fixnum_instr_symbol(unit_test_t * tst)
+{
+  lisp_unit_context_t  * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                        tst);
+  lisp_symbol_t        * symbol = LISP_AS(SYMBOL(ctx, "+"), lisp_symbol_t);
+  lisp_cell_t            plus, minus, lambda;
+  lisp_decoded_instr_t * ip;
+  ASSERT_IS_OK(tst, lisp_make_func_plus(ctx->vm, &plus));
+  ASSERT_IS_OK(tst, lisp_make_func_minus(ctx->vm, &minus));
+  ASSERT_IS_OK(tst, lisp_symbol_set(ctx->vm, symbol, &plus));
+  assert_eval(tst, ctx, &lambda,
+              LIST(ctx, SYMBOL(ctx, "+"), INTEGER(ctx, 1), INTEGER(ctx, 2),
+                   NULL),
+              LISP_OK);
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 3);
+  ASSERT_DISASM(tst,
+                ctx,
+                &lambda,
+                NULL,
+                LIST(ctx, 
+                     SYMBOL(ctx, "PUSHD"),
+                     SYMBOL(ctx, "PUSHD"),
+                     SYMBOL(ctx, "FIXR"),
+                     SYMBOL(ctx, "ADD2"),
+                     SYMBOL(ctx, "RET"),
+                     NULL));
+  ip = LISP_AS(LISP_CAR(&lambda), lisp_byte_code_t)->decoded;
+  while(ip->opcode != LISP_ASM_FIXR) 
+  {
+    ip++;
+  }
+  ASSERT_EQ_U(tst, ip->fixnum, LISP_ASM_ADD2);
+
+  /* rebound to another builtin, FIXR calls it */
+  ASSERT_IS_OK(tst, lisp_symbol_set(ctx->vm, symbol, &minus));
+  lisp_push_halt(ctx->env);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&lambda, lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, -1);
+  ASSERT_EQ_U(tst, ip->fixnum, LISP_ASM_SUB2);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  ctx->env->call_stack_top = 1;
+
+  /* no lambda */
+  ASSERT_IS_OK(tst, lisp_symbol_set(ctx->vm, symbol, INTEGER(ctx, 1)));
+  lisp_push_halt(ctx->env);
+  ASSERT_EQ_I(tst, 
+              lisp_eval_lambda(ctx->env, LISP_AS(&lambda, lisp_lambda_t), 0),
+              LISP_TYPE_ERROR);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  ctx->env->call_stack_top = 1;
+
+  /* bound to the builtin again */
+  ASSERT_IS_OK(tst, lisp_symbol_set(ctx->vm, symbol, &plus));
+  lisp_push_halt(ctx->env);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&lambda, lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 3);
+  ASSERT_EQ_U(tst, ip->fixnum, LISP_ASM_ADD2);
+  ctx->env->call_stack_top = 1;
+  lisp_unset_object(ctx->vm, &lambda);
+  lisp_unset_object(ctx->vm, &plus);
+  lisp_unset_object(ctx->vm, &minus);
+  lisp_free_unit_context(ctx);
+}
+
+#ifdef LISP_JIT
+/* (add 3 4) in machine code: PUSHD 3; PUSHD 4; FIXR add; ADD2; RET */
+static void test_fixnum_instr_jit(unit_test_t * tst)
+{
+  lisp_unit_context_t * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                       tst);
+  lisp_symbol_t       * add = LISP_AS(SYMBOL(ctx, "add"), lisp_symbol_t);
+  lisp_cell_t           plus, times, lambda;
+  lisp_byte_code_t    * byte_code;
+  ASSERT_IS_OK(tst, lisp_make_func_plus(ctx->vm, &plus));
+  ASSERT_IS_OK(tst, lisp_make_func_times(ctx->vm, &times));
+  ASSERT_IS_OK(tst, lisp_symbol_set(ctx->vm, add, &plus));
+  ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env, 
+                                        &lambda,
+                                        LIST(ctx, 
+                                             SYMBOL(ctx, "add"),
+                                             INTEGER(ctx, 3),
+                                             INTEGER(ctx, 4),
+                                             NULL)));
+  byte_code = LISP_AS(LISP_CAR(&lambda), lisp_byte_code_t);
+  ASSERT_IS_OK(tst, lisp_jit_compile(ctx->vm, byte_code));
+  ASSERT_NEQ_PTR(tst, byte_code->native, NULL);
+  lisp_push_halt(ctx->env);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&lambda, lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 7);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  ctx->env->call_stack_top = 1;
+
+  /* rebound, FIXR calls the symbol and the interpreter resumes at RET */
+  ASSERT_IS_OK(tst, lisp_symbol_set(ctx->vm, add, &times));
+  lisp_push_halt(ctx->env);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&lambda, lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 12);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  ctx->env->call_stack_top = 1;
+
+  /* overflow of the fixnum instruction */
+  ASSERT_IS_OK(tst, lisp_symbol_set(ctx->vm, add, &plus));
+  ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env, 
+                                        &lambda,
+                                        LIST(ctx, 
+                                             SYMBOL(ctx, "add"),
+                                             INTEGER(ctx, INT_MAX),
+                                             INTEGER(ctx, 1),
+                                             NULL)));
+  byte_code = LISP_AS(LISP_CAR(&lambda), lisp_byte_code_t);
+  ASSERT_IS_OK(tst, lisp_jit_compile(ctx->vm, byte_code));
+  lisp_push_halt(ctx->env);
+  ASSERT_EQ_I(tst, 
+              lisp_eval_lambda(ctx->env, LISP_AS(&lambda, lisp_lambda_t), 0),
+              LISP_RANGE_ERROR);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  ctx->env->call_stack_top = 1;
+  lisp_unset_object(ctx->vm, &lambda);
+  lisp_unset_object(ctx->vm, &plus);
+  lisp_unset_object(ctx->vm, &times);
+  lisp_free_unit_context(ctx);
+}
+#endif
+
+static void test_calls_through_symbols(unit_test_t * tst)
+{
+  lisp_unit_context_t * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                       tst);
+  lisp_cell_t           plus, times;
+  lisp_cell_t           lambda;
+  lisp_symbol_t       * add = LISP_AS(SYMBOL(ctx, "add"), lisp_symbol_t);
+  ASSERT_IS_OK(tst, lisp_make_func_plus(ctx->vm, &plus));
+  ASSERT_IS_OK(tst, lisp_make_func_times(ctx->vm, &times));
+  ASSERT_IS_OK(tst, lisp_symbol_set(ctx->vm, add, &plus));
+  ASSERT_IS_OK(tst, lisp_symbol_set(ctx->vm, 
+                                    LISP_AS(SYMBOL(ctx, "x"), lisp_symbol_t),
+                                    INTEGER(ctx, 10)));
+
+  /* (+ x (add x 1)) */
+  assert_eval(tst, ctx, &lambda,
+              LIST(ctx, 
+                   &plus,
+                   SYMBOL(ctx, "x"),
+                   LIST(ctx, SYMBOL(ctx, "add"), 
+                        SYMBOL(ctx, "x"), INTEGER(ctx, 1), NULL),
+                   NULL),
+              LISP_OK);
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 21);
+  ASSERT_DISASM(tst,
+                ctx,
+                &lambda,
+                NULL,
+                LIST(ctx, 
+                     SYMBOL(ctx, "LDVR"),
+                     SYMBOL(ctx, "PUSHV"),
+                     SYMBOL(ctx, "LDVR"),
+                     SYMBOL(ctx, "PUSHV"),
+                     SYMBOL(ctx, "PUSHD"),
+                     SYMBOL(ctx, "FIXR"),
+                     SYMBOL(ctx, "ADD2"),
+                     SYMBOL(ctx, "PUSHV"),
+                     SYMBOL(ctx, "ADD2"),
+                     SYMBOL(ctx, "RET"),
+                     NULL));
+  lisp_unset_object(ctx->vm, &lambda);
+
+  /* (add 2 (add 3 4)), the fixnum instructions are guarded, 
+     the rebound symbol is called */
+  assert_eval(tst, ctx, &lambda,
+              LIST(ctx, 
+                   SYMBOL(ctx, "add"),
+                   INTEGER(ctx, 2),
+                   LIST(ctx, SYMBOL(ctx, "add"), 
+                        INTEGER(ctx, 3), INTEGER(ctx, 4), NULL),
+                   NULL),
+              LISP_OK);
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 9);
+  ASSERT_IS_OK(tst, lisp_symbol_set(ctx->vm, add, &times));
+  lisp_push_halt(ctx->env);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&lambda, lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 24);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  ctx->env->call_stack_top = 1;
+  lisp_unset_object(ctx->vm, &lambda);
+
+  /* no lambda */
+  assert_eval(tst, ctx, &lambda,
+              LIST(ctx, 
+                   &plus,
+                   INTEGER(ctx, 1),
+                   LIST(ctx, SYMBOL(ctx, "x"), INTEGER(ctx, 1), NULL),
+                   NULL),
+              LISP_TYPE_ERROR);
+  lisp_unset_object(ctx->vm, &lambda);
+
+  /* undefined */
+  assert_eval(tst, ctx, &lambda,
+              LIST(ctx, 
+                   &plus,
+                   INTEGER(ctx, 1),
+                   LIST(ctx, SYMBOL(ctx, "y"), INTEGER(ctx, 1), NULL),
+                   NULL),
+              LISP_UNDEFINED);
+  lisp_unset_object(ctx->vm, &lambda);
+
+  lisp_unset_object(ctx->vm, &plus);
+  lisp_unset_object(ctx->vm, &times);
+  lisp_free_unit_context(ctx);
+}
+
 void test_builtin_arithmetic(unit_context_t * ctx)
 {
   unit_suite_t * suite = unit_create_suite(ctx, "builtin_arithmetic");
   TEST(suite, test_plus_empty);
   TEST(suite, test_plus_int_int);
+  TEST(suite, test_fixnum_instr);
+  TEST(suite, test_fixnum_instr_overflow);
+  TEST(suite, test_builtin_minus_times_less);
+  TEST(suite, test_nested_calls);
+  TEST(suite, test_many_nested_calls);
+  TEST(suite, test_fixnum_instr_symbol);
+  TEST(suite, test_calls_through_symbols);
+#ifdef LISP_JIT
+  TEST(suite, test_fixnum_instr_jit);
+#endif
 }
@@ -46,6 +46,11 @@ void set_up_conses(unit_test_t * tst,
     vm->cons_pages = REALLOC(vm->cons_pages, 
                              sizeof(lisp_cons_t**) * (vm->n_cons_pages + 1) );
     cons = MALLOC(sizeof(lisp_cons_t) * vm->cons_page_size);
+    for(i = 0; i < vm->cons_page_size; i++) 
+    {
+      cons[i].car = lisp_nil;
+      cons[i].cdr = lisp_nil;
+    }
     vm->cons_pages[vm->n_cons_pages++] = cons;
     n = vm->root_cons_top + vm->cons_page_size;
     vm->root_cons_table = REALLOC(vm->root_cons_table,
@@ -54,6 +59,7 @@ void set_up_conses(unit_test_t * tst,
     for(i = vm->root_cons_top; i < n; i++) 
     {
       vm->root_cons_table[i].cons = &cons[j];
+      vm->root_cons_table[i].cons->gc_cons_index = i;
       vm->root_cons_table[i].ref_count = 0;
       j++;
     }  
@@ -76,6 +82,11 @@ void set_up_conses(unit_test_t * tst,
     vm->cons_pages = REALLOC(vm->cons_pages, 
                              sizeof(lisp_cons_t**) * (vm->n_cons_pages + 1) );
     cons = MALLOC(sizeof(lisp_cons_t) * vm->cons_page_size);
+    for(i = 0; i < vm->cons_page_size; i++) 
+    {
+      cons[i].car = lisp_nil;
+      cons[i].cdr = lisp_nil;
+    }
     vm->cons_pages[vm->n_cons_pages++] = cons;
     n = vm->cons_table_size + vm->cons_page_size;
     vm->cons_table = REALLOC(vm->cons_table,
@@ -84,6 +95,7 @@ void set_up_conses(unit_test_t * tst,
     for(i = vm->cons_table_size; i < n; i++) 
     {
       vm->cons_table[i] = &cons[j];
+      vm->cons_table[i]->gc_cons_index = i;
       j++;
     }  
     vm->cons_table_size = n;
@@ -200,8 +212,9 @@ int lisp_vm_check(unit_test_t * tst, lisp_vm_t * vm)
        ( i >= vm->grey_cons_begin && i < vm->white_cons_top) )
     {
       ret &= CHECK_FALSE(tst, vm->cons_table[i]->is_root);
-      ret &= CHECK_EQ_U(tst, vm->cons_table[i]->gc_cons_index, i);
     }
+    /* free conses too, pages are released by index */
+    ret &= CHECK_EQ_U(tst, vm->cons_table[i]->gc_cons_index, i);
     _check_cons_page(tst, vm->cons_table[i], vm, cons_page_counter);
     if(i < vm->black_cons_top)
     {
@@ -216,13 +229,13 @@ int lisp_vm_check(unit_test_t * tst, lisp_vm_t * vm)
     if(i < vm->root_cons_top) 
     {
       ret &= CHECK(tst, vm->root_cons_table[i].cons->is_root);
-      ret &= CHECK_EQ_U(tst, vm->root_cons_table[i].cons->gc_cons_index, i);
       ret &= CHECK(tst, 
                    _has_no_white_children(tst,
                                           vm,
                                           vm->root_cons_table[i].cons));
 
     }
+    ret &= CHECK_EQ_U(tst, vm->root_cons_table[i].cons->gc_cons_index, i);
     _check_cons_page(tst, 
                      vm->root_cons_table[i].cons, 
                      vm,
@@ -9,6 +9,7 @@ SRC_TEST+=      src/test_core/context.c\
 	        src/test_core/test_string.c\
 	        src/test_core/test_symbol.c\
 	        src/test_core/test_cons.c\
+	        src/test_core/test_gc.c\
 	        src/test_core/test_lambda.c\
 	        src/test_core/test_eval.c
 
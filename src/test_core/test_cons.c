@@ -675,6 +675,86 @@ static void test_unroot_cons_failure(unit_test_t * tst)
   memcheck_end();
 }
 
+static void test_root_cons_first_white(unit_test_t * tst) 
+{
+  /* write barrier must not move the rooted cons */
+  memcheck_begin();
+  lisp_vm_t    * vm = lisp_create_vm(&lisp_vm_default_param);
+  lisp_cell_t cons1, cons2;
+  ASSERT_FALSE(tst, lisp_make_cons(vm, &cons1));
+  ASSERT_FALSE(tst, lisp_make_cons_car_cdr(vm, &cons2, &lisp_nil, &cons1));
+  ASSERT_FALSE(tst, lisp_cons_root(vm, cons1.data.cons));
+  ASSERT_FALSE(tst, lisp_cons_unroot(vm, cons1.data.cons));
+  ASSERT_EQ_U(tst,  lisp_n_grey_cons(vm),  0u);
+  ASSERT_EQ_U(tst,  lisp_n_white_cons(vm), 1u);
+  ASSERT(tst,       lisp_vm_check(tst, vm));
+  ASSERT_FALSE(tst, lisp_cons_root(vm, cons2.data.cons));
+  ASSERT(tst,       lisp_is_root_cons(vm, &cons2));
+  ASSERT_FALSE(tst, lisp_is_white_cons(vm, &cons1));
+  ASSERT_EQ_U(tst,  lisp_root_refcount(vm, &cons2), 1u);
+  ASSERT(tst,       lisp_vm_check(tst, vm));
+  ASSERT_FALSE(tst, lisp_cons_unroot(vm, cons2.data.cons));
+  ASSERT(tst,       lisp_vm_check(tst, vm));
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+
+static void test_unroot_cons_not_last(unit_test_t * tst) 
+{
+  memcheck_begin();
+  lisp_vm_t    * vm = lisp_create_vm(&lisp_vm_default_param);
+  lisp_cell_t cons1, cons2, cons3;
+  ASSERT_FALSE(tst, lisp_make_cons_root(vm, &cons1));
+  ASSERT_FALSE(tst, lisp_make_cons_root(vm, &cons2));
+  ASSERT_FALSE(tst, lisp_make_cons_root(vm, &cons3));
+  ASSERT_FALSE(tst, lisp_cons_unroot(vm, cons1.data.cons));
+  ASSERT(tst,       lisp_is_black_cons(vm, &cons1));
+  ASSERT(tst,       lisp_is_root_cons(vm, &cons2));
+  ASSERT(tst,       lisp_is_root_cons(vm, &cons3));
+  ASSERT_EQ_U(tst,  lisp_n_root_cons(vm), 2u);
+  ASSERT_EQ_U(tst,  lisp_root_refcount(vm, &cons3), 1u);
+  ASSERT(tst,       lisp_vm_check(tst, vm));
+  ASSERT_FALSE(tst, lisp_cons_unroot(vm, cons3.data.cons));
+  ASSERT_FALSE(tst, lisp_cons_unroot(vm, cons2.data.cons));
+  ASSERT_EQ_U(tst,  lisp_n_root_cons(vm), 0u);
+  ASSERT(tst,       lisp_vm_check(tst, vm));
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+
+static void test_make_cons_root_page_end(unit_test_t * tst) 
+{
+  /* free root slots keep a zero count up to the end of the page */
+  lisp_cell_t     cons;
+  lisp_size_t     i, j;
+  memcheck_begin();
+  lisp_vm_t * vm = lisp_create_vm(&lisp_vm_default_param);
+  for(i = 0; i < vm->cons_page_size; i++) 
+  {
+    if(i % 2) 
+    {
+      ASSERT_FALSE(tst, lisp_make_cons_root_car_cdr(vm, &cons, 
+                                                    &lisp_nil, &lisp_nil));
+    }
+    else 
+    {
+      ASSERT_FALSE(tst, lisp_make_cons_root(vm, &cons));
+    }
+    ASSERT_EQ_U(tst, lisp_root_refcount(vm, &cons), 1u);
+    for(j = vm->root_cons_top; j < vm->root_cons_table_size; j++) 
+    {
+      ASSERT_EQ_U(tst, vm->root_cons_table[j].ref_count, 0u);
+    }
+  }
+  ASSERT_EQ_U(tst, vm->root_cons_top, vm->root_cons_table_size);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+
 static void test_set_car_cdr(unit_test_t * tst) 
 {
   memcheck_begin();
@@ -1029,15 +1109,82 @@ static void test_make_list_failure(unit_test_t * tst)
   lisp_make_integer(&lst[0], 1);
   lisp_make_integer(&lst[1], 2);
   lisp_make_integer(&lst[2], 3);
-  mock_register(lisp_make_cons_car_cdr, NULL, NULL, NULL);
-  mock_register(lisp_make_cons_car_cdr, 
-                lisp_mock_return_alloc_error, NULL, NULL);
-  mock_register(lisp_make_cons_car_cdr, 
-                lisp_mock_return_alloc_error, NULL, NULL);
+  /* cons table, page table, cons page */
+  memcheck_expected_alloc(1);
+  memcheck_expected_alloc(1);
+  memcheck_expected_alloc(0);
   ASSERT_EQ_I(tst, lisp_make_list(vm, &expr, lst, 3), LISP_ALLOC_ERROR);
+  ASSERT_EQ_U(tst, 0u, memcheck_retire_mocks());
+  ASSERT(tst, LISP_IS_NIL(&expr));
+  ASSERT_EQ_U(tst, lisp_n_white_cons(vm), 0u);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
 
-  ASSERT_EQ_U(tst, 1u, mock_retire(lisp_make_cons_car_cdr));
-  lisp_unset_object(vm, &expr);
+/* elements 0 .. n-1, adjacent: consecutive conses */
+static void assert_list_of_integers(unit_test_t       * tst,
+                                    const lisp_cell_t * list,
+                                    lisp_size_t         n,
+                                    int                 adjacent)
+{
+  const lisp_cell_t * cur = list;
+  lisp_size_t         i;
+  for(i = 0; i < n; i++) 
+  {
+    ASSERT(tst, LISP_IS_CONS(cur));
+    ASSERT_EQ_I(tst, LISP_CAR(cur)->data.integer, (lisp_integer_t) i);
+    if(adjacent && i + 1 < n) 
+    {
+      ASSERT(tst, LISP_CDR(cur)->data.cons == cur->data.cons + 1);
+    }
+    cur = LISP_CDR(cur);
+  }
+  ASSERT(tst, LISP_IS_NIL(cur));
+}
+
+static void test_make_list_sequential(unit_test_t * tst)
+{
+  memcheck_begin();
+  lisp_vm_param_t   param = lisp_vm_default_param;
+  lisp_vm_t       * vm;
+  lisp_cell_t       lst[200];
+  lisp_cell_t       expr;
+  lisp_size_t       i;
+  param.cons_page_size = 128;
+  vm = lisp_create_vm(&param);
+  for(i = 0; i < 200; i++) 
+  {
+    lisp_make_integer(&lst[i], i);
+  }
+  /* carved from a fresh page */
+  ASSERT_IS_OK(tst, lisp_make_list(vm, &expr, lst, 100));
+  ASSERT_EQ_U(tst, vm->n_cons_pages, 1u);
+  assert_list_of_integers(tst, &expr, 100, 1);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  /* 28 free conses left, the list takes them and a new page */
+  ASSERT_IS_OK(tst, lisp_make_list(vm, &expr, lst, 50));
+  ASSERT_EQ_U(tst, vm->n_cons_pages, 2u);
+  ASSERT_EQ_U(tst, lisp_n_white_cons(vm), 150u);
+  assert_list_of_integers(tst, &expr, 50, 0);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  /* the rest of the new page is still in address order */
+  ASSERT_IS_OK(tst, lisp_make_list(vm, &expr, lst, 20));
+  assert_list_of_integers(tst, &expr, 20, 1);
+
+  /* larger than a page */
+  ASSERT_IS_OK(tst, lisp_make_list(vm, &expr, lst, 200));
+  assert_list_of_integers(tst, &expr, 200, 0);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  /* recycled conses */
+  ASSERT_IS_OK(tst, lisp_gc_step(vm, 1));
+  ASSERT_IS_OK(tst, lisp_make_list(vm, &expr, lst, 100));
+  assert_list_of_integers(tst, &expr, 100, 0);
+  ASSERT(tst, lisp_vm_check(tst, vm));
   lisp_free_vm(vm);
   ASSERT_MEMCHECK(tst);
   memcheck_end();
@@ -1166,6 +1313,9 @@ void test_cons(unit_context_t * ctx)
   TEST(suite, test_root_cons_failure);
   TEST(suite, test_unroot_cons);
   TEST(suite, test_unroot_cons_failure);
+  TEST(suite, test_root_cons_first_white);
+  TEST(suite, test_unroot_cons_not_last);
+  TEST(suite, test_make_cons_root_page_end);
   TEST(suite, test_set_car_cdr);
   TEST(suite, test_set_car_cdr_object);
 
@@ -1178,6 +1328,7 @@ void test_cons(unit_context_t * ctx)
   TEST(suite, test_make_list_atoms);
   TEST(suite, test_make_list_symbols);
   TEST(suite, test_make_list_failure);
+  TEST(suite, test_make_list_sequential);
   TEST(suite, test_make_list_root_empty);
   TEST(suite, test_make_list_root_atoms);
   TEST(suite, test_lisp_make_list_root_typed);
@@ -19,6 +19,7 @@ static void test_create_eval_env_failure(unit_test_t * tst)
   memcheck_begin();
   lisp_eval_env_t * env;
   lisp_vm_t * vm = lisp_create_vm(&lisp_vm_default_param);
+  size_t      i, n;
   memcheck_expected_alloc(0);
   env = lisp_create_eval_env(vm);
   ASSERT_EQ_PTR(tst, env, NULL);
@@ -27,6 +28,24 @@ static void test_create_eval_env_failure(unit_test_t * tst)
   memcheck_expected_alloc(0);
   env = lisp_create_eval_env(vm);
   ASSERT_EQ_PTR(tst, env, NULL);
+
+  /* each later allocation, e.g. of the halt lambda */
+  for(n = 2; env == NULL; n++) 
+  {
+    for(i = 0; i < n; i++) 
+    {
+      memcheck_expected_alloc(1);
+    }
+    memcheck_expected_alloc(0);
+    env = lisp_create_eval_env(vm);
+    if(env == NULL) 
+    {
+      ASSERT(tst, lisp_vm_check(tst, vm));
+    }
+  }
+  ASSERT_GT_U(tst, n, 4u);
+  ASSERT_GE_U(tst, memcheck_retire_mocks(), 1u);
+  lisp_free_eval_env(env);
   
   lisp_free_vm(vm);
   ASSERT_MEMCHECK(tst);
@@ -55,6 +74,53 @@ static void test_push_integer_alloc_error(unit_test_t * tst)
   lisp_free_unit_context(ctx);
 }
 
+static void test_push_integer_mapped_stack(unit_test_t * tst) 
+{
+  lisp_vm_param_t       param = lisp_vm_default_param;
+  lisp_unit_context_t * ctx;
+  lisp_cell_t         * stack;
+  size_t i;
+  param.eval_stack_mmap = 1;
+  ctx = lisp_create_unit_context(&param, tst);
+#ifdef HAS_MMAP
+  ASSERT(tst, ctx->env->stack_mapped);
+  ASSERT_EQ_U(tst, ctx->env->stack_size, ctx->env->max_stack_size);
+  ASSERT_EQ_U(tst, ctx->env->call_stack_size, 
+              ctx->env->max_call_stack_size);
+#endif
+  stack = ctx->env->stack;
+  for(i = 0; i < ctx->env->max_stack_size; i++) 
+  {
+    ASSERT_IS_OK(tst, lisp_push_integer(ctx->env, i));
+  }
+  ASSERT_IS_STACK_OVERFLOW(tst, lisp_push_integer(ctx->env, i));
+  if(ctx->env->stack_mapped) 
+  {
+    /* the stack never moves */
+    ASSERT_EQ_PTR(tst, ctx->env->stack, stack);
+    ASSERT_EQ_I(tst, ctx->env->stack[i - 1].data.integer, 
+                (lisp_integer_t) i - 1);
+  }
+  lisp_free_unit_context(ctx);
+}
+
+static void test_push_cons_is_not_rooted(unit_test_t * tst) 
+{
+  lisp_unit_context_t * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                       tst);
+  lisp_cell_t cons;
+  lisp_size_t n_root = lisp_n_root_cons(ctx->vm);
+  ASSERT_IS_OK(tst, lisp_make_cons(ctx->vm, &cons));
+  ASSERT_IS_OK(tst, lisp_push(ctx->env, &cons));
+  ASSERT_EQ_U(tst, lisp_n_root_cons(ctx->vm), n_root);
+  ASSERT_IS_OK(tst, lisp_gc_collect(ctx->vm));
+  ASSERT_EQ_U(tst, lisp_n_white_cons(ctx->vm) + 
+                   lisp_n_grey_cons(ctx->vm) +
+                   lisp_n_black_cons(ctx->vm), 1u);
+  ASSERT(tst, ctx->env->stack[0].data.cons == cons.data.cons);
+  ASSERT(tst, lisp_vm_check(ctx->tst, ctx->vm));
+  lisp_free_unit_context(ctx);
+}
 
 void test_eval(unit_context_t * ctx)
 {
@@ -63,4 +129,6 @@ void test_eval(unit_context_t * ctx)
   TEST(suite, test_create_eval_env_failure);
   TEST(suite, test_push_integer);
   TEST(suite, test_push_integer_alloc_error);
+  TEST(suite, test_push_integer_mapped_stack);
+  TEST(suite, test_push_cons_is_not_rooted);
 }
@@ -0,0 +1,825 @@
+#include "config.h"
+#include "util/xmalloc.h"
+#include "util/unit_test.h"
+#include "core/lisp_vm.h"
+#include "core/lisp_eval.h"
+#include "core/lisp_lambda.h"
+#include "lisp_vm_check.h"
+#include "lisp_assertion.h"
+
+static void test_gc_collect_unreachable(unit_test_t * tst)
+{
+  memcheck_begin();
+  lisp_vm_t    * vm = lisp_create_vm(&lisp_vm_default_param);
+  lisp_type_id_t id = 0;
+  lisp_cell_t    obj, garbage, root, elems[2];
+  int            garbage_flags, flags[2];
+  ASSERT_IS_OK(tst, lisp_register_object_type(vm,
+                                              "TEST",
+                                              lisp_test_object_destructor,
+                                              NULL,
+                                              &id));
+  /* 1. unreachable cons holding an object */
+  ASSERT_IS_OK(tst, lisp_make_test_object(&obj, &garbage_flags, id));
+  ASSERT_IS_OK(tst, lisp_make_cons_car_cdr(vm, &garbage, &obj, &lisp_nil));
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &obj));
+
+  /* 2. rooted list holding objects */
+  ASSERT_IS_OK(tst, lisp_make_test_object(&elems[0], &flags[0], id));
+  ASSERT_IS_OK(tst, lisp_make_test_object(&elems[1], &flags[1], id));
+  ASSERT_IS_OK(tst, lisp_make_list_root(vm, &root, elems, 2));
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &elems[0]));
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &elems[1]));
+  ASSERT_EQ_U(tst, lisp_n_grey_cons(vm),  1u);
+  ASSERT_EQ_U(tst, lisp_n_white_cons(vm), 1u);
+
+  /* 3. full collection */
+  ASSERT_IS_OK(tst, lisp_gc_collect(vm));
+  ASSERT_EQ_I(tst, garbage_flags, TEST_OBJECT_STATE_FREE);
+  ASSERT_EQ_I(tst, flags[0], TEST_OBJECT_STATE_INIT);
+  ASSERT_EQ_I(tst, flags[1], TEST_OBJECT_STATE_INIT);
+  ASSERT_EQ_U(tst, lisp_n_root_cons(vm), 1u);
+  ASSERT_EQ_U(tst, lisp_n_black_cons(vm) +
+                   lisp_n_grey_cons(vm) +
+                   lisp_n_white_cons(vm), 1u);
+  ASSERT(tst, LISP_IS_CONS(LISP_CDR(&root)));
+  ASSERT_EQ_I(tst, LISP_CADR(&root)->type_id, id);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  /* 4. unroot the list */
+  ASSERT_IS_OK(tst, lisp_unset_object_root(vm, &root));
+  ASSERT_IS_OK(tst, lisp_gc_collect(vm));
+  ASSERT_EQ_I(tst, flags[0], TEST_OBJECT_STATE_FREE);
+  ASSERT_EQ_I(tst, flags[1], TEST_OBJECT_STATE_FREE);
+  ASSERT_EQ_U(tst, lisp_n_black_cons(vm) +
+                   lisp_n_grey_cons(vm) +
+                   lisp_n_white_cons(vm), 0u);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+
+static void test_gc_step_is_bounded(unit_test_t * tst)
+{
+  memcheck_begin();
+  lisp_vm_t    * vm = lisp_create_vm(&lisp_vm_default_param);
+  lisp_cell_t    root, elems[10];
+  lisp_cell_t  * rest;
+  lisp_size_t    i, n_cycles;
+  for(i = 0; i < 10; i++)
+  {
+    lisp_make_integer(&elems[i], i);
+  }
+  ASSERT_IS_OK(tst, lisp_make_list_root(vm, &root, elems, 10));
+  ASSERT_EQ_U(tst, lisp_n_grey_cons(vm),  1u);
+  ASSERT_EQ_U(tst, lisp_n_white_cons(vm), 8u);
+  n_cycles = vm->gc_n_cycles;
+
+  /* root scan greys the 2nd cons, one step blackens it
+     and greys the 3rd cons */
+  ASSERT_IS_OK(tst, lisp_gc_step(vm, 1));
+  ASSERT_EQ_U(tst, lisp_n_black_cons(vm), 1u);
+  ASSERT_EQ_U(tst, lisp_n_grey_cons(vm),  1u);
+  ASSERT_EQ_U(tst, lisp_n_white_cons(vm), 7u);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  ASSERT_IS_OK(tst, lisp_gc_step(vm, 2));
+  ASSERT_EQ_U(tst, lisp_n_black_cons(vm), 3u);
+  ASSERT_EQ_U(tst, lisp_n_grey_cons(vm),  1u);
+  ASSERT_EQ_U(tst, lisp_n_white_cons(vm), 5u);
+  ASSERT_EQ_U(tst, vm->gc_n_cycles, n_cycles);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  /* finish the cycle */
+  while(vm->gc_n_cycles == n_cycles)
+  {
+    ASSERT_IS_OK(tst, lisp_gc_step(vm, 1));
+    ASSERT(tst, lisp_vm_check(tst, vm));
+  }
+  rest = &root;
+  for(i = 0; i < 10; i++)
+  {
+    ASSERT(tst, LISP_IS_CONS(rest));
+    ASSERT_EQ_I(tst, LISP_CAR(rest)->data.integer, i);
+    rest = LISP_CDR(rest);
+  }
+  ASSERT(tst, LISP_IS_NIL(rest));
+  ASSERT_EQ_U(tst, lisp_n_black_cons(vm) +
+                   lisp_n_grey_cons(vm) +
+                   lisp_n_white_cons(vm), 9u);
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+
+static void test_gc_write_barrier(unit_test_t * tst)
+{
+  memcheck_begin();
+  lisp_vm_t    * vm = lisp_create_vm(&lisp_vm_default_param);
+  lisp_type_id_t id = 0;
+  lisp_cell_t    root, elems[3], obj, cons;
+  int            flags;
+  lisp_size_t    n_cycles;
+  ASSERT_IS_OK(tst, lisp_register_object_type(vm,
+                                              "TEST",
+                                              lisp_test_object_destructor,
+                                              NULL,
+                                              &id));
+  lisp_make_integer(&elems[0], 1);
+  lisp_make_integer(&elems[1], 2);
+  lisp_make_integer(&elems[2], 3);
+  ASSERT_IS_OK(tst, lisp_make_list_root(vm, &root, elems, 3));
+  n_cycles = vm->gc_n_cycles;
+  ASSERT_IS_OK(tst, lisp_gc_step(vm, 1));
+  ASSERT(tst, lisp_is_black_cons(vm, LISP_CDR(&root)));
+
+  /* store a new white cons into a black cons */
+  ASSERT_IS_OK(tst, lisp_make_test_object(&obj, &flags, id));
+  ASSERT_IS_OK(tst, lisp_make_cons_car_cdr(vm, &cons, &obj, &lisp_nil));
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &obj));
+  ASSERT(tst, lisp_is_white_cons(vm, &cons));
+  ASSERT_IS_OK(tst, lisp_cons_set_car_cdr(vm,
+                                          LISP_AS(LISP_CDR(&root),
+                                                  lisp_cons_t),
+                                          &cons,
+                                          NULL));
+  ASSERT(tst, lisp_is_grey_cons(vm, &cons));
+  ASSERT(tst, lisp_vm_check(tst, vm));
+  while(vm->gc_n_cycles == n_cycles)
+  {
+    ASSERT_IS_OK(tst, lisp_gc_step(vm, 1));
+  }
+  ASSERT_IS_OK(tst, lisp_gc_collect(vm));
+  ASSERT_EQ_I(tst, flags, TEST_OBJECT_STATE_INIT);
+  ASSERT_EQ_I(tst, LISP_CAR(LISP_CADR(&root))->type_id, id);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  ASSERT_EQ_I(tst, flags, TEST_OBJECT_STATE_FREE);
+  memcheck_end();
+}
+
+static void test_gc_lazy_sweep(unit_test_t * tst)
+{
+  memcheck_begin();
+  lisp_vm_t    * vm = lisp_create_vm(&lisp_vm_default_param);
+  lisp_type_id_t id = 0;
+  lisp_cell_t    obj, cons;
+  int            flags[2];
+  ASSERT_IS_OK(tst, lisp_register_object_type(vm,
+                                              "TEST",
+                                              lisp_test_object_destructor,
+                                              NULL,
+                                              &id));
+  ASSERT_IS_OK(tst, lisp_make_test_object(&obj, &flags[0], id));
+  ASSERT_IS_OK(tst, lisp_make_cons_car_cdr(vm, &cons, &obj, &lisp_nil));
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &obj));
+  ASSERT_IS_OK(tst, lisp_make_test_object(&obj, &flags[1], id));
+  ASSERT_IS_OK(tst, lisp_make_cons_car_cdr(vm, &cons, &obj, &lisp_nil));
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &obj));
+
+  /* the cycle ends without sweeping */
+  ASSERT_IS_OK(tst, lisp_gc_step(vm, 1));
+  ASSERT_EQ_U(tst, lisp_n_white_cons(vm), 0u);
+  ASSERT_EQ_U(tst, vm->sweep_cons_top, 2u);
+  ASSERT_EQ_I(tst, flags[0], TEST_OBJECT_STATE_INIT);
+  ASSERT_EQ_I(tst, flags[1], TEST_OBJECT_STATE_INIT);
+
+  /* allocation sweeps the reused cons */
+  ASSERT_IS_OK(tst, lisp_make_cons(vm, &cons));
+  ASSERT_EQ_I(tst, flags[0], TEST_OBJECT_STATE_FREE);
+  ASSERT_EQ_I(tst, flags[1], TEST_OBJECT_STATE_INIT);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  /* remaining unswept cons is released with the vm */
+  lisp_free_vm(vm);
+  ASSERT_EQ_I(tst, flags[1], TEST_OBJECT_STATE_FREE);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+
+static void test_gc_alloc_pacing(unit_test_t * tst)
+{
+  memcheck_begin();
+  lisp_vm_param_t param = lisp_vm_default_param;
+  lisp_vm_t     * vm;
+  lisp_cell_t     root, cons, elems[10];
+  lisp_size_t     i;
+  param.gc_alloc_interval  = 2;
+  param.gc_alloc_step_size = 1;
+  vm = lisp_create_vm(&param);
+  for(i = 0; i < 10; i++)
+  {
+    lisp_make_integer(&elems[i], i);
+  }
+  ASSERT_IS_OK(tst, lisp_make_list_root(vm, &root, elems, 10));
+  /* the list is unreachable until the root cons is allocated */
+  ASSERT_EQ_U(tst, lisp_n_black_cons(vm), 0u);
+  ASSERT_EQ_U(tst, lisp_n_grey_cons(vm),  1u);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  /* allocation of garbage drives the marking  */
+  for(i = 0; i < 20; i++)
+  {
+    ASSERT_IS_OK(tst, lisp_make_cons(vm, &cons));
+  }
+  ASSERT_EQ_U(tst, lisp_n_black_cons(vm), 9u);
+  ASSERT_EQ_U(tst, lisp_n_grey_cons(vm),  0u);
+  ASSERT_EQ_U(tst, lisp_n_white_cons(vm), 20u);
+  ASSERT_EQ_U(tst, vm->gc_n_cycles, 0u);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  /* end of cycle */
+  ASSERT_IS_OK(tst, lisp_gc_step(vm, 1));
+  ASSERT_EQ_U(tst, vm->gc_n_cycles, 1u);
+  ASSERT_EQ_U(tst, vm->sweep_cons_top, 29u);
+  ASSERT_EQ_U(tst, lisp_n_grey_cons(vm) + lisp_n_white_cons(vm), 9u);
+
+  /* allocation sweeps */
+  for(i = 0; i < 4; i++)
+  {
+    ASSERT_IS_OK(tst, lisp_make_cons(vm, &cons));
+  }
+  ASSERT_EQ_U(tst, vm->sweep_cons_top, 27u);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+
+static int _test_make_garbage(lisp_eval_env_t     * env,
+                              const lisp_lambda_t * lambda,
+                              lisp_size_t           nargs)
+{
+  lisp_cell_t elems[16];
+  lisp_size_t i;
+  for(i = 0; i < 16; i++)
+  {
+    lisp_make_integer(&elems[i], i);
+  }
+  for(i = 0; i < env->n_values; i++)
+  {
+    lisp_unset_object_root(env->vm, &env->values[i]);
+  }
+  env->n_values = 1;
+  return lisp_make_list_root(env->vm, env->values, elems, 16);
+}
+
+static void test_gc_alloc_safe_point(unit_test_t * tst)
+{
+  memcheck_begin();
+  lisp_vm_param_t   param = lisp_vm_default_param;
+  lisp_vm_t       * vm;
+  lisp_eval_env_t * env;
+  lisp_cell_t       func, expr, lambda;
+  lisp_size_t       i, call_stack_top, max_table_size = 0;
+  param.cons_page_size     = 64;
+  param.gc_alloc_interval  = 16;
+  param.gc_alloc_step_size = 64;
+  vm  = lisp_create_vm(&param);
+  env = lisp_create_eval_env(vm);
+  ASSERT_IS_OK(tst, lisp_make_builtin_lambda(vm, &func, 0, NULL, 
+                                             _test_make_garbage));
+  ASSERT_IS_OK(tst, lisp_make_list_root(vm, &expr, &func, 1));
+  ASSERT_IS_OK(tst, lisp_lambda_compile(env, &lambda, &expr));
+  ASSERT_IS_OK(tst, lisp_copy_object_as_root(vm, &func, &lambda));
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &lambda));
+
+  /* the cycles are ended by the evaluator, without lisp_gc_step */
+  for(i = 0; i < 20000; i++)
+  {
+    call_stack_top = env->call_stack_top;
+    lisp_push_halt(env);
+    ASSERT_IS_OK(tst, lisp_eval_lambda(env, LISP_AS(&func, lisp_lambda_t), 0));
+    env->call_stack_top = call_stack_top;
+    ASSERT_EQ_U(tst, env->n_values, 1u);
+    ASSERT(tst, LISP_IS_INTEGER(LISP_CAR(env->values)));
+    if(vm->cons_table_size > max_table_size)
+    {
+      max_table_size = vm->cons_table_size;
+    }
+  }
+  ASSERT_LE_U(tst, max_table_size, 4 * vm->cons_page_size);
+  ASSERT_GT_U(tst, vm->gc_n_cycles, 100u);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  ASSERT_IS_OK(tst, lisp_unset_object_root(vm, &func));
+  ASSERT_IS_OK(tst, lisp_unset_object_root(vm, &expr));
+  lisp_free_eval_env(env);
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+
+static void test_gc_release_pages(unit_test_t * tst)
+{
+  memcheck_begin();
+  lisp_vm_t    * vm = lisp_create_vm(&lisp_vm_default_param);
+  lisp_cell_t    root, live, cons;
+  lisp_size_t    i;
+  ASSERT_IS_OK(tst, lisp_make_cons_root(vm, &root));
+  for(i = 0; i < 1500; i++)
+  {
+    ASSERT_IS_OK(tst, lisp_make_cons(vm, &cons));
+  }
+  ASSERT_IS_OK(tst, lisp_make_cons(vm, &live));
+  ASSERT_IS_OK(tst, lisp_cons_set_car_cdr(vm, root.data.cons, NULL, &live));
+  for(i = 0; i < 1000; i++)
+  {
+    ASSERT_IS_OK(tst, lisp_make_cons(vm, &cons));
+  }
+  ASSERT_EQ_U(tst, vm->n_cons_pages, 4u);
+
+  /* pages of the root cons and the live cons are kept */
+  ASSERT_IS_OK(tst, lisp_gc_collect(vm));
+  ASSERT_EQ_U(tst, vm->n_cons_pages, 2u);
+  ASSERT_EQ_U(tst, vm->cons_table_size, vm->cons_page_size);
+  ASSERT_EQ_U(tst, vm->root_cons_table_size, vm->cons_page_size);
+  ASSERT_EQ_U(tst, lisp_n_black_cons(vm) +
+                   lisp_n_grey_cons(vm) +
+                   lisp_n_white_cons(vm), 1u);
+  ASSERT(tst, LISP_CDR(&root)->data.cons == live.data.cons);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  /* all pages are released */
+  ASSERT_IS_OK(tst, lisp_unset_object_root(vm, &root));
+  ASSERT_IS_OK(tst, lisp_gc_collect(vm));
+  ASSERT_EQ_U(tst, vm->n_cons_pages, 0u);
+  ASSERT_EQ_U(tst, vm->cons_table_size, 0u);
+  ASSERT_EQ_U(tst, vm->root_cons_table_size, 0u);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  /* pages are allocated again */
+  ASSERT_IS_OK(tst, lisp_make_cons_root(vm, &root));
+  ASSERT_IS_OK(tst, lisp_make_cons(vm, &cons));
+  ASSERT_EQ_U(tst, vm->n_cons_pages, 2u);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+  ASSERT_IS_OK(tst, lisp_unset_object_root(vm, &root));
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+
+static void test_gc_release_pages_deferred(unit_test_t * tst)
+{
+  memcheck_begin();
+  lisp_vm_param_t param = lisp_vm_default_param;
+  lisp_vm_t     * vm;
+  lisp_cell_t     cons;
+  lisp_size_t     i;
+  param.cons_page_size     = 64;
+  param.gc_alloc_interval  = 1;
+  param.gc_alloc_step_size = 1000;
+  vm = lisp_create_vm(&param);
+  for(i = 0; i < 200; i++)
+  {
+    ASSERT_IS_OK(tst, lisp_make_cons(vm, &cons));
+  }
+  ASSERT_EQ_U(tst, vm->n_cons_pages, 4u);
+  ASSERT_IS_OK(tst, lisp_gc_step(vm, 1000));
+  ASSERT_EQ_U(tst, vm->sweep_cons_top, 200u);
+
+  /* allocation sweeps, the pages are kept */
+  ASSERT_IS_OK(tst, lisp_make_cons(vm, &cons));
+  ASSERT_EQ_U(tst, vm->sweep_cons_top, 0u);
+  ASSERT(tst, vm->gc_release_pending);
+  ASSERT_EQ_U(tst, vm->n_cons_pages, 4u);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  /* released by the next steps, a step examines the pages of 
+     n_conses conses, the page of the new cons is kept */
+  ASSERT_IS_OK(tst, lisp_gc_step(vm, 0));
+  ASSERT(tst, vm->gc_release_pending);
+  ASSERT_EQ_U(tst, vm->gc_release_page, 1u);
+  ASSERT_EQ_U(tst, vm->n_cons_pages, 4u);
+  ASSERT_IS_OK(tst, lisp_gc_step(vm, 128));
+  ASSERT(tst, vm->gc_release_pending);
+  ASSERT_EQ_U(tst, vm->n_cons_pages, 2u);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+  ASSERT_IS_OK(tst, lisp_gc_step(vm, 64));
+  ASSERT_FALSE(tst, vm->gc_release_pending);
+  ASSERT_EQ_U(tst, vm->n_cons_pages, 1u);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+
+static void test_gc_cons_arena(unit_test_t * tst)
+{
+  memcheck_begin();
+  lisp_vm_param_t param = lisp_vm_default_param;
+  lisp_vm_t     * vm;
+  lisp_cell_t     root, cons;
+  lisp_size_t     i;
+  param.cons_page_size        = 64;
+  param.cons_arena_size       = 64 * 4;
+  param.cons_arena_huge_pages = 1;
+  vm = lisp_create_vm(&param);
+  ASSERT_EQ_U(tst, vm->cons_page_size, 64u);
+#ifdef HAS_MMAP
+  ASSERT(tst, vm->cons_arena != NULL);
+  ASSERT_EQ_U(tst, vm->cons_arena_n_pages, 4u);
+#endif
+  ASSERT_IS_OK(tst, lisp_make_cons_root(vm, &root));
+  /* exhaust the arena */
+  for(i = 0; i < 64 * 5; i++)
+  {
+    ASSERT_IS_OK(tst, lisp_make_cons(vm, &cons));
+  }
+  ASSERT_EQ_U(tst, vm->n_cons_pages, 6u);
+#ifdef HAS_MMAP
+  ASSERT_EQ_U(tst, vm->cons_arena_top, 4u);
+  ASSERT(tst, (char*) vm->cons_pages[0] == (char*) vm->cons_arena);
+#endif
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  /* released arena pages are reused */
+  ASSERT_IS_OK(tst, lisp_gc_collect(vm));
+  ASSERT_EQ_U(tst, vm->n_cons_pages, 1u);
+#ifdef HAS_MMAP
+  ASSERT_EQ_U(tst, vm->n_cons_arena_free_pages, 3u);
+#endif
+  for(i = 0; i < 64 * 2; i++)
+  {
+    ASSERT_IS_OK(tst, lisp_make_cons(vm, &cons));
+  }
+  ASSERT_EQ_U(tst, vm->n_cons_pages, 3u);
+#ifdef HAS_MMAP
+  ASSERT_EQ_U(tst, vm->n_cons_arena_free_pages, 1u);
+  ASSERT_EQ_U(tst, vm->cons_arena_top, 4u);
+#endif
+  ASSERT(tst, lisp_vm_check(tst, vm));
+  ASSERT_IS_OK(tst, lisp_unset_object_root(vm, &root));
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+
+static void test_gc_root_region(unit_test_t * tst)
+{
+  memcheck_begin();
+  lisp_vm_t    * vm = lisp_create_vm(&lisp_vm_default_param);
+  lisp_type_id_t id = 0;
+  lisp_cell_t    obj, cons, region_cells[2];
+  lisp_cell_t  * region = region_cells;
+  lisp_size_t    n_region = 0;
+  int            flags[2];
+  ASSERT_IS_OK(tst, lisp_register_object_type(vm,
+                                              "TEST",
+                                              lisp_test_object_destructor,
+                                              NULL,
+                                              &id));
+  ASSERT_IS_OK(tst, lisp_register_root_region(vm, &region, &n_region));
+
+  /* cons in the region survives without entering the root set */
+  ASSERT_IS_OK(tst, lisp_make_test_object(&obj, &flags[0], id));
+  ASSERT_IS_OK(tst, lisp_make_cons_car_cdr(vm, &cons, &obj, &lisp_nil));
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &obj));
+  ASSERT_IS_OK(tst, lisp_copy_object_as_region_root(vm, &region[n_region++],
+                                                    &cons));
+  ASSERT_EQ_U(tst, lisp_n_root_cons(vm), 0u);
+  ASSERT_IS_OK(tst, lisp_gc_collect(vm));
+  ASSERT_EQ_I(tst, flags[0], TEST_OBJECT_STATE_INIT);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  /* stored after the region has been scanned: write barrier */
+  ASSERT_IS_OK(tst, lisp_make_test_object(&obj, &flags[1], id));
+  ASSERT_IS_OK(tst, lisp_make_cons_car_cdr(vm, &cons, &obj, &lisp_nil));
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &obj));
+  ASSERT_IS_OK(tst, lisp_copy_object_as_region_root(vm, &region[n_region++],
+                                                    &cons));
+  ASSERT_EQ_U(tst, lisp_n_white_cons(vm), 0u);
+  ASSERT_IS_OK(tst, lisp_gc_collect(vm));
+  ASSERT_EQ_I(tst, flags[1], TEST_OBJECT_STATE_INIT);
+  ASSERT_EQ_U(tst, lisp_n_root_cons(vm), 0u);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  /* popped conses are collected */
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &region[--n_region]));
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &region[--n_region]));
+  ASSERT_IS_OK(tst, lisp_gc_collect(vm));
+  ASSERT_EQ_I(tst, flags[0], TEST_OBJECT_STATE_FREE);
+  ASSERT_EQ_I(tst, flags[1], TEST_OBJECT_STATE_FREE);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  lisp_unregister_root_region(vm, &region);
+  ASSERT_EQ_U(tst, vm->n_root_regions, 0u);
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+
+static void test_gc_minor(unit_test_t * tst)
+{
+  memcheck_begin();
+  lisp_vm_param_t param = lisp_vm_default_param;
+  lisp_vm_t     * vm;
+  lisp_type_id_t  id = 0;
+  lisp_cell_t     root, old, young, list, obj, elems[3];
+  int             flags[3], garbage_flags[2];
+  lisp_size_t     n_conses;
+  param.gc_generational = 1;
+  vm = lisp_create_vm(&param);
+  ASSERT_IS_OK(tst, lisp_register_object_type(vm,
+                                              "TEST",
+                                              lisp_test_object_destructor,
+                                              NULL,
+                                              &id));
+  ASSERT_IS_OK(tst, lisp_make_cons_root(vm, &root));
+  ASSERT_EQ_U(tst, vm->gc_nursery_top, 0u);
+
+  /* 1. promote a cons reachable from the root */
+  ASSERT_IS_OK(tst, lisp_make_cons(vm, &old));
+  ASSERT_IS_OK(tst, lisp_cons_set_car_cdr(vm, root.data.cons, &old, NULL));
+  ASSERT_EQ_U(tst, vm->gc_nursery_top, 1u);
+  ASSERT_IS_OK(tst, lisp_gc_minor(vm));
+  ASSERT_FALSE(tst, old.data.cons->gc_young);
+  ASSERT_EQ_U(tst, vm->gc_nursery_top, 0u);
+
+  /* 2. young conses reachable from the remembered set 
+        and garbage in different colours */
+  ASSERT_IS_OK(tst, lisp_make_test_object(&elems[0], &flags[0], id));
+  ASSERT_IS_OK(tst, lisp_make_test_object(&elems[1], &flags[1], id));
+  ASSERT_IS_OK(tst, lisp_make_list(vm, &list, elems, 2));
+  ASSERT_IS_OK(tst, lisp_cons_set_car_cdr(vm, root.data.cons, NULL, &list));
+  ASSERT_IS_OK(tst, lisp_make_test_object(&elems[2], &flags[2], id));
+  ASSERT_IS_OK(tst, lisp_make_cons_car_cdr(vm, &young, &elems[2], &lisp_nil));
+  ASSERT_IS_OK(tst, lisp_cons_set_car_cdr(vm, old.data.cons, &young, NULL));
+  ASSERT(tst, old.data.cons->gc_remembered);
+  ASSERT_EQ_U(tst, vm->gc_remembered_top, 1u);
+  ASSERT_IS_OK(tst, lisp_make_test_object(&obj, &garbage_flags[0], id));
+  ASSERT_IS_OK(tst, lisp_make_cons_car_cdr(vm, &young, &obj, &lisp_nil));
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &obj));
+  /* black and grey list */
+  ASSERT_IS_OK(tst, lisp_gc_step(vm, 2));
+  ASSERT_EQ_U(tst, lisp_n_black_cons(vm), 2u);
+  ASSERT_EQ_U(tst, lisp_n_grey_cons(vm),  2u);
+  ASSERT_IS_OK(tst, lisp_cons_set_car_cdr(vm, root.data.cons, NULL, &lisp_nil));
+  ASSERT_IS_OK(tst, lisp_make_test_object(&obj, &garbage_flags[1], id));
+  ASSERT_IS_OK(tst, lisp_make_list(vm, &young, &obj, 1));
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &obj));
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &elems[0]));
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &elems[1]));
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &elems[2]));
+  ASSERT_EQ_U(tst, vm->gc_nursery_top, 5u);
+  n_conses = lisp_n_black_cons(vm) + lisp_n_grey_cons(vm) + 
+    lisp_n_white_cons(vm);
+
+  ASSERT_IS_OK(tst, lisp_gc_minor(vm));
+  ASSERT_EQ_I(tst, garbage_flags[0], TEST_OBJECT_STATE_FREE);
+  ASSERT_EQ_I(tst, garbage_flags[1], TEST_OBJECT_STATE_FREE);
+  ASSERT_EQ_I(tst, flags[0], TEST_OBJECT_STATE_FREE);
+  ASSERT_EQ_I(tst, flags[1], TEST_OBJECT_STATE_FREE);
+  ASSERT_EQ_I(tst, flags[2], TEST_OBJECT_STATE_INIT);
+  ASSERT_EQ_U(tst, lisp_n_black_cons(vm) + lisp_n_grey_cons(vm) + 
+              lisp_n_white_cons(vm), n_conses - 4);
+  ASSERT_EQ_U(tst, lisp_n_black_cons(vm), 1u);
+  ASSERT_EQ_U(tst, lisp_n_grey_cons(vm),  1u);
+  ASSERT_FALSE(tst, old.data.cons->gc_remembered);
+  ASSERT_EQ_U(tst, vm->gc_remembered_top, 0u);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  /* 3. promoted conses are left to full cycles */
+  ASSERT_IS_OK(tst, lisp_cons_set_car_cdr(vm, old.data.cons, &lisp_nil, NULL));
+  ASSERT_IS_OK(tst, lisp_gc_minor(vm));
+  ASSERT_EQ_I(tst, flags[2], TEST_OBJECT_STATE_INIT);
+  ASSERT_IS_OK(tst, lisp_gc_collect(vm));
+  ASSERT_EQ_I(tst, flags[2], TEST_OBJECT_STATE_FREE);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  ASSERT_IS_OK(tst, lisp_unset_object_root(vm, &root));
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+
+static void test_gc_compact(unit_test_t * tst)
+{
+  memcheck_begin();
+  lisp_vm_param_t param = lisp_vm_default_param;
+  lisp_vm_t     * vm;
+  lisp_type_id_t  id = 0;
+  lisp_cell_t     root, obj, cons, pinned, rest;
+  lisp_cell_t     kept[8];
+  int             flags[8];
+  lisp_cons_t   * pinned_cons;
+  lisp_size_t     i, n_pages;
+  param.cons_page_size = 16;
+  vm = lisp_create_vm(&param);
+  ASSERT_IS_OK(tst, lisp_register_object_type(vm,
+                                              "TEST",
+                                              lisp_test_object_destructor,
+                                              NULL,
+                                              &id));
+  ASSERT_IS_OK(tst, lisp_make_cons_root(vm, &root));
+  /* every 8th cons survives */
+  for(i = 0; i < 64; i++) 
+  {
+    if(i % 8 == 0) 
+    {
+      ASSERT_IS_OK(tst, lisp_make_test_object(&obj, &flags[i / 8], id));
+      ASSERT_IS_OK(tst, lisp_make_cons_car_cdr(vm, &kept[i / 8], 
+                                               &obj, &lisp_nil));
+      ASSERT_IS_OK(tst, lisp_unset_object(vm, &obj));
+    }
+    else 
+    {
+      ASSERT_IS_OK(tst, lisp_make_cons(vm, &cons));
+    }
+  }
+  for(i = 7; i > 0; i--) 
+  {
+    ASSERT_IS_OK(tst, lisp_cons_set_car_cdr(vm, kept[i - 1].data.cons, 
+                                            NULL, &kept[i]));
+  }
+  /* a lambda typed cell pins its cons */
+  ASSERT_IS_OK(tst, lisp_make_cons_typed(vm, &pinned, LISP_TID_LAMBDA));
+  pinned_cons = pinned.data.cons;
+  ASSERT_IS_OK(tst, lisp_cons_set_car_cdr(vm, root.data.cons, 
+                                          &kept[0], &pinned));
+  ASSERT_IS_OK(tst, lisp_gc_collect(vm));
+  n_pages = vm->n_cons_pages;
+  ASSERT_GT_U(tst, n_pages, 3u);
+
+  ASSERT_IS_OK(tst, lisp_gc_compact(vm));
+  ASSERT_LT_U(tst, vm->n_cons_pages, n_pages);
+  ASSERT(tst, LISP_CDR(&root)->data.cons == pinned_cons);
+  rest = *LISP_CAR(&root);
+  for(i = 0; i < 8; i++) 
+  {
+    ASSERT(tst, LISP_IS_CONS(&rest));
+    ASSERT_EQ_I(tst, LISP_CAR(&rest)->type_id, id);
+    ASSERT_EQ_I(tst, flags[i], TEST_OBJECT_STATE_INIT);
+    rest = *LISP_CDR(&rest);
+  }
+  ASSERT(tst, LISP_IS_NIL(&rest));
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  ASSERT_IS_OK(tst, lisp_cons_set_car_cdr(vm, root.data.cons, 
+                                          &lisp_nil, NULL));
+  ASSERT_IS_OK(tst, lisp_gc_collect(vm));
+  for(i = 0; i < 8; i++) 
+  {
+    ASSERT_EQ_I(tst, flags[i], TEST_OBJECT_STATE_FREE);
+  }
+  ASSERT_IS_OK(tst, lisp_unset_object_root(vm, &root));
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+
+static void test_gc_parallel_mark(unit_test_t * tst)
+{
+  memcheck_begin();
+  lisp_vm_param_t param = lisp_vm_default_param;
+  lisp_vm_t     * vm;
+  lisp_type_id_t  id = 0;
+  lisp_cell_t     root, list, sub, obj, garbage, elems[3];
+  lisp_cell_t     region_cells[1];
+  lisp_cell_t   * region = region_cells;
+  lisp_size_t     n_region = 0;
+  int             flags[2];
+  lisp_size_t     i;
+  param.gc_mark_threads = 4;
+  vm = lisp_create_vm(&param);
+  ASSERT_IS_OK(tst, lisp_register_object_type(vm,
+                                              "TEST",
+                                              lisp_test_object_destructor,
+                                              NULL,
+                                              &id));
+  ASSERT_IS_OK(tst, lisp_register_root_region(vm, &region, &n_region));
+  ASSERT_IS_OK(tst, lisp_make_cons_root(vm, &root));
+
+  /* 2000 conses with sublists of 3 conses and garbage in between */
+  list = lisp_nil;
+  elems[0] = elems[1] = elems[2] = lisp_nil;
+  for(i = 0; i < 2000; i++) 
+  {
+    ASSERT_IS_OK(tst, lisp_make_list(vm, &sub, elems, 3));
+    ASSERT_IS_OK(tst, lisp_make_cons_car_cdr(vm, &list, &sub, &list));
+    ASSERT_IS_OK(tst, lisp_make_cons(vm, &garbage));
+  }
+  ASSERT_IS_OK(tst, lisp_cons_set_car_cdr(vm, root.data.cons, &list, NULL));
+  ASSERT_IS_OK(tst, lisp_make_test_object(&obj, &flags[0], id));
+  ASSERT_IS_OK(tst, lisp_make_cons_car_cdr(vm, &garbage, &obj, &lisp_nil));
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &obj));
+  ASSERT_IS_OK(tst, lisp_make_test_object(&obj, &flags[1], id));
+  ASSERT_IS_OK(tst, lisp_make_cons_car_cdr(vm, &sub, &obj, &lisp_nil));
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &obj));
+  ASSERT_IS_OK(tst, lisp_copy_object_as_region_root(vm, &region[n_region++],
+                                                    &sub));
+
+  ASSERT_IS_OK(tst, lisp_gc_collect(vm));
+  ASSERT_EQ_I(tst, flags[0], TEST_OBJECT_STATE_FREE);
+  ASSERT_EQ_I(tst, flags[1], TEST_OBJECT_STATE_INIT);
+  ASSERT_EQ_U(tst, lisp_n_black_cons(vm) + lisp_n_grey_cons(vm) + 
+              lisp_n_white_cons(vm), 2000u * 4u + 1u);
+  ASSERT_EQ_U(tst, lisp_n_grey_cons(vm), 2u);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  /* the collector continues incrementally */
+  ASSERT_IS_OK(tst, lisp_gc_step(vm, 1));
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &region[--n_region]));
+  ASSERT_IS_OK(tst, lisp_cons_set_car_cdr(vm, root.data.cons, &lisp_nil, NULL));
+  ASSERT_IS_OK(tst, lisp_gc_collect(vm));
+  ASSERT_EQ_I(tst, flags[1], TEST_OBJECT_STATE_FREE);
+  ASSERT_EQ_U(tst, lisp_n_black_cons(vm) + lisp_n_grey_cons(vm) + 
+              lisp_n_white_cons(vm), 0u);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  ASSERT_IS_OK(tst, lisp_unset_object_root(vm, &root));
+  lisp_unregister_root_region(vm, &region);
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+
+static void test_gc_background_sweep(unit_test_t * tst)
+{
+  memcheck_begin();
+  lisp_vm_param_t param = lisp_vm_default_param;
+  lisp_vm_t     * vm;
+  lisp_type_id_t  id = 0;
+  lisp_cell_t     root, list, elems[1000];
+  int             flags[2];
+  lisp_size_t     i;
+  lisp_memory_usage_t before, usage;
+  param.cons_page_size      = 64;
+  param.gc_background_sweep = 1;
+  vm = lisp_create_vm(&param);
+#ifdef HAS_PTHREAD
+  ASSERT(tst, vm->gc_sweeper != NULL);
+#endif
+  ASSERT_IS_OK(tst, lisp_register_object_type(vm,
+                                              "TEST",
+                                              lisp_test_object_destructor,
+                                              NULL,
+                                              &id));
+  for(i = 0; i < 1000; i++) 
+  {
+    elems[i] = lisp_nil;
+  }
+  /* live and dead lists */
+  ASSERT_IS_OK(tst, lisp_make_test_object(&elems[0], &flags[0], id));
+  ASSERT_IS_OK(tst, lisp_make_list_root(vm, &root, elems, 10));
+  ASSERT_IS_OK(tst, lisp_unset_object(vm, &elems[0]));
+  lisp_get_memory_usage(vm, &before);
+  ASSERT_IS_OK(tst, lisp_make_test_object(&elems[0], &flags[1], id));
+  for(i = 1; i < 100; i++) 
+  {
+    ASSERT_IS_OK(tst, lisp_make_string(vm, &elems[i], "dead"));
+  }
+  ASSERT_IS_OK(tst, lisp_make_list(vm, &list, elems, 1000));
+  for(i = 0; i < 100; i++) 
+  {
+    ASSERT_IS_OK(tst, lisp_unset_object(vm, &elems[i]));
+  }
+
+  /* the dead list is lent to the sweeper at the end of the cycle */
+  ASSERT_IS_OK(tst, lisp_gc_step(vm, 2000));
+#ifdef HAS_PTHREAD
+  ASSERT_EQ_U(tst, vm->gc_sweep_lent, 1000u);
+  ASSERT_EQ_U(tst, vm->sweep_cons_top, vm->white_cons_top);
+  /* object cells are released when the conses are taken back */
+  ASSERT_EQ_I(tst, flags[1], TEST_OBJECT_STATE_INIT);
+#endif
+
+  ASSERT_IS_OK(tst, lisp_gc_collect(vm));
+  ASSERT_EQ_U(tst, vm->gc_sweep_lent, 0u);
+  ASSERT_EQ_I(tst, flags[0], TEST_OBJECT_STATE_INIT);
+  ASSERT_EQ_I(tst, flags[1], TEST_OBJECT_STATE_FREE);
+  /* the strings have been released by the sweeper */
+  lisp_get_memory_usage(vm, &usage);
+  ASSERT_EQ_U(tst, usage.objects, before.objects);
+  ASSERT_EQ_U(tst, lisp_n_black_cons(vm) + lisp_n_grey_cons(vm) + 
+              lisp_n_white_cons(vm), 9u);
+  ASSERT_LE_U(tst, vm->n_cons_pages, 2u);
+  ASSERT(tst, lisp_vm_check(tst, vm));
+
+  ASSERT_IS_OK(tst, lisp_unset_object_root(vm, &root));
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+
+void test_gc(unit_context_t * ctx)
+{
+  unit_suite_t * suite = unit_create_suite(ctx, "gc");
+  TEST(suite, test_gc_collect_unreachable);
+  TEST(suite, test_gc_step_is_bounded);
+  TEST(suite, test_gc_write_barrier);
+  TEST(suite, test_gc_lazy_sweep);
+  TEST(suite, test_gc_alloc_pacing);
+  TEST(suite, test_gc_alloc_safe_point);
+  TEST(suite, test_gc_release_pages);
+  TEST(suite, test_gc_release_pages_deferred);
+  TEST(suite, test_gc_cons_arena);
+  TEST(suite, test_gc_root_region);
+  TEST(suite, test_gc_minor);
+  TEST(suite, test_gc_compact);
+  TEST(suite, test_gc_parallel_mark);
+  TEST(suite, test_gc_background_sweep);
+}
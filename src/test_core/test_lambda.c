@@ -6,6 +6,8 @@
 #include "core/lisp_symbol.h"
 #include "core/lisp_exception.h"
 #include "core/lisp_lambda.h"
+#include "core/lisp_asm.h"
+#include "core/lisp_jit.h"
 #include "test_core/lisp_assertion.h"
 #include "test_core/lisp_compile_mock.h"
 #include "test_core/context.h"
@@ -160,6 +162,45 @@ static void test_lambda_compile_atom(unit_test_t * tst)
   lisp_free_unit_context(ctx);
 }
 
+static void test_lambda_decoded_instr(unit_test_t * tst)
+{
+  lisp_unit_context_t  * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                        tst);
+  lisp_cell_t            lambda;
+  lisp_byte_code_t     * byte_code;
+  lisp_decoded_instr_t * ip;
+  ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env, &lambda,
+                                        INTEGER(ctx, 1)));
+  byte_code = LISP_AS(LISP_CAR(&lambda), lisp_byte_code_t);
+  ASSERT_EQ_PTR(tst, byte_code->decoded, NULL);
+  ASSERT_IS_OK(tst,
+               lisp_eval_lambda(ctx->env, 
+                                LISP_AS(&lambda, lisp_lambda_t),
+                                0));
+  /* decoded by the first call: LDVD 1; RET fused, end */
+  ip = byte_code->decoded;
+  ASSERT_NEQ_PTR(tst, ip, NULL);
+  ASSERT_EQ_U(tst, ip[0].opcode, LISP_ASM_LDVD_RET);
+  ASSERT_EQ_U(tst, ip[0].offset, 0u);
+  ASSERT(tst, lisp_eq_object(&ip[0].arg.cell, INTEGER(ctx, 1)));
+  ASSERT_EQ_U(tst, ip[1].opcode, 0u);
+  ASSERT_EQ_U(tst, ip[1].offset, byte_code->instr_size);
+  ASSERT_EQ_U(tst, ctx->env->n_values, 1u);
+  ASSERT(tst,      LISP_IS_INTEGER(ctx->env->values));
+
+  /* unknown opcodes end the decoded instructions */
+  ((lisp_instr_t*) &byte_code[1])[LISP_SIZ_LDVD] = 0xff;
+  FREE_OBJECT(byte_code->decoded);
+  byte_code->decoded = NULL;
+  ASSERT_IS_UNSUPPORTED(tst,
+                        lisp_eval_lambda(ctx->env, 
+                                         LISP_AS(&lambda, lisp_lambda_t),
+                                         0));
+  ASSERT_EQ_U(tst, byte_code->decoded[1].opcode, 0xffu);
+  ASSERT_EQ_U(tst, byte_code->decoded[2].opcode, 0u);
+  lisp_free_unit_context(ctx);
+}
+
 static void test_lambda_compile_atom_object(unit_test_t * tst)
 {
   lisp_unit_context_t * ctx = lisp_create_unit_context(&lisp_vm_default_param,
@@ -262,12 +303,65 @@ static void test_lambda_compile_symbol_undefined(unit_test_t * tst)
   lisp_free_unit_context(ctx);
 }
 
+static void test_lambda_ldvr_cache(unit_test_t * tst)
+{
+  lisp_unit_context_t  * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                        tst);
+  lisp_symbol_t        * symbol = LISP_AS(SYMBOL(ctx, "a"), lisp_symbol_t);
+  lisp_cell_t            lambda;
+  lisp_decoded_instr_t * ip;
+  lisp_size_t            epoch;
+  lisp_symbol_set(ctx->vm, symbol, INTEGER(ctx, 1));
+  ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env, 
+                                        &lambda,
+                                        SYMBOL(ctx, "a")));
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env, 
+                                     LISP_AS(&lambda, lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 1);
+  ip = LISP_AS(LISP_CAR(&lambda), lisp_byte_code_t)->decoded;
+  ASSERT_EQ_U(tst, ip->opcode, LISP_ASM_LDVR_RET);
+  ASSERT_EQ_U(tst, ip->arg.ldvr.epoch, ctx->vm->symbol_epoch);
+  ASSERT_EQ_PTR(tst, ip->arg.ldvr.binding, lisp_symbol_get(ctx->vm, symbol));
+
+  /* a new value of a bound symbol keeps the cache */
+  epoch = ctx->vm->symbol_epoch;
+  lisp_symbol_set(ctx->vm, symbol, INTEGER(ctx, 2));
+  ASSERT_EQ_U(tst, ctx->vm->symbol_epoch, epoch);
+  lisp_push_halt(ctx->env);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env, 
+                                     LISP_AS(&lambda, lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 2);
+
+  /* unset and set invalidate it */
+  lisp_symbol_unset(ctx->vm, symbol);
+  ASSERT_NEQ_U(tst, ctx->vm->symbol_epoch, epoch);
+  lisp_push_halt(ctx->env);
+  ASSERT_IS_UNDEFINED(tst, lisp_eval_lambda(ctx->env, 
+                                            LISP_AS(&lambda, lisp_lambda_t),
+                                            0));
+  epoch = ctx->vm->symbol_epoch;
+  lisp_symbol_set(ctx->vm, symbol, INTEGER(ctx, 3));
+  ASSERT_NEQ_U(tst, ctx->vm->symbol_epoch, epoch);
+  ctx->env->call_stack_top = 0;
+  lisp_push_halt(ctx->env);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env, 
+                                     LISP_AS(&lambda, lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 3);
+  ASSERT_EQ_PTR(tst, ip->arg.ldvr.binding, lisp_symbol_get(ctx->vm, symbol));
+  lisp_unset_object(ctx->vm, &lambda);
+  lisp_free_unit_context(ctx);
+}
+
 static void test_compile_cons_builtin_arg_arg(unit_test_t * tst) 
 {
-  lisp_unit_context_t * ctx = lisp_create_unit_context(&lisp_vm_default_param,
-                                                       tst);
-  lisp_lambda_mock_t  mock;
-  lisp_cell_t         lambda;
+  lisp_unit_context_t  * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                        tst);
+  lisp_lambda_mock_t     mock;
+  lisp_cell_t            lambda;
+  lisp_decoded_instr_t * ip;
   ASSERT_IS_OK(tst,
                lisp_lambda_compile(ctx->env,
                                    &lambda, 
@@ -294,6 +388,15 @@ static void test_compile_cons_builtin_arg_arg(unit_test_t * tst)
                                      LISP_AS(&lambda, lisp_lambda_t),
                                      0));
 
+  /* PUSHD 1; PUSHD 2; JP decoded as one superinstruction */
+  ip = LISP_AS(LISP_CAR(&lambda), lisp_byte_code_t)->decoded;
+  ASSERT_EQ_U(tst, ip[0].opcode, LISP_ASM_PUSHDN_JP);
+  ASSERT_EQ_U(tst, ip[0].arg.jp.n_push, 2u);
+  ASSERT_EQ_U(tst, ip[0].arg.jp.nargs,  2u);
+  ASSERT(tst, lisp_eq_object(&ip[1].arg.cell, INTEGER(ctx, 1)));
+  ASSERT(tst, lisp_eq_object(&ip[2].arg.cell, INTEGER(ctx, 2)));
+  ASSERT_EQ_U(tst, ip[3].opcode, 0u);
+
   /* test call */
   ASSERT_EQ_U(tst, mock.n_args, 2);
   ASSERT(tst, lisp_eq_object(&mock.args[0], INTEGER(ctx, 1)));
@@ -311,6 +414,397 @@ static void test_compile_cons_builtin_arg_arg(unit_test_t * tst)
   lisp_free_unit_context(ctx);
 }
 
+static void test_lambda_compile_reg(unit_test_t * tst) 
+{
+  lisp_unit_context_t  * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                        tst);
+  lisp_lambda_mock_t     inner, outer;
+  lisp_cell_t            lambda;
+  lisp_cell_t          * builtin = BUILTIN(ctx,
+                                           lisp_lambda_mock_function,
+                                           NULL);
+  ASSERT_IS_OK(tst,
+               lisp_lambda_compile_reg(ctx->env,
+                                       &lambda, 
+                                       LIST(ctx, 
+                                            builtin,
+                                            INTEGER(ctx, 1),
+                                            LIST(ctx,
+                                                 builtin,
+                                                 INTEGER(ctx, 2),
+                                                 INTEGER(ctx, 3),
+                                                 NULL),
+                                            NULL)));
+  ASSERT_DISASM(tst,
+                ctx,
+                &lambda,
+                NULL,
+                LIST(ctx, 
+                     SYMBOL(ctx, "RFRAME"),
+                     SYMBOL(ctx, "RMOVD"),
+                     SYMBOL(ctx, "RMOVD"),
+                     SYMBOL(ctx, "RMOVD"),
+                     SYMBOL(ctx, "RCALL"),
+                     SYMBOL(ctx, "RCALL"),
+                     SYMBOL(ctx, "RRET"),
+                     NULL));
+  lisp_init_lambda_mock(&inner, ctx->vm, 1);
+  lisp_init_lambda_mock(&outer, ctx->vm, 1);
+  lisp_make_integer(&inner.values[0], 5);
+  lisp_make_integer(&outer.values[0], 23);
+  mock_register(lisp_lambda_mock_function, NULL, &inner, NULL);
+  mock_register(lisp_lambda_mock_function, NULL, &outer, NULL);
+  ASSERT_IS_OK(tst, lisp_eval_lambda_reg(ctx->env,
+                                         LISP_AS(&lambda, lisp_lambda_t),
+                                         0));
+  /* (+ 2 3) is passed to the outer call */
+  ASSERT_EQ_U(tst, inner.n_args, 2);
+  ASSERT(tst, lisp_eq_object(&inner.args[0], INTEGER(ctx, 2)));
+  ASSERT(tst, lisp_eq_object(&inner.args[1], INTEGER(ctx, 3)));
+  ASSERT_EQ_U(tst, outer.n_args, 2);
+  ASSERT(tst, lisp_eq_object(&outer.args[0], INTEGER(ctx, 1)));
+  ASSERT(tst, lisp_eq_object(&outer.args[1], INTEGER(ctx, 5)));
+
+  ASSERT_EQ_U(tst, ctx->env->n_values, 1u);
+  ASSERT(tst,      LISP_IS_INTEGER(ctx->env->values));
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 23);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  ASSERT_EQ_U(tst, mock_retire_all(), 0u);
+  lisp_free_lambda_mock(&inner);
+  lisp_free_lambda_mock(&outer);
+  lisp_free_unit_context(ctx);
+}
+
+static void test_lambda_eval_reg_mixed(unit_test_t * tst) 
+{
+  lisp_unit_context_t  * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                        tst);
+  lisp_cell_t            stack_lambda, reg_lambda, lambda;
+
+  /* register code called by the stack machine */
+  ASSERT_IS_OK(tst, lisp_lambda_compile_reg(ctx->env, &reg_lambda,
+                                            INTEGER(ctx, 7)));
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&reg_lambda, lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_U(tst, ctx->env->n_values, 1u);
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 7);
+
+  /* stack code called by register code */
+  ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env, &stack_lambda,
+                                        INTEGER(ctx, 8)));
+  ASSERT_IS_OK(tst, lisp_lambda_compile_reg(ctx->env, &lambda,
+                                            LIST(ctx, 
+                                                 &stack_lambda,
+                                                 NULL)));
+  ASSERT_IS_OK(tst, lisp_eval_lambda_reg(ctx->env,
+                                         LISP_AS(&lambda, lisp_lambda_t),
+                                         0));
+  ASSERT_EQ_U(tst, ctx->env->n_values, 1u);
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 8);
+  ASSERT_EQ_U(tst, ctx->env->call_stack_top, 1u);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+
+  /* undefined symbol */
+  ASSERT_IS_OK(tst, lisp_lambda_compile_reg(ctx->env, &lambda,
+                                            SYMBOL(ctx, "undefined")));
+  ASSERT_EQ_I(tst, lisp_eval_lambda_reg(ctx->env,
+                                        LISP_AS(&lambda, lisp_lambda_t),
+                                        0),
+              LISP_UNDEFINED);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  lisp_free_unit_context(ctx);
+}
+
+#ifdef LISP_JIT
+static void test_lambda_jit(unit_test_t * tst) 
+{
+  lisp_unit_context_t  * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                        tst);
+  lisp_lambda_mock_t     mock, inner;
+  lisp_cell_t            lambda;
+  lisp_cell_t          * builtin;
+  lisp_byte_code_t     * byte_code;
+
+  /* LDVD; RET */
+  ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env, &lambda,
+                                        INTEGER(ctx, 5)));
+  byte_code = LISP_AS(LISP_CAR(&lambda), lisp_byte_code_t);
+  ASSERT_IS_OK(tst, lisp_jit_compile(ctx->vm, byte_code));
+  ASSERT_NEQ_PTR(tst, byte_code->native, NULL);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&lambda, lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_U(tst, ctx->env->n_values, 1u);
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 5);
+  ASSERT_EQ_PTR(tst, byte_code->decoded, NULL);
+
+  /* PUSHD 1; PUSHD 2; JP to BUILTIN, both translated */
+  builtin = BUILTIN(ctx, lisp_lambda_mock_function, NULL);
+  ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env,
+                                        &lambda,
+                                        LIST(ctx, 
+                                             builtin,
+                                             INTEGER(ctx, 1),
+                                             INTEGER(ctx, 2),
+                                             NULL)));
+  ASSERT_IS_OK(tst, 
+               lisp_jit_compile(ctx->vm,
+                                LISP_AS(LISP_CAR(&lambda), 
+                                        lisp_byte_code_t)));
+  ASSERT_IS_OK(tst, 
+               lisp_jit_compile(ctx->vm,
+                                LISP_AS(LISP_CAR(builtin), 
+                                        lisp_byte_code_t)));
+  lisp_init_lambda_mock(&mock, ctx->vm, 1);
+  lisp_make_integer(&mock.values[0], 23);
+  mock_register(lisp_lambda_mock_function, NULL, &mock, NULL);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&lambda, lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_U(tst, mock.n_args, 2);
+  ASSERT(tst, lisp_eq_object(&mock.args[0], INTEGER(ctx, 1)));
+  ASSERT(tst, lisp_eq_object(&mock.args[1], INTEGER(ctx, 2)));
+  ASSERT_EQ_U(tst, ctx->env->n_values, 1u);
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 23);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  ASSERT_EQ_U(tst, mock_retire_all(), 0u);
+  lisp_free_lambda_mock(&mock);
+
+  /* LDVR a; RET */
+  ASSERT_IS_OK(tst, lisp_symbol_set(ctx->vm,
+                                    LISP_AS(SYMBOL(ctx, "a"), lisp_symbol_t),
+                                    INTEGER(ctx, 7)));
+  ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env, &lambda,
+                                        SYMBOL(ctx, "a")));
+  byte_code = LISP_AS(LISP_CAR(&lambda), lisp_byte_code_t);
+  ASSERT_IS_OK(tst, lisp_jit_compile(ctx->vm, byte_code));
+  ASSERT_NEQ_PTR(tst, byte_code->native, NULL);
+  lisp_push_halt(ctx->env);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&lambda, lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 7);
+
+  /* undefined symbol */
+  ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env, &lambda,
+                                        SYMBOL(ctx, "b")));
+  byte_code = LISP_AS(LISP_CAR(&lambda), lisp_byte_code_t);
+  ASSERT_IS_OK(tst, lisp_jit_compile(ctx->vm, byte_code));
+  ASSERT_EQ_I(tst, lisp_eval_lambda(ctx->env,
+                                    LISP_AS(&lambda, lisp_lambda_t),
+                                    0),
+              LISP_UNDEFINED);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+
+  /* (f (f 1) a): PUSHD 1; CALLR 1, f; PUSHV; LDVR a; PUSHV; JPR 2, f,
+     the machine code ends with CALLR, the rest is interpreted */
+  ASSERT_IS_OK(tst, lisp_symbol_set(ctx->vm,
+                                    LISP_AS(SYMBOL(ctx, "f"), lisp_symbol_t),
+                                    builtin));
+  ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env,
+                                        &lambda,
+                                        LIST(ctx, 
+                                             SYMBOL(ctx, "f"),
+                                             LIST(ctx, 
+                                                  SYMBOL(ctx, "f"),
+                                                  INTEGER(ctx, 1),
+                                                  NULL),
+                                             SYMBOL(ctx, "a"),
+                                             NULL)));
+  byte_code = LISP_AS(LISP_CAR(&lambda), lisp_byte_code_t);
+  ASSERT_IS_OK(tst, lisp_jit_compile(ctx->vm, byte_code));
+  lisp_init_lambda_mock(&inner, ctx->vm, 1);
+  lisp_init_lambda_mock(&mock, ctx->vm, 1);
+  lisp_make_integer(&inner.values[0], 5);
+  lisp_make_integer(&mock.values[0], 23);
+  mock_register(lisp_lambda_mock_function, NULL, &inner, NULL);
+  mock_register(lisp_lambda_mock_function, NULL, &mock, NULL);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&lambda, lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_U(tst, inner.n_args, 1u);
+  ASSERT(tst, lisp_eq_object(&inner.args[0], INTEGER(ctx, 1)));
+  ASSERT_EQ_U(tst, mock.n_args, 2u);
+  ASSERT(tst, lisp_eq_object(&mock.args[0], INTEGER(ctx, 5)));
+  ASSERT(tst, lisp_eq_object(&mock.args[1], INTEGER(ctx, 7)));
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 23);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  ASSERT_EQ_U(tst, mock_retire_all(), 0u);
+  lisp_free_lambda_mock(&inner);
+  lisp_free_lambda_mock(&mock);
+
+  /* (f a 2): LDVR a; PUSHV; PUSHD 2; JPR 2, f, all translated */
+  ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env,
+                                        &lambda,
+                                        LIST(ctx, 
+                                             SYMBOL(ctx, "f"),
+                                             SYMBOL(ctx, "a"),
+                                             INTEGER(ctx, 2),
+                                             NULL)));
+  byte_code = LISP_AS(LISP_CAR(&lambda), lisp_byte_code_t);
+  ASSERT_IS_OK(tst, lisp_jit_compile(ctx->vm, byte_code));
+  lisp_init_lambda_mock(&mock, ctx->vm, 1);
+  lisp_make_integer(&mock.values[0], 23);
+  mock_register(lisp_lambda_mock_function, NULL, &mock, NULL);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&lambda, lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_U(tst, mock.n_args, 2u);
+  ASSERT(tst, lisp_eq_object(&mock.args[0], INTEGER(ctx, 7)));
+  ASSERT(tst, lisp_eq_object(&mock.args[1], INTEGER(ctx, 2)));
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  ASSERT_EQ_PTR(tst, byte_code->decoded, NULL);
+  ASSERT_EQ_U(tst, mock_retire_all(), 0u);
+  lisp_free_lambda_mock(&mock);
+
+  /* register code has no template */
+  ASSERT_IS_OK(tst, lisp_lambda_compile_reg(ctx->env, &lambda,
+                                            INTEGER(ctx, 5)));
+  byte_code = LISP_AS(LISP_CAR(&lambda), lisp_byte_code_t);
+  ASSERT_EQ_I(tst, lisp_jit_compile(ctx->vm, byte_code), LISP_UNSUPPORTED);
+  ASSERT_EQ_PTR(tst, byte_code->native, NULL);
+  lisp_free_unit_context(ctx);
+}
+
+static void test_lambda_jit_threshold(unit_test_t * tst) 
+{
+  lisp_unit_context_t  * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                        tst);
+  lisp_cell_t            lambda;
+  lisp_byte_code_t     * byte_code;
+  lisp_size_t            i;
+  ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env, &lambda,
+                                        INTEGER(ctx, 5)));
+  byte_code = LISP_AS(LISP_CAR(&lambda), lisp_byte_code_t);
+  for(i = 1; i <= LISP_JIT_THRESHOLD; i++) 
+  {
+    ASSERT_EQ_PTR(tst, byte_code->native, NULL);
+    ctx->env->call_stack_top = 0;
+    lisp_push_halt(ctx->env);
+    ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                       LISP_AS(&lambda, lisp_lambda_t),
+                                       0));
+    ASSERT_EQ_I(tst, ctx->env->values->data.integer, 5);
+  }
+  ASSERT_NEQ_PTR(tst, byte_code->native, NULL);
+  ASSERT_EQ_U(tst, byte_code->n_calls, LISP_JIT_THRESHOLD);
+  lisp_free_unit_context(ctx);
+}
+
+static void test_lambda_jit_code_chunks(unit_test_t * tst) 
+{
+  lisp_unit_context_t  * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                        tst);
+  lisp_cell_t            lambda[2];
+  lisp_byte_code_t     * byte_code[2];
+  void                 * native;
+  lisp_memory_usage_t    before, usage;
+  lisp_size_t            i;
+  for(i = 0; i < 2; i++) 
+  {
+    ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env, &lambda[i],
+                                          INTEGER(ctx, i)));
+    byte_code[i] = LISP_AS(LISP_CAR(&lambda[i]), lisp_byte_code_t);
+  }
+  lisp_get_memory_usage(ctx->vm, &before);
+  ASSERT_EQ_U(tst, before.jit_code, 0u);
+  /* no room for a chunk */
+  ctx->vm->heap_limit = before.total + LISP_JIT_CHUNK_SIZE / 2;
+  ASSERT_IS_ALLOC_ERROR(tst, lisp_jit_compile(ctx->vm, byte_code[0]));
+  ASSERT_EQ_PTR(tst, byte_code[0]->native, NULL);
+  ctx->vm->heap_limit = 0;
+
+  /* both lambdas share one chunk */
+  ASSERT_IS_OK(tst, lisp_jit_compile(ctx->vm, byte_code[0]));
+  ASSERT_IS_OK(tst, lisp_jit_compile(ctx->vm, byte_code[1]));
+  lisp_get_memory_usage(ctx->vm, &usage);
+  ASSERT_GE_U(tst, usage.jit_code, LISP_JIT_CHUNK_SIZE);
+  ASSERT_LT_U(tst, usage.jit_code, 2 * LISP_JIT_CHUNK_SIZE);
+  ASSERT_EQ_U(tst, usage.total - before.total, usage.jit_code);
+  ASSERT(tst, (char*) byte_code[1]->native > (char*) byte_code[0]->native);
+
+  /* the chunk is reused when all of its code has been released */
+  native = byte_code[0]->native;
+  lisp_jit_free(byte_code[0]);
+  lisp_jit_free(byte_code[1]);
+  ASSERT_IS_OK(tst, lisp_jit_compile(ctx->vm, byte_code[1]));
+  ASSERT_EQ_PTR(tst, byte_code[1]->native, native);
+  ctx->env->call_stack_top = 0;
+  lisp_push_halt(ctx->env);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&lambda[1], lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 1);
+  lisp_get_memory_usage(ctx->vm, &before);
+  ASSERT_EQ_U(tst, before.jit_code, usage.jit_code);
+  lisp_free_unit_context(ctx);
+}
+#endif
+
+/* L_0 = (builtin 0), L_k = (L_k-1 k), deeper than the stack */
+#define TEST_TAIL_CALL_DEPTH (2 * LISP_MAX_STACK_SIZE)
+static void test_lambda_tail_call(unit_test_t * tst) 
+{
+  lisp_unit_context_t  * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                        tst);
+  lisp_lambda_mock_t     mock;
+  lisp_cell_t          * chain;
+  lisp_cell_t            lambda;
+  lisp_size_t            k;
+  chain = MALLOC(sizeof(lisp_cell_t) * (TEST_TAIL_CALL_DEPTH + 1));
+  ASSERT_NEQ_PTR(tst, chain, NULL);
+  lisp_copy_object_as_root(ctx->vm, 
+                           &chain[0], 
+                           BUILTIN(ctx, lisp_lambda_mock_function, NULL));
+  for(k = 1; k <= TEST_TAIL_CALL_DEPTH; k++) 
+  {
+    ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env,
+                                          &lambda, 
+                                          LIST(ctx, 
+                                               &chain[k - 1],
+                                               INTEGER(ctx, k),
+                                               NULL)));
+    lisp_copy_object_as_root(ctx->vm, &chain[k], &lambda);
+    lisp_unset_object(ctx->vm, &lambda);
+  }
+  lisp_init_lambda_mock(&mock, ctx->vm, 1);
+  lisp_make_integer(&mock.values[0], 23);
+  mock_register(lisp_lambda_mock_function, NULL, &mock, NULL);
+  ASSERT_IS_OK(tst, 
+               lisp_eval_lambda(ctx->env,
+                                LISP_AS(&chain[TEST_TAIL_CALL_DEPTH], 
+                                        lisp_lambda_t),
+                                0));
+
+  /* each call replaced the argument of its caller */
+  ASSERT_EQ_U(tst, mock.n_args, 1);
+  ASSERT(tst, lisp_eq_object(&mock.args[0], INTEGER(ctx, 1)));
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 23);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  ASSERT_EQ_U(tst, mock_retire_all(), 0u);
+  lisp_free_lambda_mock(&mock);
+
+  /* RET releases the arguments */
+  ASSERT_IS_OK(tst, lisp_lambda_compile(ctx->env, &lambda,
+                                        INTEGER(ctx, 7)));
+  lisp_push(ctx->env, INTEGER(ctx, 1));
+  lisp_push(ctx->env, TEST_OBJECT(ctx));
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&lambda, lisp_lambda_t),
+                                     2));
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 7);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  ASSERT(tst, LISP_IS_NIL(&ctx->env->stack[1]));
+
+  for(k = 0; k <= TEST_TAIL_CALL_DEPTH; k++) 
+  {
+    lisp_unset_object_root(ctx->vm, &chain[k]);
+  }
+  FREE(chain);
+  lisp_free_unit_context(ctx);
+}
+
 static void test_compile_form_arg_arg(unit_test_t * tst) 
 {
   lisp_unit_context_t * ctx;  
@@ -405,6 +899,213 @@ static void test_compile_form_phase2_failure(unit_test_t * tst)
   lisp_free_unit_context(ctx);
 }
 
+static void test_compile_call_head_call(unit_test_t * tst) 
+{
+  lisp_unit_context_t  * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                        tst);
+  lisp_lambda_mock_t     head, callee, outer;
+  lisp_cell_t            lambda;
+  lisp_cell_t          * builtin = BUILTIN(ctx,
+                                           lisp_lambda_mock_function,
+                                           NULL);
+
+  /* ((B) 1): the value of (B) is called with 1 */
+  ASSERT_IS_OK(tst,
+               lisp_lambda_compile(ctx->env,
+                                   &lambda, 
+                                   LIST(ctx, 
+                                        LIST(ctx, builtin, NULL),
+                                        INTEGER(ctx, 1),
+                                        NULL)));
+  ASSERT_DISASM(tst,
+                ctx,
+                &lambda,
+                NULL,
+                LIST(ctx, 
+                     SYMBOL(ctx, "CALL"),
+                     SYMBOL(ctx, "PUSHV"),
+                     SYMBOL(ctx, "PUSHD"),
+                     SYMBOL(ctx, "JPV"),
+                     NULL));
+  lisp_init_lambda_mock(&head,   ctx->vm, 1);
+  lisp_init_lambda_mock(&callee, ctx->vm, 1);
+  lisp_copy_object_as_root(ctx->vm, &head.values[0], builtin);
+  lisp_make_integer(&callee.values[0], 23);
+  mock_register(lisp_lambda_mock_function, NULL, &head,   NULL);
+  mock_register(lisp_lambda_mock_function, NULL, &callee, NULL);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&lambda, lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_U(tst, head.n_args, 0u);
+  ASSERT_EQ_U(tst, callee.n_args, 1u);
+  ASSERT(tst, lisp_eq_object(&callee.args[0], INTEGER(ctx, 1)));
+  ASSERT_EQ_U(tst, ctx->env->n_values, 1u);
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 23);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  ASSERT_EQ_U(tst, mock_retire_all(), 0u);
+  lisp_free_lambda_mock(&head);
+  lisp_free_lambda_mock(&callee);
+
+  /* (B 1 ((B) 2)): CALLV returns to the outer call */
+  ASSERT_IS_OK(tst,
+               lisp_lambda_compile(ctx->env,
+                                   &lambda, 
+                                   LIST(ctx, 
+                                        builtin,
+                                        INTEGER(ctx, 1),
+                                        LIST(ctx, 
+                                             LIST(ctx, builtin, NULL),
+                                             INTEGER(ctx, 2),
+                                             NULL),
+                                        NULL)));
+  ASSERT_DISASM(tst,
+                ctx,
+                &lambda,
+                NULL,
+                LIST(ctx, 
+                     SYMBOL(ctx, "PUSHD"),
+                     SYMBOL(ctx, "CALL"),
+                     SYMBOL(ctx, "PUSHV"),
+                     SYMBOL(ctx, "PUSHD"),
+                     SYMBOL(ctx, "CALLV"),
+                     SYMBOL(ctx, "PUSHV"),
+                     SYMBOL(ctx, "JP"),
+                     NULL));
+  lisp_init_lambda_mock(&head,   ctx->vm, 1);
+  lisp_init_lambda_mock(&callee, ctx->vm, 1);
+  lisp_init_lambda_mock(&outer,  ctx->vm, 1);
+  lisp_copy_object_as_root(ctx->vm, &head.values[0], builtin);
+  lisp_make_integer(&callee.values[0], 5);
+  lisp_make_integer(&outer.values[0], 23);
+  mock_register(lisp_lambda_mock_function, NULL, &head,   NULL);
+  mock_register(lisp_lambda_mock_function, NULL, &callee, NULL);
+  mock_register(lisp_lambda_mock_function, NULL, &outer,  NULL);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&lambda, lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_U(tst, callee.n_args, 1u);
+  ASSERT(tst, lisp_eq_object(&callee.args[0], INTEGER(ctx, 2)));
+  ASSERT_EQ_U(tst, outer.n_args, 2u);
+  ASSERT(tst, lisp_eq_object(&outer.args[0], INTEGER(ctx, 1)));
+  ASSERT(tst, lisp_eq_object(&outer.args[1], INTEGER(ctx, 5)));
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 23);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  ASSERT_EQ_U(tst, mock_retire_all(), 0u);
+  lisp_free_lambda_mock(&head);
+  lisp_free_lambda_mock(&callee);
+  lisp_free_lambda_mock(&outer);
+
+  /* the head is not a lambda */
+  ASSERT_IS_OK(tst,
+               lisp_lambda_compile(ctx->env,
+                                   &lambda, 
+                                   LIST(ctx, 
+                                        LIST(ctx, builtin, NULL),
+                                        INTEGER(ctx, 1),
+                                        NULL)));
+  lisp_init_lambda_mock(&head, ctx->vm, 1);
+  lisp_make_integer(&head.values[0], 7);
+  mock_register(lisp_lambda_mock_function, NULL, &head, NULL);
+  ASSERT_IS_TYPE_ERROR(tst, lisp_eval_lambda(ctx->env,
+                                             LISP_AS(&lambda, lisp_lambda_t),
+                                             0));
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  ASSERT_EQ_U(tst, mock_retire_all(), 0u);
+  lisp_free_lambda_mock(&head);
+  lisp_free_unit_context(ctx);
+}
+
+/* (quote X): LDVD X; RET */
+static int _compile_phase1_quote(struct lisp_vm_t  * vm, 
+                                 lisp_size_t       * instr_size,
+                                 const lisp_cell_t * expr)
+{
+  *instr_size = LISP_SIZ_LDVD + LISP_SIZ_RET;
+  return LISP_OK;
+}
+
+static int _compile_phase2_quote(struct lisp_vm_t  * vm,
+                                 lisp_cell_t       * cell,
+                                 lisp_instr_t      * instr,
+                                 const lisp_cell_t * expr)
+{
+  LISP_SET_INSTR(LISP_ASM_LDVD, instr, lisp_cell_t, *LISP_CAR(LISP_CDR(expr)));
+  instr+= LISP_SIZ_LDVD;
+  *instr = LISP_ASM_RET;
+  return LISP_OK;
+}
+
+static void test_compile_form_as_argument(unit_test_t * tst) 
+{
+  lisp_unit_context_t  * ctx = lisp_create_unit_context(&lisp_vm_default_param,
+                                                        tst);
+  lisp_lambda_mock_t     mock;
+  lisp_cell_t            lambda;
+  lisp_cell_t          * builtin = BUILTIN(ctx,
+                                           lisp_lambda_mock_function,
+                                           NULL);
+  ASSERT_IS_OK(tst, lisp_symbol_set(ctx->vm,
+                                    LISP_AS(SYMBOL(ctx, "quote"), 
+                                            lisp_symbol_t),
+                                    FORM(ctx,
+                                         _compile_phase1_quote,
+                                         _compile_phase2_quote)));
+
+  /* (B (quote 5) 2): the form is called as a lambda of its own */
+  ASSERT_IS_OK(tst,
+               lisp_lambda_compile(ctx->env,
+                                   &lambda, 
+                                   LIST(ctx, 
+                                        builtin,
+                                        LIST(ctx, 
+                                             SYMBOL(ctx, "quote"),
+                                             INTEGER(ctx, 5),
+                                             NULL),
+                                        INTEGER(ctx, 2),
+                                        NULL)));
+  ASSERT_DISASM(tst,
+                ctx,
+                &lambda,
+                NULL,
+                LIST(ctx, 
+                     SYMBOL(ctx, "CALL"),
+                     SYMBOL(ctx, "PUSHV"),
+                     SYMBOL(ctx, "PUSHD"),
+                     SYMBOL(ctx, "JP"),
+                     NULL));
+  lisp_init_lambda_mock(&mock, ctx->vm, 1);
+  lisp_make_integer(&mock.values[0], 23);
+  mock_register(lisp_lambda_mock_function, NULL, &mock, NULL);
+  ASSERT_IS_OK(tst, lisp_eval_lambda(ctx->env,
+                                     LISP_AS(&lambda, lisp_lambda_t),
+                                     0));
+  ASSERT_EQ_U(tst, mock.n_args, 2u);
+  ASSERT(tst, lisp_eq_object(&mock.args[0], INTEGER(ctx, 5)));
+  ASSERT(tst, lisp_eq_object(&mock.args[1], INTEGER(ctx, 2)));
+  ASSERT_EQ_I(tst, ctx->env->values->data.integer, 23);
+  ASSERT_EQ_U(tst, ctx->env->stack_top, 0u);
+  ASSERT_EQ_U(tst, mock_retire_all(), 0u);
+  lisp_free_lambda_mock(&mock);
+
+  /* a failing form fails the compilation */
+  ASSERT_IS_OK(tst, lisp_symbol_set(ctx->vm,
+                                    LISP_AS(SYMBOL(ctx, "myform"), 
+                                            lisp_symbol_t),
+                                    FORM(ctx,
+                                         lisp_compile_phase1_mock_failure,
+                                         lisp_compile_phase2_mock)));
+  ASSERT_IS_UNSUPPORTED(tst,
+                        lisp_lambda_compile(ctx->env,
+                                            &lambda, 
+                                            LIST(ctx, 
+                                                 builtin,
+                                                 LIST(ctx, 
+                                                      SYMBOL(ctx, "myform"),
+                                                      NULL),
+                                                 NULL)));
+  lisp_free_unit_context(ctx);
+}
+
 
 void test_lambda(unit_context_t * ctx)
 {
@@ -418,13 +1119,25 @@ void test_lambda(unit_context_t * ctx)
 
   TEST(suite, test_lisp_make_builtin_lambda);
   TEST(suite, test_lambda_compile_atom);
+  TEST(suite, test_lambda_decoded_instr);
   TEST(suite, test_lambda_compile_atom_object);
   TEST(suite, test_lambda_compile_nil);
   TEST(suite, test_lambda_compile_symbol);
   TEST(suite, test_lambda_compile_symbol_undefined);
+  TEST(suite, test_lambda_ldvr_cache);
   TEST(suite, test_compile_cons_builtin_arg_arg);
+  TEST(suite, test_lambda_compile_reg);
+  TEST(suite, test_lambda_eval_reg_mixed);
+  TEST(suite, test_lambda_tail_call);
+#ifdef LISP_JIT
+  TEST(suite, test_lambda_jit);
+  TEST(suite, test_lambda_jit_threshold);
+  TEST(suite, test_lambda_jit_code_chunks);
+#endif
 
   TEST(suite, test_compile_form_arg_arg);
   TEST(suite, test_compile_form_phase1_failure);
   TEST(suite, test_compile_form_phase2_failure);
+  TEST(suite, test_compile_call_head_call);
+  TEST(suite, test_compile_form_as_argument);
 }
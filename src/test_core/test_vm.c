@@ -1,9 +1,14 @@
+#include "config.h"
 #include "util/unit_test.h"
 #include "core/lisp_vm.h" 
 #include "util/xmalloc.h"
 #include "util/hash_table.h"
 #include "lisp_vm_check.h"
+#include "test_core/lisp_assertion.h"
 #include <stdio.h>
+#ifdef HAS_PTHREAD
+#include <pthread.h>
+#endif
 
 static void test_alloc_object(unit_test_t * tst)
 {
@@ -24,6 +29,133 @@ static void test_alloc_object_fail(unit_test_t * tst)
   memcheck_end();
 }
 
+static void test_alloc_object_size_classes(unit_test_t * tst)
+{
+  memcheck_begin();
+  lisp_vm_t * vm    = lisp_create_vm(&lisp_vm_default_param);
+  lisp_vm_t * other = lisp_create_vm(&lisp_vm_default_param);
+  void      * obj;
+  void      * obj2;
+  lisp_memory_usage_t usage;
+  lisp_get_memory_usage(vm, &usage);
+  /* freed blocks of a size class are reused by the same vm */
+  obj = MALLOC_VM_OBJECT(vm, 20, 2);
+  ASSERT_EQ_U(tst, LISP_OBJECT_REFCOUNT(obj), 2u);
+  FREE_OBJECT(obj);
+  obj2 = MALLOC_VM_OBJECT(other, 24, 1);
+  ASSERT_NEQ_PTR(tst, obj2, obj);
+  FREE_OBJECT(obj2);
+  obj2 = MALLOC_VM_OBJECT(vm, 24, 1);
+  ASSERT_EQ_PTR(tst, obj2, obj);
+  ASSERT_EQ_U(tst, LISP_OBJECT_REFCOUNT(obj2), 1u);
+  FREE_OBJECT(obj2);
+  /* large objects */
+  obj = MALLOC_VM_OBJECT(vm, 4096, 1);
+  ASSERT(tst, obj != NULL);
+  ASSERT_EQ_U(tst, LISP_OBJECT_REFCOUNT(obj), 1u);
+  ((char*) obj)[4095] = 1;
+  FREE_OBJECT(obj);
+  /* objects without vm */
+  obj = MALLOC_OBJECT(20, 1);
+  ASSERT(tst, obj != NULL);
+  FREE_OBJECT(obj);
+  ASSERT_EQ_U(tst, vm->mem_objects, usage.objects);
+  lisp_free_vm(other);
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+
+#ifdef HAS_PTHREAD
+static void * free_object_thread(void * obj)
+{
+  FREE_OBJECT(obj);
+  return NULL;
+}
+
+static void test_free_object_other_thread(unit_test_t * tst)
+{
+  memcheck_begin();
+  lisp_vm_t         * vm = lisp_create_vm(&lisp_vm_default_param);
+  lisp_memory_usage_t before, usage;
+  pthread_t           thread;
+  void              * obj;
+  void              * large;
+  lisp_get_memory_usage(vm, &before);
+  obj   = MALLOC_VM_OBJECT(vm, 20, 1);
+  large = MALLOC_VM_OBJECT(vm, 4096, 1);
+  ASSERT_NEQ_PTR(tst, obj, NULL);
+  ASSERT_NEQ_PTR(tst, large, NULL);
+  /* blocks freed by another thread are returned to the vm */
+  ASSERT_FALSE(tst, pthread_create(&thread, NULL, free_object_thread, obj));
+  pthread_join(thread, NULL);
+  ASSERT_FALSE(tst, pthread_create(&thread, NULL, free_object_thread, large));
+  pthread_join(thread, NULL);
+  lisp_get_memory_usage(vm, &usage);
+  ASSERT_EQ_U(tst, usage.objects, before.objects);
+  ASSERT_EQ_PTR(tst, MALLOC_VM_OBJECT(vm, 24, 1), obj);
+  FREE_OBJECT(obj);
+  lisp_get_memory_usage(vm, &usage);
+  ASSERT_EQ_U(tst, usage.objects, before.objects);
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+#endif
+
+static void test_heap_limit(unit_test_t * tst)
+{
+  memcheck_begin();
+  lisp_vm_param_t     param = lisp_vm_default_param;
+  lisp_vm_t         * vm;
+  lisp_memory_usage_t usage, usage2;
+  lisp_cell_t         str, cons;
+  param.cons_page_size = 16;
+  vm = lisp_create_vm(&param);
+  ASSERT_NEQ_PTR(tst, vm, NULL);
+  lisp_get_memory_usage(vm, &usage);
+  ASSERT(tst, usage.objects > 0);
+  ASSERT(tst, usage.symbols > 0);
+  ASSERT_EQ_U(tst, usage.total, (usage.cons_pages + usage.cons_tables +
+                                 usage.objects + usage.symbols + 
+                                 usage.jit_code));
+  /* objects are accounted until they are freed */
+  ASSERT_IS_OK(tst, lisp_make_string(vm, &str, "abc"));
+  lisp_get_memory_usage(vm, &usage2);
+  ASSERT(tst, usage2.objects > usage.objects);
+  lisp_unset_object(vm, &str);
+  lisp_get_memory_usage(vm, &usage2);
+  ASSERT_EQ_U(tst, usage2.objects, usage.objects);
+  ASSERT_IS_OK(tst, lisp_make_cons(vm, &cons));
+  lisp_get_memory_usage(vm, &usage2);
+  ASSERT_EQ_U(tst, usage2.cons_pages, 16 * sizeof(lisp_cons_t));
+  lisp_free_vm(vm);
+
+  /* allocations beyond the limit fail */
+  param.heap_limit = usage.total;
+  vm = lisp_create_vm(&param);
+  ASSERT_NEQ_PTR(tst, vm, NULL);
+  ASSERT_EQ_I(tst, lisp_make_string(vm, &str, "abc"), LISP_ALLOC_ERROR);
+  ASSERT(tst, LISP_IS_NIL(&str));
+  ASSERT_EQ_I(tst, lisp_make_cons(vm, &cons), LISP_ALLOC_ERROR);
+  /* room for one cons page */
+  vm->heap_limit = usage2.total;
+  ASSERT_IS_OK(tst, lisp_make_cons(vm, &cons));
+  while(vm->white_cons_top < vm->cons_table_size) 
+  {
+    ASSERT_IS_OK(tst, lisp_make_cons(vm, &cons));
+  }
+  ASSERT_EQ_I(tst, lisp_make_cons(vm, &cons), LISP_ALLOC_ERROR);
+  lisp_get_memory_usage(vm, &usage);
+  ASSERT(tst, usage.total <= vm->heap_limit);
+  vm->heap_limit = 0;
+  ASSERT_IS_OK(tst, lisp_make_string(vm, &str, "abc"));
+  lisp_unset_object(vm, &str);
+  lisp_free_vm(vm);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+
 static size_t count_allocs_for_create_vm()
 {
   memchecker_t * memcheck = memcheck_begin();
@@ -144,6 +276,54 @@ static void test_copy_object(unit_test_t * tst)
   memcheck_end();
 }
 
+static void test_unset_object_deferred(unit_test_t * tst)
+{
+  memcheck_begin();
+  lisp_cell_t    obj;
+  lisp_cell_t    copy;
+  int            flags;
+  lisp_vm_t    * vm;
+  lisp_type_id_t  id = 0;
+  lisp_size_t    i;
+  vm = lisp_create_vm(&lisp_vm_default_param);
+  ASSERT_NEQ_PTR(tst, vm, NULL);
+  ASSERT_FALSE(tst, lisp_register_object_type(vm,
+					      "TEST",
+					      lisp_test_object_destructor,
+                                              NULL,
+					      &id));
+  flags = 0;
+  ASSERT_FALSE(tst, lisp_make_test_object(&obj, &flags, id));
+  ASSERT_FALSE(tst, lisp_copy_object(vm, &copy, &obj));
+  /* the object survives until the flush */
+  ASSERT_FALSE(tst, lisp_unset_object_deferred(vm, &obj));
+  ASSERT(tst, LISP_IS_NIL(&obj));
+  ASSERT_FALSE(tst, lisp_unset_object_deferred(vm, &copy));
+  ASSERT_EQ_U(tst, vm->deferred_unset_top, 2u);
+  ASSERT_EQ_I(tst, flags, TEST_OBJECT_STATE_INIT);
+  lisp_flush_deferred_unset(vm);
+  ASSERT_EQ_U(tst, vm->deferred_unset_top, 0u);
+  ASSERT_EQ_I(tst, flags, TEST_OBJECT_STATE_FREE);
+
+  /* a full buffer is flushed */
+  ASSERT_FALSE(tst, lisp_make_test_object(&obj, &flags, id));
+  for(i = 0; i < LISP_DEFERRED_UNSET_SIZE; i++) 
+  {
+    ASSERT_FALSE(tst, lisp_copy_object(vm, &copy, &obj));
+    ASSERT_FALSE(tst, lisp_unset_object_deferred(vm, &copy));
+  }
+  ASSERT_EQ_U(tst, vm->deferred_unset_top, LISP_DEFERRED_UNSET_SIZE);
+  ASSERT_EQ_U(tst, LISP_REFCOUNT(&obj), LISP_DEFERRED_UNSET_SIZE + 1);
+  ASSERT_FALSE(tst, lisp_unset_object_deferred(vm, &obj));
+  ASSERT_EQ_U(tst, vm->deferred_unset_top, 1u);
+  ASSERT_EQ_I(tst, flags, TEST_OBJECT_STATE_INIT);
+  /* pending decrements are applied by lisp_free_vm */
+  lisp_free_vm(vm);
+  ASSERT_EQ_I(tst, flags, TEST_OBJECT_STATE_FREE);
+  ASSERT_MEMCHECK(tst);
+  memcheck_end();
+}
+
 static void _test_init_objects_to_copy(unit_test_t * tst,
 				       lisp_vm_t   * vm,
 				       lisp_cell_t   from[],
@@ -408,9 +588,15 @@ void test_vm(unit_context_t * ctx)
   unit_suite_t * suite = unit_create_suite(ctx, "vm");
   TEST(suite, test_alloc_object);
   TEST(suite, test_alloc_object_fail);
+  TEST(suite, test_alloc_object_size_classes);
+#ifdef HAS_PTHREAD
+  TEST(suite, test_free_object_other_thread);
+#endif
+  TEST(suite, test_heap_limit);
   TEST(suite, test_alloc_vm_fail);
   TEST(suite, test_object_without_explicit_destructor);
   TEST(suite, test_copy_object);
+  TEST(suite, test_unset_object_deferred);
   TEST(suite, test_copy_n_objects);
   TEST(suite, test_copy_object_as_root_and_unset_root);
   TEST(suite, test_copy_object_as_root_fail);